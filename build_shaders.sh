@@ -2,3 +2,4 @@
 
 glslangValidator -V shaders/simple.vert -o shaders/simple.vert.spv
 glslangValidator -V shaders/simple.frag -o shaders/simple.frag.spv
+glslangValidator -V shaders/cull.comp -o shaders/cull.comp.spv
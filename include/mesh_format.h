@@ -0,0 +1,187 @@
+/*
+ * Binary mesh file, written by meshconv and mmap'ed by vulkanxcbc
+ * C (C99)
+ *
+ *  MeshFileHeader
+ *  vertex blob at vertexDataOffset, vertexCount * layout.stride bytes, in the GPU vertex layout
+ *  index blob at indexDataOffset, indexCount * indexSize bytes, 16 or 32 bit
+ *
+ * Little endian. The blobs are aligned to MESH_FILE_ALIGNMENT and are
+ * copied into the staging buffer as they are.
+ */
+
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#define MESH_FILE_MAGIC 0x4853454du /* "MESH" */
+#define MESH_FILE_VERSION 1u
+#define MESH_FILE_ALIGNMENT 16u
+
+//the normal is octahedron encoded in 2 x snorm16 and the color is RGBA8 unorm in every layout,
+//positions are float, half or snorm16, snorm16 positions are dequantized with the mesh transform
+typedef enum{
+    MESH_VERTEX_FORMAT_FLOAT,
+    MESH_VERTEX_FORMAT_HALF,
+    MESH_VERTEX_FORMAT_SNORM16,
+    MESH_VERTEX_FORMAT_COUNT
+}MeshVertexFormat;
+
+typedef struct{
+    const char *name;
+    uint32_t stride;
+    uint32_t normalOffset;
+    uint32_t colorOffset;
+    bool quantized;
+}MeshVertexLayout;
+
+static const MeshVertexLayout meshVertexLayouts[MESH_VERTEX_FORMAT_COUNT] = {
+    {"float",   20, 12, 16, false},
+    {"half",    16,  8, 12, false},
+    {"snorm16", 16,  8, 12, true},
+};
+
+//vertex layout descriptor, must match meshVertexLayouts[format]
+typedef struct{
+    uint32_t format;
+    uint32_t stride;
+    uint32_t normalOffset;
+    uint32_t colorOffset;
+}MeshFileLayout;
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t indexSize;
+    MeshFileLayout layout;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    //bounds of the model space positions
+    float boundsMin[3];
+    float boundsMax[3];
+    float radius;
+    //model space position = position * dequantScale + dequantOffset, identity unless quantized
+    float dequantScale;
+    float dequantOffset[3];
+    uint32_t reserved;
+}MeshFileHeader;
+
+//round to nearest, out of range values become infinity
+static inline uint16_t meshFloatToHalf(float value)
+{
+    union { float f; uint32_t u; } bits = { value };
+
+    uint32_t sign = (bits.u >> 16) & 0x8000u;
+    uint32_t mantissa = bits.u & 0x7fffffu;
+    int32_t exponent = (int32_t)((bits.u >> 23) & 0xffu) - 127 + 15;
+
+    if (((bits.u >> 23) & 0xffu) == 0xffu) return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0));
+
+    if (exponent >= 31) return (uint16_t)(sign | 0x7c00u);
+
+    //subnormal half
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return (uint16_t)sign;
+
+        mantissa |= 0x800000u;
+
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+
+        if ((mantissa >> (shift - 1)) & 1u) half++;
+
+        return (uint16_t)(sign | half);
+    }
+
+    //a rounding carry into the exponent still gives the right value
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+
+    if (mantissa & 0x1000u) half++;
+
+    return (uint16_t)half;
+}
+
+static inline int16_t meshPackSnorm16(float value)
+{
+    return (int16_t)lrintf(fminf(fmaxf(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+static inline uint8_t meshPackUnorm8(float value)
+{
+    return (uint8_t)lrintf(fminf(fmaxf(value, 0.0f), 1.0f) * 255.0f);
+}
+
+//normal projected on the octahedron |x|+|y|+|z| = 1 and the lower half folded over the upper one,
+//decoded in simple.vert
+static inline void meshOctEncodeNormal(const float normal[3], int16_t encoded[2])
+{
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+
+    if (length == 0.0f)
+    {
+        encoded[0] = encoded[1] = 0;
+        return;
+    }
+
+    float u = normal[0] / length;
+    float v = normal[1] / length;
+
+    if (normal[2] < 0.0f)
+    {
+        float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+
+        u = foldedU;
+        v = foldedV;
+    }
+
+    encoded[0] = meshPackSnorm16(u);
+    encoded[1] = meshPackSnorm16(v);
+}
+
+//one vertex in meshVertexLayouts[format], quantized positions are (position - dequantOffset) / dequantScale
+static inline void meshPackVertex(MeshVertexFormat format, const float position[3], const float normal[3],
+    const float color[3], float dequantScale, const float dequantOffset[3], uint8_t *out)
+{
+    const MeshVertexLayout *layout = &meshVertexLayouts[format];
+
+    if (format == MESH_VERTEX_FORMAT_FLOAT)
+    {
+        memcpy(out, position, 3 * sizeof(float));
+    }
+    else
+    {
+        uint16_t packed[4];
+
+        for (int i = 0; i < 3; ++i)
+        {
+            if (layout->quantized)
+                packed[i] = (uint16_t)meshPackSnorm16((position[i] - dequantOffset[i]) / dequantScale);
+            else
+                packed[i] = meshFloatToHalf(position[i]);
+        }
+
+        packed[3] = layout->quantized ? (uint16_t)meshPackSnorm16(1.0f) : meshFloatToHalf(1.0f);
+
+        memcpy(out, packed, sizeof packed);
+    }
+
+    int16_t encodedNormal[2];
+
+    meshOctEncodeNormal(normal, encodedNormal);
+    memcpy(out + layout->normalOffset, encodedNormal, sizeof encodedNormal);
+
+    uint8_t packedColor[4] = { meshPackUnorm8(color[0]), meshPackUnorm8(color[1]), meshPackUnorm8(color[2]), 255 };
+
+    memcpy(out + layout->colorOffset, packedColor, sizeof packedColor);
+}
+
+#endif
@@ -3,6 +3,8 @@
  * Vulkan, XCB, C (C99)
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #define OPTPARSE_IMPLEMENTATION
 #define OPTPARSE_API static
 #include "optparse.h"
@@ -17,7 +19,18 @@
 #include <ctype.h>
 #include <math.h>
 #include <stddef.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include "linmath.h"
+#include "mesh_format.h"
 
 #define VK_USE_PLATFORM_XCB_KHR
 #include <vulkan/vulkan.h>
@@ -57,6 +70,8 @@ if (pfn_##name == NULL) \
 
 #define SWAP_CHAIN_IMAGE_COUNT 2
 
+#define MAX_FRAMES_IN_FLIGHT 4
+
 #define COLOR_RESET "\x1B[0m"
 #define COLOR_RED "\x1B[31m"
 #define COLOR_GREEN "\x1B[32m"
@@ -70,6 +85,7 @@ PFN_vkGetInstanceProcAddr pfn_vkGetInstanceProcAddr = NULL;
 PFN_vkEnumerateInstanceLayerProperties pfn_vkEnumerateInstanceLayerProperties = NULL;
 PFN_vkEnumerateInstanceExtensionProperties pfn_vkEnumerateInstanceExtensionProperties = NULL;
 PFN_vkCreateInstance pfn_vkCreateInstance = NULL;
+PFN_vkEnumerateInstanceVersion pfn_vkEnumerateInstanceVersion = NULL;
 
 PFN_vkDestroyInstance pfn_vkDestroyInstance = NULL;
 #ifdef DEBUG
@@ -90,6 +106,9 @@ PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR pfn_vkGetPhysicalDeviceSurfaceCapa
 PFN_vkGetPhysicalDeviceSurfaceFormatsKHR pfn_vkGetPhysicalDeviceSurfaceFormatsKHR = NULL;
 PFN_vkGetPhysicalDeviceSurfacePresentModesKHR pfn_vkGetPhysicalDeviceSurfacePresentModesKHR = NULL;
 PFN_vkGetPhysicalDeviceMemoryProperties pfn_vkGetPhysicalDeviceMemoryProperties = NULL;
+PFN_vkGetPhysicalDeviceFeatures pfn_vkGetPhysicalDeviceFeatures = NULL;
+PFN_vkGetPhysicalDeviceFormatProperties pfn_vkGetPhysicalDeviceFormatProperties = NULL;
+PFN_vkGetPhysicalDeviceFeatures2 pfn_vkGetPhysicalDeviceFeatures2 = NULL;
 
 PFN_vkDestroyDevice pfn_vkDestroyDevice = NULL;
 PFN_vkGetDeviceQueue pfn_vkGetDeviceQueue = NULL;
@@ -104,6 +123,10 @@ PFN_vkDestroySwapchainKHR pfn_vkDestroySwapchainKHR = NULL;
 PFN_vkGetSwapchainImagesKHR pfn_vkGetSwapchainImagesKHR = NULL;
 PFN_vkCreateImageView pfn_vkCreateImageView = NULL;
 PFN_vkDestroyImageView pfn_vkDestroyImageView = NULL;
+PFN_vkCreateImage pfn_vkCreateImage = NULL;
+PFN_vkDestroyImage pfn_vkDestroyImage = NULL;
+PFN_vkGetImageMemoryRequirements pfn_vkGetImageMemoryRequirements = NULL;
+PFN_vkBindImageMemory pfn_vkBindImageMemory = NULL;
 PFN_vkCreateRenderPass pfn_vkCreateRenderPass = NULL;
 PFN_vkDestroyRenderPass pfn_vkDestroyRenderPass = NULL;
 PFN_vkCreateFramebuffer pfn_vkCreateFramebuffer = NULL;
@@ -120,6 +143,8 @@ PFN_vkCreateCommandPool pfn_vkCreateCommandPool = NULL;
 PFN_vkDestroyCommandPool pfn_vkDestroyCommandPool = NULL;
 PFN_vkAllocateCommandBuffers pfn_vkAllocateCommandBuffers = NULL;
 PFN_vkFreeCommandBuffers pfn_vkFreeCommandBuffers = NULL;
+PFN_vkResetCommandPool pfn_vkResetCommandPool = NULL;
+PFN_vkCmdExecuteCommands pfn_vkCmdExecuteCommands = NULL;
 PFN_vkCreateShaderModule pfn_vkCreateShaderModule = NULL;
 PFN_vkDestroyShaderModule pfn_vkDestroyShaderModule = NULL;
 PFN_vkCreateDescriptorSetLayout pfn_vkCreateDescriptorSetLayout = NULL;
@@ -133,6 +158,9 @@ PFN_vkCreatePipelineLayout pfn_vkCreatePipelineLayout = NULL;
 PFN_vkDestroyPipelineLayout pfn_vkDestroyPipelineLayout = NULL;
 PFN_vkCreateGraphicsPipelines pfn_vkCreateGraphicsPipelines = NULL;
 PFN_vkDestroyPipeline pfn_vkDestroyPipeline = NULL;
+PFN_vkCreatePipelineCache pfn_vkCreatePipelineCache = NULL;
+PFN_vkDestroyPipelineCache pfn_vkDestroyPipelineCache = NULL;
+PFN_vkGetPipelineCacheData pfn_vkGetPipelineCacheData = NULL;
 PFN_vkAcquireNextImageKHR pfn_vkAcquireNextImageKHR = NULL;
 PFN_vkBeginCommandBuffer pfn_vkBeginCommandBuffer = NULL;
 PFN_vkCmdBeginRenderPass pfn_vkCmdBeginRenderPass = NULL;
@@ -146,9 +174,25 @@ PFN_vkQueueSubmit pfn_vkQueueSubmit = NULL;
 PFN_vkQueuePresentKHR pfn_vkQueuePresentKHR = NULL;
 PFN_vkCmdDraw pfn_vkCmdDraw = NULL;
 PFN_vkCmdDrawIndexed pfn_vkCmdDrawIndexed = NULL;
+PFN_vkCmdDrawIndexedIndirect pfn_vkCmdDrawIndexedIndirect = NULL;
+PFN_vkCmdDrawIndexedIndirectCountKHR pfn_vkCmdDrawIndexedIndirectCountKHR = NULL;
+PFN_vkCreateComputePipelines pfn_vkCreateComputePipelines = NULL;
+PFN_vkCmdDispatch pfn_vkCmdDispatch = NULL;
+PFN_vkCmdFillBuffer pfn_vkCmdFillBuffer = NULL;
+PFN_vkCmdPushConstants pfn_vkCmdPushConstants = NULL;
+PFN_vkCmdSetViewport pfn_vkCmdSetViewport = NULL;
+PFN_vkCmdSetScissor pfn_vkCmdSetScissor = NULL;
 PFN_vkDeviceWaitIdle pfn_vkDeviceWaitIdle = NULL;
 PFN_vkCmdCopyBuffer pfn_vkCmdCopyBuffer = NULL;
 PFN_vkQueueWaitIdle pfn_vkQueueWaitIdle = NULL;
+PFN_vkCreateQueryPool pfn_vkCreateQueryPool = NULL;
+PFN_vkDestroyQueryPool pfn_vkDestroyQueryPool = NULL;
+PFN_vkGetQueryPoolResults pfn_vkGetQueryPoolResults = NULL;
+PFN_vkCmdResetQueryPool pfn_vkCmdResetQueryPool = NULL;
+PFN_vkCmdWriteTimestamp pfn_vkCmdWriteTimestamp = NULL;
+PFN_vkCmdPipelineBarrier pfn_vkCmdPipelineBarrier = NULL;
+PFN_vkGetSemaphoreCounterValue pfn_vkGetSemaphoreCounterValue = NULL;
+PFN_vkWaitSemaphores pfn_vkWaitSemaphores = NULL;
 
 #ifdef DEBUG
 struct sUserData{
@@ -161,6 +205,20 @@ struct sUserData sUsrDt;
 bool g_Quit = false;
 bool g_Ready = false;
 
+volatile sig_atomic_t g_Interrupted = 0;
+
+bool g_Headless = false;
+
+//window is unmapped (minimized) or fully obscured, nothing is rendered
+bool g_WindowHidden = false;
+
+//frame limiter, --fps-limit N, 0 is unlimited
+uint32_t g_FpsLimit = 0;
+
+xcb_connection_t *g_Connection = NULL;
+xcb_window_t g_Window = 0;
+xcb_intern_atom_reply_t *g_AtomReply = NULL;
+
 int g_MousePosX = 0;
 int g_MousePosY = 0;
 int g_MousePosOldX = 0;
@@ -191,6 +249,9 @@ uint32_t g_InstanceExtensionArrayCount = 0;
 
 VkInstance g_Instance = VK_NULL_HANDLE;
 
+//1.2 when the loader supports it, 1.0 otherwise
+uint32_t g_InstanceApiVersion = VK_API_VERSION_1_0;
+
 #ifdef DEBUG
 VkDebugUtilsMessengerEXT g_DebugMessenger = NULL;
 #endif
@@ -200,6 +261,7 @@ VkSurfaceKHR g_Surface = NULL;
 uint32_t g_PhysicalDeviceCount = 0;
 VkPhysicalDevice* g_PhysicalDevices = NULL;
 VkPhysicalDevice g_SelectedPhysicalDevice = VK_NULL_HANDLE;
+VkPhysicalDeviceProperties g_PhysicalDeviceProperties;
 
 #ifdef DEBUG
 const char *g_DeviceLayers[] = { "VK_LAYER_KHRONOS_validation" };
@@ -211,9 +273,9 @@ char** g_DeviceLayersArray = NULL;
 uint32_t g_DeviceLayersArrayCount = 0;
 
 #ifdef DEBUG
-const char *g_DeviceExtensions[] = {"VK_KHR_swapchain"};
+const char *g_DeviceExtensions[] = {"VK_KHR_swapchain", "VK_KHR_draw_indirect_count"};
 #else
-const char *g_DeviceExtensions[] = {"VK_KHR_swapchain"};
+const char *g_DeviceExtensions[] = {"VK_KHR_swapchain", "VK_KHR_draw_indirect_count"};
 #endif
 
 char** g_DeviceExtArray = NULL;
@@ -229,14 +291,24 @@ VkQueue g_GraphicsQueue = VK_NULL_HANDLE;
 VkQueue g_PresentQueue = VK_NULL_HANDLE;
 VkQueue g_TransferQueue = VK_NULL_HANDLE;
 
-VkSemaphore g_semaphoreImageAvailableArr[SWAP_CHAIN_IMAGE_COUNT] = {NULL};
-VkSemaphore g_semaphoreRenderFinishedArr[SWAP_CHAIN_IMAGE_COUNT] = {NULL};
+//frames the CPU may record ahead of the GPU, --frames-in-flight, independent of the image count
+uint32_t g_FramesInFlight = 2;
 
-VkFence fenceArr[SWAP_CHAIN_IMAGE_COUNT] = {NULL};
+VkSemaphore g_semaphoreImageAvailableArr[MAX_FRAMES_IN_FLIGHT] = {NULL};
+VkSemaphore g_semaphoreRenderFinishedArr[MAX_FRAMES_IN_FLIGHT] = {NULL};
+
+VkFence fenceArr[MAX_FRAMES_IN_FLIGHT] = {NULL};
+
+//fence of the frame that last used the swapchain image, NULL if none
+VkFence *g_ImagesInFlight = NULL;
 
 VkSurfaceFormatKHR g_SurfaceFormat = {VK_FORMAT_B8G8R8A8_UNORM,VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
 VkPresentModeKHR g_PresentMode = VK_PRESENT_MODE_FIFO_KHR;
 
+//--present-mode, without it the lowest latency mode available is used
+bool g_PresentModeRequested = false;
+VkPresentModeKHR g_RequestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+
 VkExtent2D g_SwapChainExtent;
 
 uint32_t g_ImageCount = 0;
@@ -249,30 +321,276 @@ VkImage* g_SwapChainImages = NULL;
 
 VkImageView *g_SwapChainImageViews = NULL;
 
+//device memory allocator: memory is taken from the driver in large blocks,
+//buffers and images are sub-allocated from them (maxMemoryAllocationCount is small, often 4096)
+#define MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+#define MEMORY_MAX_BLOCKS 256
+
+typedef struct{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+}MemoryRange;
+
+typedef struct{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    uint32_t memoryTypeIndex;
+    //optimal tiling images and buffers never share a block, so bufferImageGranularity can't be violated
+    bool optimalTiling;
+    //allocation larger than half a block, gets a block of its own
+    bool dedicated;
+    char *mapped;
+    //free ranges sorted by offset, neighbours are merged on free
+    MemoryRange *freeRanges;
+    uint32_t freeRangeCount;
+    uint32_t freeRangeCapacity;
+    uint32_t allocationCount;
+}MemoryBlock;
+
+typedef struct{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    //NULL unless the memory is host visible
+    char *mapped;
+    int32_t blockIndex;
+}MemoryAllocation;
+
+typedef struct{
+    uint32_t deviceAllocationCount;
+    uint32_t allocationCount;
+    uint32_t totalAllocationCount;
+    VkDeviceSize bytesAllocated;
+    VkDeviceSize bytesUsed;
+    VkDeviceSize peakBytesUsed;
+}MemoryStats;
+
+VkPhysicalDeviceMemoryProperties g_MemoryProperties;
+MemoryBlock g_MemoryBlocks[MEMORY_MAX_BLOCKS];
+MemoryStats g_MemoryStats = {0};
+
+//upload engine: buffer copies are batched and submitted on the transfer queue,
+//a timeline semaphore tracks their completion and hands the data over to the graphics queue
+#define UPLOAD_BATCH_COUNT 4
+#define UPLOAD_MAX_COPIES 64
+
+typedef struct{
+    VkBuffer srcBuffer;
+    VkBuffer dstBuffer;
+    VkBufferCopy region;
+    VkPipelineStageFlags dstStageMask;
+    VkAccessFlags dstAccessMask;
+}UploadCopy;
+
+typedef struct{
+    VkCommandBuffer transferCommandBuffer;
+    //acquire half of the ownership transfer, only used when the queue families differ
+    VkCommandBuffer acquireCommandBuffer;
+    //timeline value signalled when the batch is done, 0 if the batch is free
+    uint64_t timelineValue;
+    //staging ring position after the batch's data, the ring tail moves here once the batch is done
+    VkDeviceSize stagingRingEnd;
+}UploadBatch;
+
+//Vulkan 1.2 instance, device and the timelineSemaphore feature,
+//without it transfers go to the graphics queue and are waited for
+bool g_TimelineSemaphoreSupported = false;
+
+VkCommandPool g_UploadCommandPool = VK_NULL_HANDLE;
+VkCommandPool g_UploadAcquireCommandPool = VK_NULL_HANDLE;
+VkSemaphore g_UploadTimeline = VK_NULL_HANDLE;
+uint64_t g_UploadTimelineValue = 0;
+
+UploadBatch g_UploadBatches[UPLOAD_BATCH_COUNT];
+uint32_t g_UploadBatchIndex = 0;
+uint32_t g_UploadPendingBatchCount = 0;
+
+//recorded by uploadBuffer(), submitted by flushUploads()
+UploadCopy g_UploadCopies[UPLOAD_MAX_COPIES];
+uint32_t g_UploadCopyCount = 0;
+
+//staging ring, persistently mapped, --staging-size in MiB.
+//head and tail only grow, the position in the buffer is head % size
+#define STAGING_RING_DEFAULT_SIZE (64ull * 1024 * 1024)
+#define STAGING_RING_ALIGNMENT 16
+
+VkBuffer g_StagingRingBuffer = VK_NULL_HANDLE;
+MemoryAllocation g_StagingRingMemory = {0};
+VkDeviceSize g_StagingRingSize = STAGING_RING_DEFAULT_SIZE;
+VkDeviceSize g_StagingRingHead = 0;
+VkDeviceSize g_StagingRingTail = 0;
+VkDeviceSize g_StagingRingPeak = 0;
+
+//headless mode, g_SwapChainImages are allocated by the program itself
+MemoryAllocation *g_OffscreenImageMemory = NULL;
+uint32_t g_OffscreenImageIndex = 0;
+
 VkRenderPass g_RenderPass = NULL;
 VkFramebuffer* g_FrameBuffers = NULL;
 
+//one depth buffer for all frames in flight, cleared at the start of the render pass and never stored,
+//so tilers can keep it in tile memory and back it with lazily allocated memory
+VkFormat g_DepthFormat = VK_FORMAT_UNDEFINED;
+VkImage g_DepthImage = VK_NULL_HANDLE;
+VkImageView g_DepthImageView = VK_NULL_HANDLE;
+MemoryAllocation g_DepthImageMemory = {0};
+
+//--msaa, color and depth are multisampled and the color is resolved into the swapchain image
+//at the end of the subpass, the multisampled images are transient like the depth buffer
+VkSampleCountFlagBits g_MsaaSamples = VK_SAMPLE_COUNT_1_BIT;
+VkImage g_MsaaColorImage = VK_NULL_HANDLE;
+VkImageView g_MsaaColorImageView = VK_NULL_HANDLE;
+MemoryAllocation g_MsaaColorImageMemory = {0};
+
+//swapchain recreation: dirty is rebuilt when convenient, out of date can't be rendered to
+bool g_SwapChainDirty = false;
+bool g_SwapChainOutOfDate = false;
+
+//resize events are coalesced, the swapchain is rebuilt once they settle
+#define RESIZE_SETTLE_TIME_NS 50000000ull
+#define RESIZE_MAX_DELAY_NS 200000000ull
+
+bool g_ResizePending = false;
+uint64_t g_ResizeFirstTime = 0;
+uint64_t g_ResizeLastTime = 0;
+
 const float TORAD = M_PI / 180.0f;
 
+//authoring format of the built-in meshes, packed into meshVertexLayouts[g_VertexFormat] when uploaded
 typedef struct{
 	float x,y,z,w;
     float r,g,b;
+    float nx,ny,nz;
 }Vertex;
 
+//the mega vertex buffer uses the layouts of mesh_format.h, --vertex-format or the mesh file picks one
+static const VkFormat g_VertexPositionFormats[MESH_VERTEX_FORMAT_COUNT] = {
+    VK_FORMAT_R32G32B32_SFLOAT,
+    VK_FORMAT_R16G16B16A16_SFLOAT,
+    VK_FORMAT_R16G16B16A16_SNORM
+};
+
+MeshVertexFormat g_VertexFormat = MESH_VERTEX_FORMAT_FLOAT;
+
+//--mesh, the file is mapped from the start of the uploads until its blobs are in the staging ring
+char *g_MeshFileName = NULL;
+const unsigned char *g_MeshFileData = NULL;
+size_t g_MeshFileSize = 0;
+
 VkBuffer g_VertexBuffer = NULL;
-VkDeviceMemory g_VertexBufferDeviceMemory = VK_NULL_HANDLE;
+MemoryAllocation g_VertexBufferMemory = {0};
 
 VkBuffer g_IndexBuffer = NULL;
-VkDeviceMemory g_IndexBufferDeviceMemory = VK_NULL_HANDLE;
+MemoryAllocation g_IndexBufferMemory = {0};
+
+//per instance attributes, vertex binding 1 with VK_VERTEX_INPUT_RATE_INSTANCE
+typedef struct{
+    float x,y,z,scale;
+    float r,g,b,a;
+}InstanceData;
+
+uint32_t g_InstanceCount = 1;
 
-VkBuffer g_StagingBuffer = NULL;
-VkDeviceMemory g_StagingBufferDeviceMemory = VK_NULL_HANDLE;
+VkBuffer g_InstanceBuffer = NULL;
+MemoryAllocation g_InstanceBufferMemory = {0};
+
+//one pool per frame in flight, reset as a whole once the frame's fence is signaled
+VkCommandPool g_FrameCommandPools[MAX_FRAMES_IN_FLIGHT] = {NULL};
+VkCommandBuffer g_FrameCommandBuffers[MAX_FRAMES_IN_FLIGHT] = {NULL};
+
+//mega buffers, every mesh lives in g_VertexBuffer/g_IndexBuffer and a draw selects it
+//with vertexOffset and firstIndex, so one bind serves the whole scene
+#define MEGA_VERTEX_BUFFER_SIZE (16u << 20)
+#define MEGA_INDEX_BUFFER_SIZE (8u << 20)
+#define MAX_MESHES 64
+
+//model space position = quantized position * dequantScale + dequantOffset,
+//folded into the instances, so the shader never sees it
+typedef struct{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    float radius;
+    float dequantScale;
+    float dequantOffset[3];
+}Mesh;
+
+Mesh g_Meshes[MAX_MESHES];
+uint32_t g_MeshCount = 0;
+uint32_t g_MegaVertexCount = 0;
+uint32_t g_MegaIndexCount = 0;
+
+//a mesh file may need bigger mega buffers and 32 bit indices, the built-in meshes are 16 bit
+VkDeviceSize g_MegaVertexBufferSize = MEGA_VERTEX_BUFFER_SIZE;
+VkDeviceSize g_MegaIndexBufferSize = MEGA_INDEX_BUFFER_SIZE;
+VkIndexType g_IndexType = VK_INDEX_TYPE_UINT16;
+uint32_t g_IndexSize = sizeof(uint16_t);
+
+//draws come from a GPU buffer of VkDrawIndexedIndirectCommand written every frame, --direct turns it off
+bool g_IndirectDraws = true;
+bool g_MultiDrawIndirect = false;
+VkBuffer g_IndirectBuffer = NULL;
+MemoryAllocation g_IndirectBufferMemory = {0};
+
+//objects get their own instance range and so a place in the scene, needs drawIndirectFirstInstance
+#define OBJECT_SPACING 1.2f
+
+bool g_DrawIndirectFirstInstance = false;
+bool g_PlaceObjects = false;
+uint32_t g_InstanceBufferCount = 0;
+
+//GPU frustum culling, --gpu-cull: a compute pass writes the visible draws of the frame
+//compacted with a count for vkCmdDrawIndexedIndirectCountKHR, or in place with 0 instances without it
+#define CULL_WORKGROUP_SIZE 64
 
-VkCommandPool g_CommandPool = 0;
-VkCommandBuffer *g_CommandBuffers = NULL;
+typedef struct{
+    float planes[6][4];
+    uint32_t objectCount;
+    uint32_t drawBase;
+    uint32_t countIndex;
+    uint32_t compact;
+}CullPushConstants;
+
+bool g_GpuCulling = false;
+bool g_DrawIndirectCountSupported = false;
+//compaction appends the visible draws in atomic order, off with --sort to keep the draw order
+bool g_CullCompact = false;
+
+VkBuffer g_CullBoundsBuffer = NULL;
+MemoryAllocation g_CullBoundsMemory = {0};
+VkBuffer g_CullOutputBuffer = NULL;
+MemoryAllocation g_CullOutputMemory = {0};
+VkBuffer g_CullCountBuffer = NULL;
+MemoryAllocation g_CullCountMemory = {0};
+
+VkDescriptorSetLayout g_CullDescriptorSetLayout = NULL;
+VkDescriptorPool g_CullDescriptorPool = NULL;
+VkDescriptorSet g_CullDescriptorSet = NULL;
+VkPipelineLayout g_CullPipelineLayout = NULL;
+VkPipeline g_CullPipeline = NULL;
+VkShaderModule g_CullShaderModule = NULL;
+
+bool g_CullCountPending[MAX_FRAMES_IN_FLIGHT] = {0};
+uint64_t g_CullVisibleSum = 0;
+uint32_t g_CullVisibleMin = 0;
+uint32_t g_CullVisibleMax = 0;
+uint32_t g_CullFrames = 0;
+
+//draws of the scene, recorded every frame
+VkDrawIndexedIndirectCommand *g_Draws = NULL;
+uint32_t g_DrawCount = 0;
+
+//object of each draw, --sort reorders the draws
+uint32_t *g_DrawObjects = NULL;
+
+//--sort, draws ordered front to back so the depth test rejects hidden fragments before shading
+bool g_SortDraws = false;
 
 char vertexShaderFileName[] = {"simple.vert.spv"};
 char fragmentShaderFileName[] = {"simple.frag.spv"};
+char cullShaderFileName[] = {"cull.comp.spv"};
 
 VkShaderModule g_vertShaderModule = 0;
 VkShaderModule g_fragShaderModule = 0;
@@ -296,8 +614,13 @@ mat4x4 projectionMatrix = {{1.0f, 0.0f, 0.0f, 0.0f},
                            {0.0f, 0.0f, 1.0f, 0.0f},
                            {0.0f, 0.0f, 0.0f, 1.0f}};
 
+//uniform ring, one slot per frame in flight, persistently mapped,
+//bound with the dynamic offset of the frame when its command buffer is recorded
 VkBuffer g_DescrBuffer = NULL;
-VkDeviceMemory g_DescriptorBufferDeviceMemory = VK_NULL_HANDLE;
+MemoryAllocation g_DescriptorBufferMemory = {0};
+char *g_UniformRingMapped = NULL;
+VkDeviceSize g_UniformRingStride = 0;
+uint32_t g_UniformRingSlotCount = 0;
 
 VkDescriptorSetLayout g_DescriptorSetLayout = NULL;
 VkDescriptorSet* g_DescriptorSets = NULL;
@@ -307,8 +630,188 @@ uint32_t descriptorSetsCount = 0;
 VkPipeline g_Pipeline = NULL;
 VkPipelineLayout g_PipelineLayout = NULL;
 
+//worker pool for startup work: SPIR-V loading, shader modules and pipelines, --threads N
+#define MAX_WORKER_THREADS 16
+#define MAX_JOBS 64
+
+//number of submitted jobs not finished yet, guarded by g_JobMutex
+typedef struct{
+    uint32_t remaining;
+}JobCounter;
+
+typedef struct{
+    void (*function)(void *data);
+    void *data;
+    JobCounter *counter;
+}Job;
+
+uint32_t g_WorkerThreadCount = 0;
+pthread_t g_Workers[MAX_WORKER_THREADS];
+uint32_t g_WorkerCount = 0;
+bool g_WorkersQuit = false;
+
+pthread_mutex_t g_JobMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_JobAvailable = PTHREAD_COND_INITIALIZER;
+pthread_cond_t g_JobDone = PTHREAD_COND_INITIALIZER;
+
+Job g_Jobs[MAX_JOBS];
+uint32_t g_JobHead = 0;
+uint32_t g_JobCount = 0;
+
+typedef struct{
+    const char *fileName;
+    VkShaderModule *module;
+    bool ok;
+}ShaderModuleJob;
+
+typedef struct{
+    //shader modules the pipeline is built from
+    JobCounter *shaders;
+    VkPipeline *pipeline;
+    bool ok;
+}PipelineJob;
+
+//shader modules by content hash, pipelines referencing the same SPIR-V share one module
+#define MAX_SHADER_MODULES 32
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_MAGIC_SWAPPED 0x03022307u
+
+typedef struct{
+    uint64_t hash;
+    size_t size;
+    //a copy of the SPIR-V, a matching hash alone doesn't prove the code is the same
+    uint32_t *code;
+    VkShaderModule module;
+    uint32_t refCount;
+}ShaderModuleEntry;
+
+ShaderModuleEntry g_ShaderModules[MAX_SHADER_MODULES];
+uint32_t g_ShaderModuleCount = 0;
+uint32_t g_ShaderModuleDedupCount = 0;
+pthread_mutex_t g_ShaderModuleMutex = PTHREAD_MUTEX_INITIALIZER;
+
+ShaderModuleJob g_ShaderModuleJobs[2];
+JobCounter g_ShaderJobCounter = {0};
+PipelineJob g_PipelineJob;
+JobCounter g_PipelineJobCounter = {0};
+
+//shader hot reload, --watch-shaders
+#define SHADER_RELOAD_SETTLE_TIME_NS 100000000ull
+#define MAX_RETIRED_PIPELINES 4
+
+typedef struct{
+    VkShaderModule vertShaderModule;
+    VkShaderModule fragShaderModule;
+    VkPipeline pipeline;
+    bool ok;
+}ShaderReloadJob;
+
+bool g_WatchShaders = false;
+int g_ShaderWatchFd = -1;
+bool g_ShaderChangePending = false;
+uint64_t g_ShaderChangeTime = 0;
+//the reload runs on its own thread, a pipeline build never queues ahead of the worker jobs
+bool g_ShaderReloadRunning = false;
+pthread_t g_ShaderReloadThread;
+ShaderReloadJob g_ShaderReloadJob;
+JobCounter g_ShaderReloadCounter = {0};
+
+//multithreaded recording, --record-threads N splits the draw list into N secondaries
+#define MAX_RECORD_SLICES MAX_WORKER_THREADS
+
+typedef struct{
+    uint32_t frame;
+    uint32_t imageIndex;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+    VkCommandBuffer commandBuffer;
+}RecordJob;
+
+uint32_t g_RecordThreadCount = 0;
+uint32_t g_RecordBenchIterations = 0;
+
+//pools are per frame and per slice, a pool is never used by two threads at once
+uint32_t g_RecordSliceCapacity = 0;
+VkCommandPool g_RecordCommandPools[MAX_FRAMES_IN_FLIGHT][MAX_RECORD_SLICES];
+VkCommandBuffer g_RecordCommandBuffers[MAX_FRAMES_IN_FLIGHT][MAX_RECORD_SLICES];
+RecordJob g_RecordJobs[MAX_RECORD_SLICES];
+JobCounter g_RecordJobCounter = {0};
+
+uint32_t g_ObjectCount = 1;
+
+//pipeline each frame in flight was recorded with, a retired pipeline lives until no frame uses it
+VkPipeline g_FramePipelines[MAX_FRAMES_IN_FLIGHT] = {NULL};
+VkPipeline g_RetiredPipelines[MAX_RETIRED_PIPELINES];
+uint32_t g_RetiredPipelineCount = 0;
+
+//pipeline cache, loaded from and saved to the working directory
+#define PIPELINE_CACHE_FILE_FORMAT "pipeline-cache-%04x-%04x.bin"
+
+VkPipelineCache g_PipelineCache = VK_NULL_HANDLE;
+bool g_PipelineCacheWarm = false;
+
 int32_t currentFrame = 0;
 
+//CPU wall time of the last renderVulkan() call, milliseconds
+typedef struct{
+    double acquire;
+    double record;
+    double submit;
+    double present;
+    double frame;
+}FrameTiming;
+
+FrameTiming g_FrameTiming = {0};
+
+typedef struct{
+    double min;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+}TimeStats;
+
+//benchmark, --bench N (frames) or --bench Ns (seconds)
+uint32_t g_BenchFrames = 0;
+uint32_t g_BenchSeconds = 0;
+char *g_BenchOutFileName = NULL;
+
+FrameTiming *g_BenchSamples = NULL;
+uint32_t g_BenchSampleCount = 0;
+uint32_t g_BenchSampleCapacity = 0;
+uint64_t g_BenchStartTime = 0;
+uint64_t g_BenchEndTime = 0;
+
+//startup profiler, phases from the program start to the first frame, --startup-profile=file
+#define MAX_STARTUP_PHASES 16
+
+typedef struct{
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+}StartupPhase;
+
+StartupPhase g_StartupPhases[MAX_STARTUP_PHASES];
+uint32_t g_StartupPhaseCount = 0;
+uint64_t g_StartupTime = 0;
+bool g_StartupReported = false;
+char *g_StartupProfileFileName = NULL;
+
+//GPU timestamps, --gpu-timing, begin and end of the render pass per frame in flight
+#define TIMESTAMP_QUERIES_PER_FRAME 2
+
+bool g_GpuTiming = false;
+VkQueryPool g_TimestampQueryPool = NULL;
+uint32_t g_TimestampValidBits = 0;
+
+//queries of the frame submitted with fenceArr[i], read once the fence is signaled
+bool g_FrameTimestampPending[MAX_FRAMES_IN_FLIGHT] = {0};
+
+double *g_GpuTimes = NULL;
+uint32_t g_GpuTimeCount = 0;
+uint32_t g_GpuTimeCapacity = 0;
+
 /*
 ==============================
  printInfoMsg();
@@ -354,6 +857,136 @@ void printWarningMsg(const char *format, ...)
     va_end(args);
 }
 
+/*
+==============================
+ getTimeNs();
+==============================
+*/
+
+uint64_t getTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+==============================
+ startupPhaseBegin();
+==============================
+*/
+
+//phases are sequential, beginning one ends the previous one
+void startupPhaseBegin(const char *name)
+{
+    uint64_t now = getTimeNs();
+
+    if (g_StartupPhaseCount && !g_StartupPhases[g_StartupPhaseCount - 1].end)
+        g_StartupPhases[g_StartupPhaseCount - 1].end = now;
+
+    if (g_StartupReported || g_StartupPhaseCount == MAX_STARTUP_PHASES) return;
+
+    g_StartupPhases[g_StartupPhaseCount].name = name;
+    g_StartupPhases[g_StartupPhaseCount].start = now;
+    g_StartupPhases[g_StartupPhaseCount].end = 0;
+    g_StartupPhaseCount++;
+}
+
+/*
+==============================
+ startupPhaseEnd();
+==============================
+*/
+
+void startupPhaseEnd()
+{
+    if (g_StartupPhaseCount && !g_StartupPhases[g_StartupPhaseCount - 1].end)
+        g_StartupPhases[g_StartupPhaseCount - 1].end = getTimeNs();
+}
+
+/*
+==============================
+ startupReport();
+==============================
+*/
+
+//printed once the first frame is presented, time not covered by a phase is shown as "other"
+void startupReport()
+{
+    if (g_StartupReported) return;
+
+    g_StartupReported = true;
+
+    startupPhaseEnd();
+
+    uint64_t total = getTimeNs() - g_StartupTime;
+    uint64_t covered = 0;
+
+    printInfoMsg("startup, %.3f ms to the first frame:\n", total * 1e-6);
+
+    printf("%-28s %10s %10s %7s\n", "phase", "start ms", "ms", "%");
+
+    for (uint32_t i = 0; i < g_StartupPhaseCount; ++i)
+    {
+        StartupPhase *phase = &g_StartupPhases[i];
+        uint64_t duration = phase->end - phase->start;
+
+        covered += duration;
+
+        printf("%-28s %10.3f %10.3f %7.1f\n", phase->name, (phase->start - g_StartupTime) * 1e-6,
+            duration * 1e-6, total ? 100.0 * duration / total : 0.0);
+    }
+
+    printf("%-28s %10s %10.3f %7.1f\n", "other", "", (total - covered) * 1e-6,
+        total ? 100.0 * (total - covered) / total : 0.0);
+
+    if (!g_StartupProfileFileName) return;
+
+    FILE *file = fopen(g_StartupProfileFileName, "w");
+
+    if (!file)
+    {
+        printErrorMsg("can't open startup profile file %s\n", g_StartupProfileFileName);
+        return;
+    }
+
+    const char *ext = strrchr(g_StartupProfileFileName, '.');
+
+    if (ext && !strcmp(ext, ".csv"))
+    {
+        fprintf(file, "phase,start_ms,duration_ms\n");
+
+        for (uint32_t i = 0; i < g_StartupPhaseCount; ++i)
+        {
+            StartupPhase *phase = &g_StartupPhases[i];
+
+            fprintf(file, "%s,%.6f,%.6f\n", phase->name, (phase->start - g_StartupTime) * 1e-6,
+                (phase->end - phase->start) * 1e-6);
+        }
+
+        fprintf(file, "other,,%.6f\ntotal,0,%.6f\n", (total - covered) * 1e-6, total * 1e-6);
+    }
+    else
+    {
+        fprintf(file, "{\n  \"total_ms\": %.6f,\n  \"other_ms\": %.6f,\n  \"phases\": [",
+            total * 1e-6, (total - covered) * 1e-6);
+
+        for (uint32_t i = 0; i < g_StartupPhaseCount; ++i)
+        {
+            StartupPhase *phase = &g_StartupPhases[i];
+
+            fprintf(file, "%s\n    {\"phase\": \"%s\", \"start_ms\": %.6f, \"duration_ms\": %.6f}", i ? "," : "",
+                phase->name, (phase->start - g_StartupTime) * 1e-6, (phase->end - phase->start) * 1e-6);
+        }
+
+        fprintf(file, "\n  ]\n}\n");
+    }
+
+    fclose(file);
+
+    printInfoMsg("startup profile written to %s\n", g_StartupProfileFileName);
+}
+
 /*
 ==============================
  printHelp();
@@ -369,6 +1002,27 @@ static void printHelp(void)
             LN("")
             LN("optional arguments:")
             LN("  -d, --devicenum=num   Vulkan device number `num`, first 1")
+            LN("  -H, --headless        render offscreen, no X server is needed")
+            LN("  -b, --bench=N[s]      render N frames (or N seconds) and print frame times")
+            LN("  -o, --bench-out=file  write benchmark results to file (.json or .csv)")
+            LN("  -t, --gpu-timing      measure GPU render pass time with timestamp queries")
+            LN("  -l, --fps-limit=N     render at most N frames per second")
+            LN("  -f, --frames-in-flight=N  frames recorded ahead of the GPU, 1-4, default 2")
+            LN("  -p, --present-mode=mode   fifo, mailbox, immediate or relaxed")
+            LN("  -s, --staging-size=MiB    size of the upload staging ring, default 64")
+            LN("  -S, --startup-profile=file  write the startup phase times to file (.json or .csv)")
+            LN("  -j, --threads=N       worker threads for shader and pipeline creation")
+            LN("  -w, --watch-shaders   rebuild the pipeline when a file in shaders/ changes")
+            LN("  -r, --record-threads=N  record the draw list into N secondary command buffers in parallel")
+            LN("  -R, --record-bench=N  time N recordings with 1 up to --record-threads (or --threads) threads")
+            LN("  -n, --objects=N       number of draws in the scene")
+            LN("  -i, --instances=N     instances of the mesh drawn by each draw")
+            LN("  -D, --direct          record a vkCmdDrawIndexed per draw instead of indirect draws")
+            LN("  -c, --gpu-cull        frustum cull the objects in a compute shader")
+            LN("  -z, --sort            draw the objects front to back")
+            LN("  -m, --msaa=N          multisample anti-aliasing, 1, 2, 4 or 8 samples")
+            LN("  -v, --vertex-format=F float, half or snorm16 vertex positions")
+            LN("  -M, --mesh=file       draw a mesh file written by meshconv instead of the built-in meshes")
             LN("  -h, --help            display help message and exit"));
 }
 
@@ -416,6 +1070,27 @@ bool parseOptions(int argc, char **argv)
         static const struct optparse_long longopts[] = {
             {"help",        'h',    OPTPARSE_NONE},
             {"devicenum",   'd',    OPTPARSE_REQUIRED},
+            {"headless",    'H',    OPTPARSE_NONE},
+            {"bench",       'b',    OPTPARSE_REQUIRED},
+            {"bench-out",   'o',    OPTPARSE_REQUIRED},
+            {"gpu-timing",  't',    OPTPARSE_NONE},
+            {"fps-limit",   'l',    OPTPARSE_REQUIRED},
+            {"frames-in-flight", 'f', OPTPARSE_REQUIRED},
+            {"present-mode", 'p',   OPTPARSE_REQUIRED},
+            {"staging-size", 's',   OPTPARSE_REQUIRED},
+            {"startup-profile", 'S', OPTPARSE_REQUIRED},
+            {"threads",     'j',    OPTPARSE_REQUIRED},
+            {"watch-shaders", 'w',  OPTPARSE_NONE},
+            {"record-threads", 'r', OPTPARSE_REQUIRED},
+            {"record-bench", 'R',   OPTPARSE_REQUIRED},
+            {"objects",     'n',    OPTPARSE_REQUIRED},
+            {"instances",   'i',    OPTPARSE_REQUIRED},
+            {"direct",      'D',    OPTPARSE_NONE},
+            {"gpu-cull",    'c',    OPTPARSE_NONE},
+            {"sort",        'z',    OPTPARSE_NONE},
+            {"msaa",        'm',    OPTPARSE_REQUIRED},
+            {"vertex-format", 'v',  OPTPARSE_REQUIRED},
+            {"mesh",        'M',    OPTPARSE_REQUIRED},
             { 0, 0, 0 },
         };
 
@@ -448,102 +1123,339 @@ bool parseOptions(int argc, char **argv)
                     }
                     break;
 
-                case 'h':
-                    printHelp();
-                    return false;
+                case 'H':
 
-                case '?':
+                    g_Headless = true;
+                    break;
 
-                    printInfoMsg("%s: %s\n", argv[0], options.errmsg);
-                    //printInfoMsg("Unknown option!\n\n");
-                    return false;
+                case 'w':
 
-            }
+                    g_WatchShaders = true;
+                    break;
 
-            printInfoMsg("%c (%d, %d) = '%s'\n", opt, options.optind, longindex, options.optarg);
+                case 'D':
 
-        }
-        printInfoMsg("optind = %d\n", options.optind);
+                    g_IndirectDraws = false;
+                    break;
 
-        while ((arg = optparse_arg(&options)))
-            printInfoMsg("argument: %s\n", arg);
-    }
+                case 'c':
 
-    return true;
-}
+                    g_GpuCulling = true;
+                    break;
 
-/*
-==============================
- openLibrary();
-==============================
-*/
+                case 'z':
 
-void *openLibrary(const char *libraryName)
-{
-    void *libraryHandle = dlopen(libraryName, RTLD_NOW);
+                    g_SortDraws = true;
+                    break;
 
-    if (!libraryHandle)
-    {
-        printErrorMsg("%s\n", dlerror());
-        return NULL;
-    }
+                case 'm':
+                {
+                    int samples = 0;
 
-    dlerror();
+                    if (!isNumberPositiveAndNotNull(options.optarg, &samples) ||
+                        samples > 8 || (samples & (samples - 1)))
+                    {
+                        printErrorMsg("msaa samples must be 1, 2, 4 or 8\n");
+                        return false;
+                    }
 
-    return libraryHandle;
-}
+                    g_MsaaSamples = (VkSampleCountFlagBits)samples;
+                    break;
+                }
 
-/*
-==============================
- closeLibrary();
-==============================
-*/
+                case 'r':
+                {
+                    int threads = 0;
 
-int closeLibrary(void *libraryHandle)
-{
-    if (dlclose(libraryHandle))
-    {
-        printErrorMsg("%s\n", dlerror());
-        return 1;
-    }
+                    if (!isNumberPositiveAndNotNull(options.optarg, &threads) || threads > MAX_RECORD_SLICES)
+                    {
+                        printErrorMsg("record threads must be within range 1-%d\n", MAX_RECORD_SLICES);
+                        return false;
+                    }
 
-    return 0;
-}
+                    g_RecordThreadCount = threads;
+                    break;
+                }
 
-/*
-==============================
- getPointerFromLib();
-==============================
-*/
+                case 'R':
+                {
+                    int iterations = 0;
 
-void *getPointerFromLib(void *libraryHandle, const char *fName)
-{
+                    if (!isNumberPositiveAndNotNull(options.optarg, &iterations))
+                    {
+                        printErrorMsg("record bench iterations must be a positive number\n");
+                        return false;
+                    }
 
-    void *p = dlsym(libraryHandle, fName);
+                    g_RecordBenchIterations = iterations;
+                    break;
+                }
 
-    char *error = dlerror();
+                case 'n':
+                {
+                    int objects = 0;
 
-    if (error != NULL)
-    {
-        printErrorMsg("%s\n", error);
-        return NULL;
-    }
+                    if (!isNumberPositiveAndNotNull(options.optarg, &objects))
+                    {
+                        printErrorMsg("objects must be a positive number\n");
+                        return false;
+                    }
 
-    return p;
-}
+                    g_ObjectCount = objects;
+                    break;
+                }
 
-/*
-==============================
- getFncAddress();
-==============================
-*/
+                case 'i':
+                {
+                    int instances = 0;
 
-int getFncAddress(void *libraryHandle)
-{
+                    if (!isNumberPositiveAndNotNull(options.optarg, &instances))
+                    {
+                        printErrorMsg("instances must be a positive number\n");
+                        return false;
+                    }
 
-    *(void **)(&pfn_vkGetInstanceProcAddr) = getPointerFromLib(libraryHandle, "vkGetInstanceProcAddr");
+                    g_InstanceCount = instances;
+                    break;
+                }
 
-    if (pfn_vkGetInstanceProcAddr == NULL)
+                case 'b':
+                {
+                    int benchNumber = 0;
+                    size_t len = strlen(options.optarg);
+                    bool inSeconds = len > 1 && options.optarg[len - 1] == 's';
+
+                    if (inSeconds) options.optarg[len - 1] = 0;
+
+                    if (!isNumberPositiveAndNotNull(options.optarg, &benchNumber))
+                    {
+                        printErrorMsg("benchmark length must be greater than 0\n");
+                        return false;
+                    }
+
+                    if (inSeconds)
+                    {
+                        g_BenchSeconds = benchNumber;
+                        g_BenchFrames = 0;
+                    }
+                    else
+                    {
+                        g_BenchFrames = benchNumber;
+                        g_BenchSeconds = 0;
+                    }
+
+                    break;
+                }
+
+                case 'o':
+
+                    g_BenchOutFileName = options.optarg;
+                    break;
+
+                case 't':
+
+                    g_GpuTiming = true;
+                    break;
+
+                case 'S':
+
+                    g_StartupProfileFileName = options.optarg;
+                    break;
+
+                case 'j':
+                {
+                    int threads = 0;
+
+                    if (!isNumberPositiveAndNotNull(options.optarg, &threads) || threads > MAX_WORKER_THREADS)
+                    {
+                        printErrorMsg("worker threads must be within range 1-%d\n", MAX_WORKER_THREADS);
+                        return false;
+                    }
+
+                    g_WorkerThreadCount = threads;
+                    break;
+                }
+
+                case 'f':
+                {
+                    int framesInFlight = 0;
+
+                    if (!isNumberPositiveAndNotNull(options.optarg, &framesInFlight) ||
+                        framesInFlight > MAX_FRAMES_IN_FLIGHT)
+                    {
+                        printErrorMsg("frames in flight must be within range 1-%d\n", MAX_FRAMES_IN_FLIGHT);
+                        return false;
+                    }
+
+                    g_FramesInFlight = framesInFlight;
+                    break;
+                }
+
+                case 'p':
+
+                    g_PresentModeRequested = true;
+
+                    if (!strcmp(options.optarg, "fifo"))
+                        g_RequestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+                    else if (!strcmp(options.optarg, "mailbox"))
+                        g_RequestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+                    else if (!strcmp(options.optarg, "immediate"))
+                        g_RequestedPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                    else if (!strcmp(options.optarg, "relaxed"))
+                        g_RequestedPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                    else
+                    {
+                        printErrorMsg("unknown present mode %s\n", options.optarg);
+                        return false;
+                    }
+
+                    break;
+
+                case 'v':
+
+                    if (!strcmp(options.optarg, "float"))
+                        g_VertexFormat = MESH_VERTEX_FORMAT_FLOAT;
+                    else if (!strcmp(options.optarg, "half"))
+                        g_VertexFormat = MESH_VERTEX_FORMAT_HALF;
+                    else if (!strcmp(options.optarg, "snorm16"))
+                        g_VertexFormat = MESH_VERTEX_FORMAT_SNORM16;
+                    else
+                    {
+                        printErrorMsg("unknown vertex format %s\n", options.optarg);
+                        return false;
+                    }
+
+                    break;
+
+                case 'M':
+
+                    g_MeshFileName = options.optarg;
+                    break;
+
+                case 's':
+                {
+                    int stagingSize = 0;
+
+                    if (!isNumberPositiveAndNotNull(options.optarg, &stagingSize))
+                    {
+                        printErrorMsg("staging ring size must be greater than 0\n");
+                        return false;
+                    }
+
+                    g_StagingRingSize = (VkDeviceSize)stagingSize * 1024 * 1024;
+                    break;
+                }
+
+                case 'l':
+                {
+                    int fpsLimit = 0;
+
+                    if (!isNumberPositiveAndNotNull(options.optarg, &fpsLimit))
+                    {
+                        printErrorMsg("frame limit must be greater than 0\n");
+                        return false;
+                    }
+
+                    g_FpsLimit = fpsLimit;
+                    break;
+                }
+
+                case 'h':
+                    printHelp();
+                    return false;
+
+                case '?':
+
+                    printInfoMsg("%s: %s\n", argv[0], options.errmsg);
+                    //printInfoMsg("Unknown option!\n\n");
+                    return false;
+
+            }
+
+            printInfoMsg("%c (%d, %d) = '%s'\n", opt, options.optind, longindex, options.optarg);
+
+        }
+        printInfoMsg("optind = %d\n", options.optind);
+
+        while ((arg = optparse_arg(&options)))
+            printInfoMsg("argument: %s\n", arg);
+    }
+
+    return true;
+}
+
+/*
+==============================
+ openLibrary();
+==============================
+*/
+
+void *openLibrary(const char *libraryName)
+{
+    void *libraryHandle = dlopen(libraryName, RTLD_NOW);
+
+    if (!libraryHandle)
+    {
+        printErrorMsg("%s\n", dlerror());
+        return NULL;
+    }
+
+    dlerror();
+
+    return libraryHandle;
+}
+
+/*
+==============================
+ closeLibrary();
+==============================
+*/
+
+int closeLibrary(void *libraryHandle)
+{
+    if (dlclose(libraryHandle))
+    {
+        printErrorMsg("%s\n", dlerror());
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+==============================
+ getPointerFromLib();
+==============================
+*/
+
+void *getPointerFromLib(void *libraryHandle, const char *fName)
+{
+
+    void *p = dlsym(libraryHandle, fName);
+
+    char *error = dlerror();
+
+    if (error != NULL)
+    {
+        printErrorMsg("%s\n", error);
+        return NULL;
+    }
+
+    return p;
+}
+
+/*
+==============================
+ getFncAddress();
+==============================
+*/
+
+int getFncAddress(void *libraryHandle)
+{
+
+    *(void **)(&pfn_vkGetInstanceProcAddr) = getPointerFromLib(libraryHandle, "vkGetInstanceProcAddr");
+
+    if (pfn_vkGetInstanceProcAddr == NULL)
     {
         printErrorMsg("cannot get vkGetInstanceProcAddr address\n");
         return false;
@@ -647,2593 +1559,6341 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallback(VkDebugUtilsMessage
 
 /*
 ==============================
- shutdownVulkan();
+ findMemoryType();
 ==============================
 */
 
-void shutdownVulkan()
+//first memory type allowed by typeBits that has all the required property flags, -1 if none
+int32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties)
 {
-    if (g_Pipeline && pfn_vkDestroyPipeline)
+    for (uint32_t i = 0; i < g_MemoryProperties.memoryTypeCount; ++i)
     {
-        pfn_vkDestroyPipeline(g_LogicalDevice, g_Pipeline, NULL);
-        printInfoMsg("vkDestroyPipeline()\n");
+        if ( (typeBits & (1u << i)) &&
+            (g_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties )
+        {
+            return (int32_t)i;
+        }
     }
 
-    if (g_PipelineLayout && pfn_vkDestroyPipelineLayout)
-    {
-        pfn_vkDestroyPipelineLayout(g_LogicalDevice, g_PipelineLayout, NULL);
-        printInfoMsg("vkDestroyPipelineLayout()\n");
-    }
+    return -1;
+}
 
-    if (g_DescriptorSets && pfn_vkFreeDescriptorSets)
-    {
-        pfn_vkFreeDescriptorSets(g_LogicalDevice,g_DescriptorPool,descriptorSetsCount,g_DescriptorSets);
-        free(g_DescriptorSets);
-        printInfoMsg("free descriptor sets\n");
-    }
+/*
+==============================
+ memoryBlockReserveRanges();
+==============================
+*/
 
-    if (g_DescriptorPool && pfn_vkDestroyDescriptorPool)
-    {
-        pfn_vkDestroyDescriptorPool(g_LogicalDevice,g_DescriptorPool,NULL);
-        printInfoMsg("vkDestroyDescriptorPool()\n");
-    }
+bool memoryBlockReserveRanges(MemoryBlock *block, uint32_t count)
+{
+    if (count <= block->freeRangeCapacity) return true;
 
-    if (g_DescriptorSetLayout && pfn_vkDestroyDescriptorSetLayout)
-    {
-        pfn_vkDestroyDescriptorSetLayout(g_LogicalDevice,g_DescriptorSetLayout,NULL);
-        printInfoMsg("vkDestroyDescriptorSetLayout()\n");
-    }
+    uint32_t capacity = block->freeRangeCapacity ? block->freeRangeCapacity * 2 : 16;
 
-    if (g_DescriptorBufferDeviceMemory && pfn_vkFreeMemory)
-    {
-        pfn_vkFreeMemory(g_LogicalDevice, g_DescriptorBufferDeviceMemory, NULL);
-        printInfoMsg("vkFreeMemory(), device descriptor buffer\n");
-    }
+    while (capacity < count) capacity *= 2;
 
-    if (g_DescrBuffer && pfn_vkDestroyBuffer)
-    {
-        pfn_vkDestroyBuffer(g_LogicalDevice,g_DescrBuffer,NULL);
-        printInfoMsg("vkDestroyBuffer(), descriptor buffer\n");
-    }
+    MemoryRange *ranges = (MemoryRange*) realloc(block->freeRanges, capacity * sizeof(MemoryRange));
 
-    if (g_fragShaderModule && pfn_vkDestroyShaderModule)
+    if (ranges == NULL)
     {
-        pfn_vkDestroyShaderModule(g_LogicalDevice, g_fragShaderModule, NULL);
-        printInfoMsg("vkDestroyShaderModule(), fragment shader buffer\n");
+        printErrorMsg("unable to allocate memory (28)\n");
+        return false;
     }
 
-    if (g_vertShaderModule && pfn_vkDestroyShaderModule)
-    {
-        pfn_vkDestroyShaderModule(g_LogicalDevice, g_vertShaderModule, NULL);
-        printInfoMsg("vkDestroyShaderModule(), vertex shader buffer\n");
-    }
+    block->freeRanges = ranges;
+    block->freeRangeCapacity = capacity;
 
-    if(g_CommandBuffers)
-    {
-        for ( uint32_t i = 0; i < g_SwapChainImageCount; ++i)
-        {
-            if (g_CommandBuffers[i]!=NULL && pfn_vkFreeCommandBuffers)
-            {
-                pfn_vkFreeCommandBuffers(g_LogicalDevice, g_CommandPool, 1, &g_CommandBuffers[i]);
-                printInfoMsg("free CommandBuffers [%d]\n", i);
-            }
-        }
+    return true;
+}
 
-        free(g_CommandBuffers);
-    }
+/*
+==============================
+ memoryBlockAlloc();
+==============================
+*/
 
-    if (g_CommandPool && pfn_vkDestroyCommandPool)
-    {
-        pfn_vkDestroyCommandPool( g_LogicalDevice, g_CommandPool, NULL );
-        printInfoMsg("destroy CommandPool()\n");
-    }
+//first fit, the alignment padding in front of the allocation stays in the free list
+bool memoryBlockAlloc(MemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    if (alignment < 1) alignment = 1;
 
-    if (g_VertexBufferDeviceMemory && pfn_vkFreeMemory)
+    for (uint32_t i = 0; i < block->freeRangeCount; ++i)
     {
-        pfn_vkFreeMemory(g_LogicalDevice, g_VertexBufferDeviceMemory, NULL);
-        printInfoMsg("free vertex buffer memory\n");
-    }
+        MemoryRange *range = &block->freeRanges[i];
 
-    if (g_VertexBuffer && pfn_vkDestroyBuffer)
-    {
-        pfn_vkDestroyBuffer(g_LogicalDevice,g_VertexBuffer,NULL);
-        printInfoMsg("destroy vertex buffer\n");
-    }
+        VkDeviceSize alignedOffset = (range->offset + alignment - 1) / alignment * alignment;
+        VkDeviceSize rangeEnd = range->offset + range->size;
 
-    if (g_IndexBufferDeviceMemory && pfn_vkFreeMemory)
-    {
-        pfn_vkFreeMemory(g_LogicalDevice, g_IndexBufferDeviceMemory, NULL);
-        printInfoMsg("free index buffer memory\n");
-    }
+        if (alignedOffset + size > rangeEnd) continue;
 
-    if (g_IndexBuffer && pfn_vkDestroyBuffer)
-    {
-        pfn_vkDestroyBuffer(g_LogicalDevice,g_IndexBuffer,NULL);
-        printInfoMsg("destroy index buffer\n");
-    }
+        VkDeviceSize frontSize = alignedOffset - range->offset;
+        VkDeviceSize tailOffset = alignedOffset + size;
+        VkDeviceSize tailSize = rangeEnd - tailOffset;
 
-    if (g_StagingBuffer && pfn_vkDestroyBuffer)
-    {
-        pfn_vkDestroyBuffer(g_LogicalDevice,g_StagingBuffer,NULL);
-        printInfoMsg("destroy staging buffer\n");
-    }
+        if (frontSize && tailSize)
+        {
+            if (!memoryBlockReserveRanges(block, block->freeRangeCount + 1)) return false;
 
-    if (g_StagingBufferDeviceMemory && pfn_vkFreeMemory)
-    {
-        pfn_vkFreeMemory(g_LogicalDevice, g_StagingBufferDeviceMemory, NULL);
-        printInfoMsg("free staging buffer memory\n");
-    }
+            range = &block->freeRanges[i];
 
-    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
-    {
-        if (g_FrameBuffers[i])
+            memmove(&block->freeRanges[i + 2], &block->freeRanges[i + 1],
+                (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+
+            range->size = frontSize;
+            block->freeRanges[i + 1].offset = tailOffset;
+            block->freeRanges[i + 1].size = tailSize;
+            block->freeRangeCount++;
+        }
+        else if (frontSize)
         {
-            pfn_vkDestroyFramebuffer(g_LogicalDevice, g_FrameBuffers[i], NULL);
-            printInfoMsg("free vkDestroyFramebuffer() (%d)\n",i);
+            range->size = frontSize;
+        }
+        else if (tailSize)
+        {
+            range->offset = tailOffset;
+            range->size = tailSize;
+        }
+        else
+        {
+            memmove(&block->freeRanges[i], &block->freeRanges[i + 1],
+                (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+            block->freeRangeCount--;
         }
-    }
 
-    if (g_FrameBuffers)
-    {
-        free(g_FrameBuffers);
-        printInfoMsg("free g_FrameBuffers\n");
+        *offset = alignedOffset;
+        block->used += size;
+        block->allocationCount++;
+
+        return true;
     }
 
-    if (g_RenderPass)
-    {
-        pfn_vkDestroyRenderPass( g_LogicalDevice, g_RenderPass, NULL);
-        printInfoMsg("vkDestroyRenderPass()\n");
+    return false;
+}
 
-    }
+/*
+==============================
+ memoryBlockFree();
+==============================
+*/
 
-    if (g_SwapChainImageViews && pfn_vkDestroyImageView)
-    {
-        for ( uint32_t i = 0; i < g_SwapChainImageCount; ++i )
-        {
-            pfn_vkDestroyImageView(g_LogicalDevice, g_SwapChainImageViews[i], NULL);
-            printInfoMsg("vkDestroyImageView() (%d)\n",i);
-        }
+bool memoryBlockFree(MemoryBlock *block, VkDeviceSize offset, VkDeviceSize size)
+{
+    uint32_t i = 0;
 
-        free(g_SwapChainImageViews);
-		printInfoMsg("free SwapChain Image Views.\n");
+    while (i < block->freeRangeCount && block->freeRanges[i].offset < offset) ++i;
 
-    }
+    bool mergePrev = i > 0 &&
+        block->freeRanges[i - 1].offset + block->freeRanges[i - 1].size == offset;
+    bool mergeNext = i < block->freeRangeCount &&
+        offset + size == block->freeRanges[i].offset;
 
-    if (g_SwapChainImages)
+    if (mergePrev && mergeNext)
     {
-        free(g_SwapChainImages);
-        printInfoMsg("free SwapChain images.\n");
-    }
+        block->freeRanges[i - 1].size += size + block->freeRanges[i].size;
 
-    if (g_SwapChain && pfn_vkDestroySwapchainKHR)
+        memmove(&block->freeRanges[i], &block->freeRanges[i + 1],
+            (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+        block->freeRangeCount--;
+    }
+    else if (mergePrev)
     {
-        pfn_vkDestroySwapchainKHR(g_LogicalDevice, g_SwapChain, NULL);
-        printInfoMsg("vkDestroySwapchainKHR().\n");
+        block->freeRanges[i - 1].size += size;
     }
-
-    if(pfn_vkDestroyFence)
+    else if (mergeNext)
     {
-        for ( int32_t i = 0; i < SWAP_CHAIN_IMAGE_COUNT; ++i )
-        {
-            if(fenceArr[i])
-            {
-                pfn_vkDestroyFence( g_LogicalDevice, fenceArr[i], NULL );
-                printInfoMsg("vkDestroyFence() [%d]\n", i);
-            }
-        }
+        block->freeRanges[i].offset = offset;
+        block->freeRanges[i].size += size;
     }
-
-    if(pfn_vkDestroySemaphore)
+    else
     {
-        for(uint32_t i = 0; i < SWAP_CHAIN_IMAGE_COUNT; ++i)
-        {
-            if (g_semaphoreImageAvailableArr[i])
-            {
-                pfn_vkDestroySemaphore(g_LogicalDevice, g_semaphoreImageAvailableArr[i], NULL);
-                printInfoMsg("vkDestroySemaphore() [%d] (image available)\n", i);
-            }
-        }
+        if (!memoryBlockReserveRanges(block, block->freeRangeCount + 1)) return false;
 
-        for(uint32_t i = 0; i < SWAP_CHAIN_IMAGE_COUNT; ++i)
-        {
-            if (g_semaphoreRenderFinishedArr[i])
-            {
-                pfn_vkDestroySemaphore(g_LogicalDevice, g_semaphoreRenderFinishedArr[i], NULL);
-                printInfoMsg("vkDestroySemaphore() [%d] (render finished)\n", i);
-            }
-        }
+        memmove(&block->freeRanges[i + 1], &block->freeRanges[i],
+            (block->freeRangeCount - i) * sizeof(MemoryRange));
+
+        block->freeRanges[i].offset = offset;
+        block->freeRanges[i].size = size;
+        block->freeRangeCount++;
     }
 
-    if (g_LogicalDevice && pfn_vkDestroyDevice)
+    block->used -= size;
+    block->allocationCount--;
+
+    return true;
+}
+
+/*
+==============================
+ createMemoryBlock();
+==============================
+*/
+
+int32_t createMemoryBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool optimalTiling, bool dedicated)
+{
+    if (g_MemoryStats.deviceAllocationCount >= g_PhysicalDeviceProperties.limits.maxMemoryAllocationCount)
     {
-        pfn_vkDestroyDevice(g_LogicalDevice, NULL);
-        printInfoMsg("destroy a logical device, vkDestroyDevice()\n");
+        printErrorMsg("maxMemoryAllocationCount (%u) reached.\n",
+            g_PhysicalDeviceProperties.limits.maxMemoryAllocationCount);
+        return -1;
     }
 
-    if (g_DeviceExtArrayCount)
+    int32_t blockIndex = -1;
+
+    for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; ++i)
     {
-        for (uint32_t i = 0; i < g_DeviceExtArrayCount; ++i)
+        if (g_MemoryBlocks[i].memory == VK_NULL_HANDLE)
         {
-            printInfoMsg("free device extensions array [%d]\n",i);
-            free(g_DeviceExtArray[i]);
+            blockIndex = (int32_t)i;
+            break;
         }
     }
 
-    g_DeviceExtArrayCount = 0;
-
-    if (g_DeviceExtArray)
+    if (blockIndex < 0)
     {
-        free(g_DeviceExtArray);
-        printInfoMsg("free g_DeviceExtArray\n");
+        printErrorMsg("all %d memory blocks are in use.\n", MEMORY_MAX_BLOCKS);
+        return -1;
     }
 
-    if (g_DeviceLayersArrayCount)
+    MemoryBlock *block = &g_MemoryBlocks[blockIndex];
+
+    VkMemoryAllocateInfo memoryAllocateInfo = {0};
+
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.pNext = NULL;
+    memoryAllocateInfo.allocationSize = size;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkResult result = pfn_vkAllocateMemory(g_LogicalDevice, &memoryAllocateInfo, NULL, &block->memory);
+
+    if (result != VK_SUCCESS)
     {
-        for ( uint32_t i = 0; i < g_DeviceLayersArrayCount; ++i)
-        {
-            printInfoMsg("free device layers array [%d]\n",i);
-            free(g_DeviceLayersArray[i]);
-        }
+        block->memory = VK_NULL_HANDLE;
+        printErrorMsg("unable to allocate device memory (1), %zu bytes, memory type %u (%d)\n",
+            (size_t)size, memoryTypeIndex, result);
+        return -1;
     }
 
-    g_DeviceLayersArrayCount = 0;
+    block->size = size;
+    block->used = 0;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->optimalTiling = optimalTiling;
+    block->dedicated = dedicated;
+    block->mapped = NULL;
+    block->freeRangeCount = 0;
+    block->allocationCount = 0;
 
-    if (g_DeviceLayersArray)
+    if (g_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
     {
-        free(g_DeviceLayersArray);
-        printInfoMsg("free g_DeviceLayersArray\n");
+        //host visible blocks stay mapped for their whole life time
+        void *data;
+
+        result = pfn_vkMapMemory(g_LogicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &data);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("memory block vkMapMemory (%d).\n", result);
+            pfn_vkFreeMemory(g_LogicalDevice, block->memory, NULL);
+            block->memory = VK_NULL_HANDLE;
+            return -1;
+        }
+
+        block->mapped = data;
     }
 
-    if (g_PhysicalDevices)
+    if (!memoryBlockReserveRanges(block, 1))
     {
-        free(g_PhysicalDevices);
-        printInfoMsg("free g_PhysicalDevices\n");
+        if (block->mapped) pfn_vkUnmapMemory(g_LogicalDevice, block->memory);
+        pfn_vkFreeMemory(g_LogicalDevice, block->memory, NULL);
+        block->memory = VK_NULL_HANDLE;
+        return -1;
     }
 
-    if (g_Surface && pfn_vkDestroySurfaceKHR)
+    block->freeRanges[0].offset = 0;
+    block->freeRanges[0].size = size;
+    block->freeRangeCount = 1;
+
+    g_MemoryStats.deviceAllocationCount++;
+    g_MemoryStats.bytesAllocated += size;
+
+    printInfoMsg("memory block [%d] created, %zu bytes, memory type %u%s%s\n", blockIndex,
+        (size_t)size, memoryTypeIndex, optimalTiling ? ", images" : "", dedicated ? ", dedicated" : "");
+
+    return blockIndex;
+}
+
+/*
+==============================
+ destroyMemoryBlock();
+==============================
+*/
+
+void destroyMemoryBlock(int32_t blockIndex)
+{
+    MemoryBlock *block = &g_MemoryBlocks[blockIndex];
+
+    if (block->mapped && pfn_vkUnmapMemory)
     {
-        pfn_vkDestroySurfaceKHR(g_Instance, g_Surface, NULL);
-        printInfoMsg("vkDestroySurfaceKHR()\n");
+        pfn_vkUnmapMemory(g_LogicalDevice, block->memory);
     }
 
-#ifdef DEBUG
-    if (g_DebugMessenger && pfn_vkDestroyDebugUtilsMessengerEXT)
+    if (block->memory && pfn_vkFreeMemory)
     {
-        pfn_vkDestroyDebugUtilsMessengerEXT(g_Instance, g_DebugMessenger,NULL);
-        printInfoMsg("DestroyDebugUtilsMessenger()\n");
+        pfn_vkFreeMemory(g_LogicalDevice, block->memory, NULL);
+
+        g_MemoryStats.deviceAllocationCount--;
+        g_MemoryStats.bytesAllocated -= block->size;
+
+        printInfoMsg("memory block [%d] freed, %zu bytes\n", blockIndex, (size_t)block->size);
     }
-#endif
 
-    if (g_Instance && pfn_vkDestroyInstance)
+    free(block->freeRanges);
+
+    memset(block, 0, sizeof(MemoryBlock));
+}
+
+/*
+==============================
+ allocateMemory();
+==============================
+*/
+
+bool allocateMemory(const VkMemoryRequirements *requirements, VkMemoryPropertyFlags properties,
+    bool optimalTiling, MemoryAllocation *allocation)
+{
+    int32_t memoryTypeIndex = findMemoryType(requirements->memoryTypeBits, properties);
+
+    if (memoryTypeIndex < 0)
     {
-        pfn_vkDestroyInstance(g_Instance, NULL);
-        printInfoMsg("vkDestroyInstance()\n");
+        printErrorMsg("failed to find suitable memory type (flags 0x%x)!\n", properties);
+        return false;
     }
 
-    if (g_InstanceExtensionArrayCount)
+    //with a granularity of 1 linear and optimal resources may share a block
+    if (g_PhysicalDeviceProperties.limits.bufferImageGranularity <= 1) optimalTiling = false;
+
+    bool dedicated = requirements->size > MEMORY_BLOCK_SIZE / 2;
+
+    int32_t blockIndex = -1;
+    VkDeviceSize offset = 0;
+
+    if (!dedicated)
     {
-        for ( uint32_t i = 0; i < g_InstanceExtensionArrayCount; ++i)
+        for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; ++i)
         {
-            free(g_InstanceExtensionArray[i]);
-            printInfoMsg("free instance extensions array [%d]\n",i);
+            MemoryBlock *block = &g_MemoryBlocks[i];
+
+            if (block->memory == VK_NULL_HANDLE || block->dedicated ||
+                block->memoryTypeIndex != (uint32_t)memoryTypeIndex ||
+                block->optimalTiling != optimalTiling ||
+                block->size - block->used < requirements->size) continue;
+
+            if (memoryBlockAlloc(block, requirements->size, requirements->alignment, &offset))
+            {
+                blockIndex = (int32_t)i;
+                break;
+            }
         }
     }
 
-    if (g_InstanceExtensionArray)
+    if (blockIndex < 0)
     {
-        free(g_InstanceExtensionArray);
-        printInfoMsg("free g_InstanceExtensionArray\n");
-    }
+        VkDeviceSize blockSize = dedicated ? requirements->size : MEMORY_BLOCK_SIZE;
 
-    if (g_InstanceLayersArrayCount)
-    {
-        for ( uint32_t i = 0; i < g_InstanceLayersArrayCount; ++i)
+        blockIndex = createMemoryBlock(memoryTypeIndex, blockSize, optimalTiling, dedicated);
+
+        //small heaps (e.g. device local host visible) may not fit a whole block
+        if (blockIndex < 0 && !dedicated)
         {
-            free(g_InstanceLayersArray[i]);
-            printInfoMsg("free instance layers array [%d]\n",i);
+            printWarningMsg("falling back to a dedicated block of %zu bytes.\n", (size_t)requirements->size);
+            dedicated = true;
+            blockIndex = createMemoryBlock(memoryTypeIndex, requirements->size, optimalTiling, dedicated);
         }
-    }
 
-    if (g_InstanceLayersArray)
-    {
-        free(g_InstanceLayersArray);
-        printInfoMsg("free g_InstanceLayersArray\n");
+        if (blockIndex < 0) return false;
+
+        if (!memoryBlockAlloc(&g_MemoryBlocks[blockIndex], requirements->size, requirements->alignment, &offset))
+        {
+            destroyMemoryBlock(blockIndex);
+            return false;
+        }
     }
+
+    MemoryBlock *block = &g_MemoryBlocks[blockIndex];
+
+    allocation->memory = block->memory;
+    allocation->offset = offset;
+    allocation->size = requirements->size;
+    allocation->mapped = block->mapped ? block->mapped + offset : NULL;
+    allocation->blockIndex = blockIndex;
+
+    g_MemoryStats.allocationCount++;
+    g_MemoryStats.totalAllocationCount++;
+    g_MemoryStats.bytesUsed += requirements->size;
+
+    if (g_MemoryStats.bytesUsed > g_MemoryStats.peakBytesUsed)
+        g_MemoryStats.peakBytesUsed = g_MemoryStats.bytesUsed;
+
+    return true;
 }
 
 /*
 ==============================
- maxValU();
+ freeMemory();
 ==============================
 */
 
-uint32_t maxValU(uint32_t a, uint32_t b)
+void freeMemory(MemoryAllocation *allocation)
 {
-    if (a > b) return a;
-    return b;
+    if (allocation->memory == VK_NULL_HANDLE) return;
+
+    MemoryBlock *block = &g_MemoryBlocks[allocation->blockIndex];
+
+    if (!memoryBlockFree(block, allocation->offset, allocation->size))
+    {
+        //range is lost until the block goes away, the allocation itself is still released
+        printWarningMsg("memory block [%d], free range not recorded.\n", allocation->blockIndex);
+        block->used -= allocation->size;
+        block->allocationCount--;
+    }
+
+    g_MemoryStats.allocationCount--;
+    g_MemoryStats.bytesUsed -= allocation->size;
+
+    //dedicated blocks are returned right away, shared ones are kept for reuse
+    if (block->dedicated && block->allocationCount == 0)
+    {
+        destroyMemoryBlock(allocation->blockIndex);
+    }
+
+    memset(allocation, 0, sizeof(MemoryAllocation));
 }
 
 /*
 ==============================
- isAvailable();
+ allocateBufferMemory();
 ==============================
 */
 
-bool isAvailable(char **array, uint32_t count, const char *name)
+bool allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryAllocation *allocation)
 {
+    VkMemoryRequirements memoryRequirements = {0};
 
-    if (count<1) return false;
+    pfn_vkGetBufferMemoryRequirements(g_LogicalDevice, buffer, &memoryRequirements);
 
-    for (uint32_t i = 0; i < count; ++i)
+    if (!allocateMemory(&memoryRequirements, properties, false, allocation)) return false;
+
+    VkResult result = pfn_vkBindBufferMemory(g_LogicalDevice, buffer, allocation->memory, allocation->offset);
+
+    if (result != VK_SUCCESS)
     {
-        if (strcmp(array[i],name)==0)
-        {
-            return true;
-        }
+        printErrorMsg("vkBindBufferMemory() (%d).\n", result);
+        freeMemory(allocation);
+        return false;
     }
 
-    return false;
+    return true;
 }
 
 /*
 ==============================
- initVulkan();
+ allocateImageMemory();
 ==============================
 */
 
-bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
+bool allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, MemoryAllocation *allocation)
 {
+    VkMemoryRequirements memoryRequirements = {0};
 
-    //get global level fnc address
+    pfn_vkGetImageMemoryRequirements(g_LogicalDevice, image, &memoryRequirements);
 
-    GET_GLOBAL_LEVEL_FUN_ADDR(vkEnumerateInstanceLayerProperties);
-    GET_GLOBAL_LEVEL_FUN_ADDR(vkEnumerateInstanceExtensionProperties);
-    GET_GLOBAL_LEVEL_FUN_ADDR(vkCreateInstance);
+    if (!allocateMemory(&memoryRequirements, properties, true, allocation)) return false;
 
-    //enumerate instance layers
+    VkResult result = pfn_vkBindImageMemory(g_LogicalDevice, image, allocation->memory, allocation->offset);
+
+    if (result != VK_SUCCESS)
     {
-        uint32_t layerCount = 0;
+        printErrorMsg("vkBindImageMemory() (%d).\n", result);
+        freeMemory(allocation);
+        return false;
+    }
 
-        pfn_vkEnumerateInstanceLayerProperties(&layerCount,NULL);
+    return true;
+}
 
-        printInfoMsg("number of instance layer properties available: %d\n",layerCount);
+/*
+==============================
+ printMemoryStats();
+==============================
+*/
 
-        printInfoMsg("available instance layers: ");
+void printMemoryStats()
+{
+    printInfoMsg("device memory: %u blocks (maxMemoryAllocationCount %u), %u allocations (%u total)\n",
+        g_MemoryStats.deviceAllocationCount, g_PhysicalDeviceProperties.limits.maxMemoryAllocationCount,
+        g_MemoryStats.allocationCount, g_MemoryStats.totalAllocationCount);
 
-        if (layerCount>0)
-        {
+    printInfoMsg("device memory: %zu bytes reserved, %zu used, %zu peak\n",
+        (size_t)g_MemoryStats.bytesAllocated, (size_t)g_MemoryStats.bytesUsed,
+        (size_t)g_MemoryStats.peakBytesUsed);
 
-            printf("\n");
+    for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; ++i)
+    {
+        MemoryBlock *block = &g_MemoryBlocks[i];
 
-            VkLayerProperties *layerProperties = NULL;
+        if (block->memory == VK_NULL_HANDLE) continue;
 
-            layerProperties = (VkLayerProperties*) malloc(layerCount * sizeof(VkLayerProperties));
+        printInfoMsg("  block [%u] type %u: %zu / %zu bytes, %u allocations, %u free ranges%s%s\n",
+            i, block->memoryTypeIndex, (size_t)block->used, (size_t)block->size,
+            block->allocationCount, block->freeRangeCount,
+            block->optimalTiling ? ", images" : "", block->mapped ? ", mapped" : "");
+    }
+}
 
-            if (layerProperties==NULL)
-            {
-                printErrorMsg("unable to allocate memory (1)\n");
-                return false;
-            }
-
-            pfn_vkEnumerateInstanceLayerProperties(&layerCount,layerProperties);
-
-            for ( uint32_t i = 0; i < layerCount; ++i)
-            {
-                printf("\t%s | %s\n", layerProperties[i].layerName, layerProperties[i].description);
-            }
+/*
+==============================
+ destroyMemoryAllocator();
+==============================
+*/
 
-            uint32_t numberOfEllementsInst = sizeof g_InstanceLayers / sizeof g_InstanceLayers[0];
+void destroyMemoryAllocator()
+{
+    if (g_MemoryStats.allocationCount)
+    {
+        printWarningMsg("%u device memory allocations still alive.\n", g_MemoryStats.allocationCount);
+    }
 
-            if(numberOfEllementsInst == 1 && g_InstanceLayers[0] == NULL) numberOfEllementsInst = 0;
+    for (uint32_t i = 0; i < MEMORY_MAX_BLOCKS; ++i)
+    {
+        if (g_MemoryBlocks[i].memory) destroyMemoryBlock((int32_t)i);
+    }
+}
 
-            if (numberOfEllementsInst)
-            {
-                for (uint32_t i = 0 ; i < layerCount; ++i)
-                {
-                    for (uint32_t a = 0; a < numberOfEllementsInst; ++a)
-                    {
-                        if (!strcmp(g_InstanceLayers[a], layerProperties[i].layerName))
-                        {
-                            char **pInstanceLayersArrayTmp =
-                                (char**) realloc(g_InstanceLayersArray,
-                                sizeof g_InstanceLayers[0] * (g_InstanceLayersArrayCount+1));
+/*
+==============================
+ createUploadEngine();
+==============================
+*/
 
-                            if (!pInstanceLayersArrayTmp)
-                            {
-                                printErrorMsg("unable to reallocate memory (1)\n");
-                                free(layerProperties);
-                                return false;
-                            }
+bool createUploadEngine()
+{
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
 
-                            g_InstanceLayersArray = pInstanceLayersArrayTmp;
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = g_TransferQueueFamilyIndex;
 
-                            g_InstanceLayersArray[g_InstanceLayersArrayCount] =
-                                (char*) malloc(strlen(layerProperties[i].layerName) + 1);
+    VkResult result = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &g_UploadCommandPool);
 
-                            if (g_InstanceLayersArray[g_InstanceLayersArrayCount] == NULL)
-                            {
-                                printErrorMsg("unable to allocate memory (2)[%d]\n",g_InstanceLayersArrayCount);
-                                free(layerProperties);
-                                return false;
-                            }
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("cannot create CommandPool (upload).\n");
+        return false;
+    }
 
-                            strcpy(g_InstanceLayersArray[g_InstanceLayersArrayCount], layerProperties[i].layerName);
+    bool ownershipTransfer = g_TransferQueueFamilyIndex != g_GraphicsQueueFamilyIndex;
 
-                            g_InstanceLayersArrayCount++;
-                        }
+    if (ownershipTransfer)
+    {
+        commandPoolCreateInfo.queueFamilyIndex = g_GraphicsQueueFamilyIndex;
 
-                    }
-                }
-            }
+        result = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &g_UploadAcquireCommandPool);
 
-            free(layerProperties);
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("cannot create CommandPool (upload acquire).\n");
+            return false;
         }
-        else printf("none.\n");
     }
 
-#ifdef DEBUG
-    if (!isAvailable(g_InstanceLayersArray, g_InstanceLayersArrayCount, "VK_LAYER_KHRONOS_validation"))
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i)
     {
-        printErrorMsg("requested layer not available: VK_LAYER_KHRONOS_validation\n");
-		return false;
-    }
-    else printInfoMsg("VK_LAYER_KHRONOS_validation available OK.\n");
-#endif
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
 
-    printInfoMsg("count of instance layers to be used: %d\n",g_InstanceLayersArrayCount);
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandPool = g_UploadCommandPool;
+        commandBufferAllocateInfo.commandBufferCount = 1;
 
-    if (g_InstanceLayersArrayCount>0)
-    {
-        printInfoMsg("list of instance layers to be used:\n");
-        for (uint32_t i = 0; i < g_InstanceLayersArrayCount; ++i)
+        result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo,
+            &g_UploadBatches[i].transferCommandBuffer);
+
+        if (result != VK_SUCCESS)
         {
-            printf("\t%s\n",g_InstanceLayersArray[i]);
+            printErrorMsg("cannot allocate Command Buffers (upload).\n");
+            return false;
+        }
+
+        if (!ownershipTransfer) continue;
+
+        commandBufferAllocateInfo.commandPool = g_UploadAcquireCommandPool;
+
+        result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo,
+            &g_UploadBatches[i].acquireCommandBuffer);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("cannot allocate Command Buffers (upload acquire).\n");
+            return false;
         }
     }
 
-    //enumerate instance extensions
+    if (g_TimelineSemaphoreSupported)
     {
+        VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {0};
 
-        uint32_t extensionCount = 0;
+        semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        semaphoreTypeCreateInfo.initialValue = 0;
 
-        pfn_vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL);
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {0};
 
-        printInfoMsg("instance extension count: %d\n", extensionCount);
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
 
-        printInfoMsg("available instance extensions: ");
+        result = pfn_vkCreateSemaphore(g_LogicalDevice, &semaphoreCreateInfo, NULL, &g_UploadTimeline);
 
-        if (extensionCount>0)
+        if (result != VK_SUCCESS)
         {
+            printErrorMsg("vkCreateSemaphore() (upload timeline).\n");
+            return false;
+        }
+    }
 
-            printf("\n");
-
-            VkExtensionProperties *extensionProperties =
-                (VkExtensionProperties*) malloc(extensionCount * sizeof(VkExtensionProperties));
+    VkBufferCreateInfo stagingRingCreateInfo = {0};
 
-            if (extensionProperties==NULL)
-            {
-                printErrorMsg("unable to allocate memory (3)\n");
-                return false;
-            }
+    stagingRingCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    stagingRingCreateInfo.size = g_StagingRingSize;
+    stagingRingCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    stagingRingCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-            pfn_vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, extensionProperties);
+    result = pfn_vkCreateBuffer(g_LogicalDevice, &stagingRingCreateInfo, NULL, &g_StagingRingBuffer);
 
-            for (uint32_t i = 0 ; i < extensionCount; ++i)
-            {
-                printf("\t%s\n",extensionProperties[i].extensionName);
-            }
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("staging ring, vkCreateBuffer().\n");
+        return false;
+    }
 
-            uint32_t numberOfEllementsExt = sizeof g_InstanceExtensions / sizeof g_InstanceExtensions[0];
+    if (!allocateBufferMemory(g_StagingRingBuffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &g_StagingRingMemory))
+    {
+        printErrorMsg("staging ring, unable to allocate memory.\n");
+        return false;
+    }
 
-            if(numberOfEllementsExt == 1 && g_InstanceExtensions[0] == NULL) numberOfEllementsExt = 0;
+    printInfoMsg("upload engine OK, queue family [%d]%s%s\n", g_TransferQueueFamilyIndex,
+        ownershipTransfer ? ", ownership transfer to the graphics queue" : "",
+        g_TimelineSemaphoreSupported ? ", timeline semaphore" : ", synchronous");
 
-            if (numberOfEllementsExt)
-            {
-                for (uint32_t i = 0 ; i < extensionCount; ++i)
-                {
-                    for (uint32_t a = 0; a < numberOfEllementsExt; ++a)
-                    {
-                        if (!strcmp(g_InstanceExtensions[a], extensionProperties[i].extensionName))
-                        {
-                            char **pInstanceExtensionArrayTmp = (char**) realloc(g_InstanceExtensionArray,
-                                    sizeof g_InstanceExtensionArray[0] * (g_InstanceExtensionArrayCount+1));
+    return true;
+}
 
-                            if (!pInstanceExtensionArrayTmp)
-                            {
-                                printErrorMsg("unable to reallocate memory (2)\n");
-                                free(extensionProperties);
-                                return false;
-                            }
+/*
+==============================
+ releaseUploadBatch();
+==============================
+*/
 
-                            g_InstanceExtensionArray = pInstanceExtensionArrayTmp;
+void releaseUploadBatch(UploadBatch *batch)
+{
+    //batches may be collected out of order, the ones before are done as well
+    if (batch->stagingRingEnd > g_StagingRingTail) g_StagingRingTail = batch->stagingRingEnd;
 
-                            g_InstanceExtensionArray[g_InstanceExtensionArrayCount] =
-                                (char*) malloc(strlen(extensionProperties[i].extensionName) + 1);
+    if (batch->timelineValue)
+    {
+        batch->timelineValue = 0;
+        g_UploadPendingBatchCount--;
+    }
+}
 
-                            if (g_InstanceExtensionArray[g_InstanceExtensionArrayCount] == NULL)
-                            {
-                                printErrorMsg("unable to allocate memory (4)[%d]\n",g_InstanceExtensionArrayCount);
-                                free(extensionProperties);
-                                return false;
-                            }
+/*
+==============================
+ collectUploads();
+==============================
+*/
 
-                            strcpy(g_InstanceExtensionArray[g_InstanceExtensionArrayCount],
-                                extensionProperties[i].extensionName);
+//releases the batches the GPU is done with, doesn't block
+void collectUploads()
+{
+    if (g_UploadPendingBatchCount == 0) return;
 
-                            g_InstanceExtensionArrayCount++;
-                        }
-                    }
-                }
-            }
+    uint64_t value = 0;
 
-            free(extensionProperties);
+    VkResult result = pfn_vkGetSemaphoreCounterValue(g_LogicalDevice, g_UploadTimeline, &value);
 
-        }
-        else printf("none.\n");
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("vkGetSemaphoreCounterValue() (%d).\n", result);
+        return;
+    }
 
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i)
+    {
+        if (g_UploadBatches[i].timelineValue && g_UploadBatches[i].timelineValue <= value)
+            releaseUploadBatch(&g_UploadBatches[i]);
     }
+}
 
-    printInfoMsg("count of instance extensions to be used: %d\n",g_InstanceExtensionArrayCount);
+/*
+==============================
+ waitUploadValue();
+==============================
+*/
 
-    if (g_InstanceExtensionArrayCount>0)
+bool waitUploadValue(uint64_t value)
+{
+    VkSemaphoreWaitInfo semaphoreWaitInfo = {0};
+
+    semaphoreWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    semaphoreWaitInfo.semaphoreCount = 1;
+    semaphoreWaitInfo.pSemaphores = &g_UploadTimeline;
+    semaphoreWaitInfo.pValues = &value;
+
+    VkResult result = pfn_vkWaitSemaphores(g_LogicalDevice, &semaphoreWaitInfo, UINT64_MAX);
+
+    if (result != VK_SUCCESS)
     {
-        printInfoMsg("list of instance extensions to be used:\n");
-        for (uint32_t i = 0; i < g_InstanceExtensionArrayCount; ++i)
-        {
-            printf("\t%s\n",g_InstanceExtensionArray[i]);
-        }
+        printErrorMsg("vkWaitSemaphores() (upload) (%d).\n", result);
+        return false;
     }
 
-#ifdef DEBUG
-    VkDebugUtilsMessengerCreateInfoEXT debugMsgrCreateInfo = {0};
+    return true;
+}
 
-    debugMsgrCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    debugMsgrCreateInfo.flags = 0;
-    //| VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
-    debugMsgrCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
-                                            | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-    debugMsgrCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
-                                            | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
-                                            | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    debugMsgrCreateInfo.pfnUserCallback = debugMessengerCallback;
-    debugMsgrCreateInfo.pUserData = &sUsrDt;
-#endif
+/*
+==============================
+ flushUploads();
+==============================
+*/
 
-    //create instance
-    {
-        VkApplicationInfo applicationInfo = {0};
+//submits the queued copies, the graphics queue is made to wait for them, the CPU isn't
+bool flushUploads()
+{
+    if (g_UploadCopyCount == 0) return true;
 
-        applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        applicationInfo.pNext = NULL;
-        applicationInfo.pApplicationName = "Triangle";
-        applicationInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);
-        applicationInfo.pEngineName = "Triangle";
-        applicationInfo.engineVersion = VK_MAKE_VERSION(1,0,0);
-        applicationInfo.apiVersion = VK_API_VERSION_1_0;
+    UploadBatch *batch = &g_UploadBatches[g_UploadBatchIndex];
 
-        VkInstanceCreateInfo instanceCreateInfo = {0};
+    g_UploadBatchIndex = (g_UploadBatchIndex + 1) % UPLOAD_BATCH_COUNT;
 
-        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-#ifdef DEBUG
-        instanceCreateInfo.pNext = &debugMsgrCreateInfo;
-#else
-        instanceCreateInfo.pNext = NULL;
-#endif
-        instanceCreateInfo.flags = 0;
-        instanceCreateInfo.pApplicationInfo = &applicationInfo;
-        instanceCreateInfo.enabledLayerCount = g_InstanceLayersArrayCount;
-        if (g_InstanceLayersArrayCount)
-            instanceCreateInfo.ppEnabledLayerNames = (const char* const*) g_InstanceLayersArray;
-        else instanceCreateInfo.ppEnabledLayerNames = NULL;
-        instanceCreateInfo.enabledExtensionCount = g_InstanceExtensionArrayCount;
-        if (g_InstanceExtensionArrayCount)
-            instanceCreateInfo.ppEnabledExtensionNames = (const char* const*) g_InstanceExtensionArray;
-        else instanceCreateInfo.ppEnabledExtensionNames = NULL;
+    //the oldest batch is reused, the GPU has to be done with it
+    if (batch->timelineValue)
+    {
+        if (!waitUploadValue(batch->timelineValue)) return false;
 
-       	VkResult result = pfn_vkCreateInstance(&instanceCreateInfo, NULL, &g_Instance);
+        releaseUploadBatch(batch);
+    }
 
-        //TODO: free g_InstanceExtensionArray here
+    bool ownershipTransfer = g_TransferQueueFamilyIndex != g_GraphicsQueueFamilyIndex;
 
-        if (result != VK_SUCCESS)
-        {
-            if (result == VK_ERROR_INCOMPATIBLE_DRIVER)
-                printErrorMsg("failed to create Vulkan instance, can't find a compatible Vulkan driver.\n");
-            else printErrorMsg("failed to create Vulkan instance\n");
-
-            return false;
-        }
-
-        printInfoMsg("create vulkan instance OK.\n");
+    VkBufferMemoryBarrier bufferMemoryBarriers[UPLOAD_MAX_COPIES];
+    VkPipelineStageFlags dstStageMask = 0;
+    VkDeviceSize bytes = 0;
 
+    for (uint32_t i = 0; i < g_UploadCopyCount; ++i)
+    {
+        UploadCopy *copy = &g_UploadCopies[i];
+        VkBufferMemoryBarrier *barrier = &bufferMemoryBarriers[i];
+
+        memset(barrier, 0, sizeof(VkBufferMemoryBarrier));
+
+        barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        //release half: destination access is ignored, it's done by the acquire on the graphics queue
+        barrier->dstAccessMask = ownershipTransfer ? 0 : copy->dstAccessMask;
+        barrier->srcQueueFamilyIndex = ownershipTransfer ? (uint32_t)g_TransferQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+        barrier->dstQueueFamilyIndex = ownershipTransfer ? (uint32_t)g_GraphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+        barrier->buffer = copy->dstBuffer;
+        barrier->offset = copy->region.dstOffset;
+        barrier->size = copy->region.size;
+
+        dstStageMask |= copy->dstStageMask;
+        bytes += copy->region.size;
     }
 
-    //get inst level fnc address
+    if (dstStageMask == 0) dstStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroyInstance);
-#ifdef DEBUG
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateDebugUtilsMessengerEXT);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroyDebugUtilsMessengerEXT);
-#endif
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateXcbSurfaceKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroySurfaceKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumeratePhysicalDevices);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceProperties);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumerateDeviceLayerProperties);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumerateDeviceExtensionProperties);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceQueueFamilyProperties);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceSupportKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateDevice);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetDeviceProcAddr);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceCapabilitiesKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceFormatsKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfacePresentModesKHR);
-    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceMemoryProperties);
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
 
-#ifdef DEBUG
-    {
-        VkResult result = pfn_vkCreateDebugUtilsMessengerEXT(g_Instance, &debugMsgrCreateInfo, NULL, &g_DebugMessenger);
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("CreateDebugUtilsMessengerEXT()\n");
-            return false;
-        }
+    pfn_vkBeginCommandBuffer(batch->transferCommandBuffer, &commandBufferBeginInfo);
 
-        printInfoMsg("CreateDebugUtilsMessengerEXT() OK.\n");
+    for (uint32_t i = 0; i < g_UploadCopyCount; ++i)
+    {
+        UploadCopy *copy = &g_UploadCopies[i];
 
+        pfn_vkCmdCopyBuffer(batch->transferCommandBuffer, copy->srcBuffer, copy->dstBuffer, 1, &copy->region);
     }
-#endif
 
-    //create surface
+    if (g_UploadCopyCount)
     {
-        VkXcbSurfaceCreateInfoKHR surfaceCreateInfo = {0};
+        pfn_vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dstStageMask, 0,
+            0, NULL, g_UploadCopyCount, bufferMemoryBarriers, 0, NULL);
+    }
 
-        surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
-        surfaceCreateInfo.connection = conn;
-        surfaceCreateInfo.window = wnd;
+    pfn_vkEndCommandBuffer(batch->transferCommandBuffer);
 
-        VkResult result = pfn_vkCreateXcbSurfaceKHR(g_Instance, &surfaceCreateInfo, NULL, &g_Surface);
+    uint64_t transferValue = ++g_UploadTimelineValue;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("vkCreateXcbSurfaceKHR().");
-            return false;
-        }
-    }
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {0};
 
-    printInfoMsg("create surface OK.\n");
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.signalSemaphoreValueCount = 1;
+    timelineSubmitInfo.pSignalSemaphoreValues = &transferValue;
 
-    //enumerate physical devices (1)
+    VkSubmitInfo submitInfo = {0};
+
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = g_TimelineSemaphoreSupported ? &timelineSubmitInfo : NULL;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch->transferCommandBuffer;
+    submitInfo.signalSemaphoreCount = g_TimelineSemaphoreSupported ? 1 : 0;
+    submitInfo.pSignalSemaphores = &g_UploadTimeline;
+
+    VkResult result = pfn_vkQueueSubmit(g_TransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+
+    if (result != VK_SUCCESS)
     {
-        VkResult result = pfn_vkEnumeratePhysicalDevices(g_Instance, &g_PhysicalDeviceCount, NULL);
+        printErrorMsg("upload, vkQueueSubmit() (%d).\n", result);
+        return false;
+    }
 
-        if (result != VK_SUCCESS)
+    batch->timelineValue = transferValue;
+
+    if (ownershipTransfer)
+    {
+        //acquire half, same ranges, now with the access of the first use
+        for (uint32_t i = 0; i < g_UploadCopyCount; ++i)
         {
-            printErrorMsg("failed to query the number of physical devices present.\n");
-            return false;
+            bufferMemoryBarriers[i].srcAccessMask = 0;
+            bufferMemoryBarriers[i].dstAccessMask = g_UploadCopies[i].dstAccessMask;
         }
 
-        // there has to be at least one device present
-        if (g_PhysicalDeviceCount == 0)
+        pfn_vkBeginCommandBuffer(batch->acquireCommandBuffer, &commandBufferBeginInfo);
+
+        if (g_UploadCopyCount)
         {
-            printErrorMsg("couldn't detect any device present with Vulkan support.\n");
-            return false;
+            pfn_vkCmdPipelineBarrier(batch->acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                dstStageMask, 0, 0, NULL, g_UploadCopyCount, bufferMemoryBarriers, 0, NULL);
         }
 
-        printInfoMsg("number of Vulkan physical devices found: %d\n", g_PhysicalDeviceCount);
+        pfn_vkEndCommandBuffer(batch->acquireCommandBuffer);
 
-    }
+        uint64_t acquireValue = ++g_UploadTimelineValue;
 
-    g_PhysicalDevices = (VkPhysicalDevice*) malloc(g_PhysicalDeviceCount * sizeof(VkPhysicalDevice));
+        timelineSubmitInfo.waitSemaphoreValueCount = 1;
+        timelineSubmitInfo.pWaitSemaphoreValues = &transferValue;
+        timelineSubmitInfo.pSignalSemaphoreValues = &acquireValue;
 
-    if (g_PhysicalDevices == NULL) {
-        printErrorMsg("unable to allocate memory (5)\n");
-        return false;
-    }
+        //later graphics submissions come after this one, the wait covers them as well
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &g_UploadTimeline;
+        submitInfo.pWaitDstStageMask = &dstStageMask;
+        submitInfo.pCommandBuffers = &batch->acquireCommandBuffer;
 
-    //enumerate physical devices (2)
-    {
-        VkResult result = pfn_vkEnumeratePhysicalDevices(g_Instance, &g_PhysicalDeviceCount, g_PhysicalDevices);
+        result = pfn_vkQueueSubmit(g_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg("faied to enumerate physical devices present.\n");
+            printErrorMsg("upload acquire, vkQueueSubmit() (%d).\n", result);
             return false;
         }
+
+        batch->timelineValue = acquireValue;
     }
 
-    for (uint32_t i = 0; i < g_PhysicalDeviceCount; ++i)
+    batch->stagingRingEnd = g_StagingRingHead;
+
+    printInfoMsg("upload batch submitted, %u copies, %zu bytes, timeline value %llu\n",
+        g_UploadCopyCount, (size_t)bytes, (unsigned long long)batch->timelineValue);
+
+    g_UploadCopyCount = 0;
+    g_UploadPendingBatchCount++;
+
+    //transfer and graphics queue are the same one here, only the staging memory is waited for
+    if (!g_TimelineSemaphoreSupported)
     {
+        pfn_vkQueueWaitIdle(g_TransferQueue);
+        releaseUploadBatch(batch);
+    }
 
-        VkPhysicalDeviceProperties deviceProperties ={0};
-        pfn_vkGetPhysicalDeviceProperties(g_PhysicalDevices[i], &deviceProperties);
-        printInfoMsg("device number (%d):\n", i+1);
+    return true;
+}
 
-        printf("\tdevice name: %s\n", deviceProperties.deviceName);
+/*
+==============================
+ uploadBuffer();
+==============================
+*/
 
-        printf("\t%s\n", str_VkPhysicalDeviceType(deviceProperties.deviceType));
+//queues a copy, dstStageMask/dstAccessMask describe the first use of the data on the graphics queue
+bool uploadBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+    VkDeviceSize size, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    if (g_UploadCopyCount == UPLOAD_MAX_COPIES && !flushUploads()) return false;
 
-        printf("\tAPI version: %d.%d.%d\n", (deviceProperties.apiVersion >> 22),
-                                            (deviceProperties.apiVersion >> 12) & 0x3FF,
-                                            (deviceProperties.apiVersion & 0xFFF));
-    }
+    UploadCopy *copy = &g_UploadCopies[g_UploadCopyCount++];
 
+    copy->srcBuffer = srcBuffer;
+    copy->dstBuffer = dstBuffer;
+    copy->region.srcOffset = srcOffset;
+    copy->region.dstOffset = dstOffset;
+    copy->region.size = size;
+    copy->dstStageMask = dstStageMask;
+    copy->dstAccessMask = dstAccessMask;
 
-    if(g_RequestedDeviceNum > g_PhysicalDeviceCount)
-    {
-        printErrorMsg("there is no physical device with such number.\n");
-        printf("\tyou have requested physical device number: %d\n", g_RequestedDeviceNum);
-        if(g_PhysicalDeviceCount == 1)
-        {
-            printf("\tbut there is only %d physical device found\n", g_PhysicalDeviceCount);
-            printf("\trequested physical device number on this mashine can be only 1\n");
-        }
-        else
-        {
-            printf("\trequested physical device number on this mashine should be within range 1-%d\n",
-                g_PhysicalDeviceCount);
-            printf("\tbut there is only %d physical devices found\n", g_PhysicalDeviceCount);
-        }
+    return true;
+}
 
+/*
+==============================
+ waitOldestUploadBatch();
+==============================
+*/
 
-        return false;
-    }
+//false if no batch is in flight
+bool waitOldestUploadBatch()
+{
+    UploadBatch *oldest = NULL;
 
-    if (g_RequestedDeviceNum > 0)
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i)
     {
-        printInfoMsg("requested physical device number: %d\n", g_RequestedDeviceNum);
-    }
-    else
-        printInfoMsg("by default using first available physical device.\n");
+        UploadBatch *batch = &g_UploadBatches[i];
 
-    if (g_RequestedDeviceNum > 0)
-        g_SelectedPhysicalDevice = g_PhysicalDevices[g_RequestedDeviceNum-1];
-    else
-        g_SelectedPhysicalDevice = g_PhysicalDevices[0];
+        if (batch->timelineValue && (oldest == NULL || batch->timelineValue < oldest->timelineValue))
+            oldest = batch;
+    }
 
-    //enumerate device layers
-    {
+    if (oldest == NULL) return false;
 
-        uint32_t layerCount = 0;
+    if (!waitUploadValue(oldest->timelineValue)) return false;
 
-        pfn_vkEnumerateDeviceLayerProperties(g_SelectedPhysicalDevice, &layerCount, NULL);
+    releaseUploadBatch(oldest);
 
-        printInfoMsg("available device layers count %d\n",layerCount);
+    return true;
+}
 
-        printInfoMsg("available device layers: ");
+/*
+==============================
+ stagingRingAlloc();
+==============================
+*/
 
-        if (layerCount>0)
-        {
-            printf("\n");
+//returns where to write size bytes, *offset is the source offset for uploadBuffer(),
+//blocks only when the ring is full of data the GPU hasn't copied yet
+char *stagingRingAlloc(VkDeviceSize size, VkDeviceSize *offset)
+{
+    size = (size + STAGING_RING_ALIGNMENT - 1) / STAGING_RING_ALIGNMENT * STAGING_RING_ALIGNMENT;
 
-            VkLayerProperties* layerProperties = NULL;
+    if (size > g_StagingRingSize)
+    {
+        printErrorMsg("staging ring, %zu bytes don't fit into %zu.\n", (size_t)size, (size_t)g_StagingRingSize);
+        return NULL;
+    }
 
-            layerProperties = (VkLayerProperties*) malloc(layerCount * sizeof(VkLayerProperties));
+    //the copy of this allocation would not fit the batch, whose end in the ring would then cover it
+    if (g_UploadCopyCount == UPLOAD_MAX_COPIES && !flushUploads()) return NULL;
 
-            if (layerProperties == NULL)
-            {
-                printErrorMsg("unable to allocate memory (7)\n");
-                return false;
-            }
+    for (;;)
+    {
+        VkDeviceSize position = g_StagingRingHead % g_StagingRingSize;
 
-            pfn_vkEnumerateDeviceLayerProperties(g_SelectedPhysicalDevice, &layerCount, layerProperties);
+        //an allocation never wraps, the rest of the buffer is skipped instead
+        VkDeviceSize padding = position + size > g_StagingRingSize ? g_StagingRingSize - position : 0;
 
-            for (uint32_t i=0 ; i < layerCount; ++i)
-            {
-                printf("\t%s | %s\n", layerProperties[i].layerName, layerProperties[i].description);
-            }
+        if (g_StagingRingHead + padding + size - g_StagingRingTail <= g_StagingRingSize)
+        {
+            g_StagingRingHead += padding;
+            *offset = g_StagingRingHead % g_StagingRingSize;
+            g_StagingRingHead += size;
 
-            uint32_t numberOfEllements = sizeof g_DeviceLayers / sizeof g_DeviceLayers[0];
+            if (g_StagingRingHead - g_StagingRingTail > g_StagingRingPeak)
+                g_StagingRingPeak = g_StagingRingHead - g_StagingRingTail;
 
-            if(numberOfEllements == 1 && g_DeviceLayers[0] == NULL) numberOfEllements = 0;
+            return g_StagingRingMemory.mapped + *offset;
+        }
 
-            if (numberOfEllements)
-            {
+        //the space is held by copies not submitted yet, or by batches still in flight
+        if (waitOldestUploadBatch()) continue;
 
-                for (uint32_t i = 0 ; i < layerCount; ++i)
-                {
-                    for (uint32_t a = 0; a < numberOfEllements; ++a)
-                    {
-                        if (!strcmp(g_DeviceLayers[a], layerProperties[i].layerName))
-                        {
+        if (g_UploadCopyCount)
+        {
+            if (!flushUploads()) return NULL;
+            continue;
+        }
 
-                            char** pDeviceLayersArrayTmp = (char**) realloc(g_DeviceLayersArray,
-                                sizeof g_DeviceLayers[0] * (g_DeviceLayersArrayCount+1));
+        printErrorMsg("staging ring, no space left.\n");
+        return NULL;
+    }
+}
 
-                            if (!pDeviceLayersArrayTmp)
-                            {
-                                printErrorMsg("unable to reallocate memory (3)\n");
-                                free(layerProperties);
-                                return false;
-                            }
+/*
+==============================
+ uploadData();
+==============================
+*/
 
-                            g_DeviceLayersArray = pDeviceLayersArrayTmp;
+//copies data to the staging ring and queues the transfer to dstBuffer, large data goes in chunks
+bool uploadData(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+    VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    VkDeviceSize chunkSize = g_StagingRingSize / 4;
+    VkDeviceSize done = 0;
 
+    while (done < size)
+    {
+        VkDeviceSize chunk = size - done < chunkSize ? size - done : chunkSize;
+        VkDeviceSize srcOffset = 0;
 
-                            g_DeviceLayersArray[g_DeviceLayersArrayCount] =
-                                (char*) malloc(strlen(layerProperties[i].layerName) + 1);
+        char *dst = stagingRingAlloc(chunk, &srcOffset);
 
-                            if (g_DeviceLayersArray[g_DeviceLayersArrayCount] == NULL)
-                            {
-                                printErrorMsg("unable to allocate memory (8)[%d]\n", g_DeviceLayersArrayCount);
-                                free(layerProperties);
-                                return false;
-                            }
+        if (dst == NULL) return false;
 
-                            strcpy(g_DeviceLayersArray[g_DeviceLayersArrayCount],layerProperties[i].layerName);
+        memcpy(dst, (const char*)data + done, chunk);
 
-                            g_DeviceLayersArrayCount++;
+        if (!uploadBuffer(g_StagingRingBuffer, srcOffset, dstBuffer, dstOffset + done, chunk,
+            dstStageMask, dstAccessMask)) return false;
 
-                        }
-                    }
-                }
-            }
+        done += chunk;
+    }
 
-            free(layerProperties);
-        }
-        else printf("none.\n");
-	}
+    return true;
+}
 
-    printInfoMsg("count of device layers to be used: %d\n",g_DeviceLayersArrayCount);
+/*
+==============================
+ destroyUploadEngine();
+==============================
+*/
 
-    if (g_DeviceLayersArrayCount>0)
+void destroyUploadEngine()
+{
+    //the device is idle at this point, every batch is done
+    for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i)
     {
-        printInfoMsg("list of device layers to be used:\n");
-        for (uint32_t i = 0; i < g_DeviceLayersArrayCount; ++i)
-        {
-            printf("\t%s\n",g_DeviceLayersArray[i]);
-        }
+        if (g_UploadBatches[i].timelineValue) releaseUploadBatch(&g_UploadBatches[i]);
     }
 
-	//enumerate device extensions
+    if (g_StagingRingBuffer)
     {
+        printInfoMsg("staging ring: %zu bytes written, peak use %zu of %zu\n", (size_t)g_StagingRingHead,
+            (size_t)g_StagingRingPeak, (size_t)g_StagingRingSize);
+    }
 
-        uint32_t extensionCount = 0;
+    if (g_StagingRingBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice, g_StagingRingBuffer, NULL);
+        g_StagingRingBuffer = VK_NULL_HANDLE;
+        printInfoMsg("destroy staging ring buffer\n");
+    }
 
-        pfn_vkEnumerateDeviceExtensionProperties(g_SelectedPhysicalDevice, NULL, &extensionCount, NULL);
+    if (g_StagingRingMemory.memory)
+    {
+        freeMemory(&g_StagingRingMemory);
+        printInfoMsg("free staging ring memory\n");
+    }
 
-        printInfoMsg("available device extensions count: %d\n", extensionCount);
+    if (g_UploadTimeline && pfn_vkDestroySemaphore)
+    {
+        pfn_vkDestroySemaphore(g_LogicalDevice, g_UploadTimeline, NULL);
+        g_UploadTimeline = VK_NULL_HANDLE;
+        printInfoMsg("vkDestroySemaphore() (upload timeline)\n");
+    }
 
-        printInfoMsg("available device extensions: ");
+    //command buffers go away with their pools
+    if (g_UploadAcquireCommandPool && pfn_vkDestroyCommandPool)
+    {
+        pfn_vkDestroyCommandPool(g_LogicalDevice, g_UploadAcquireCommandPool, NULL);
+        g_UploadAcquireCommandPool = VK_NULL_HANDLE;
+        printInfoMsg("destroy CommandPool (upload acquire)\n");
+    }
 
-        if (extensionCount>0)
-        {
-            printf("\n");
+    if (g_UploadCommandPool && pfn_vkDestroyCommandPool)
+    {
+        pfn_vkDestroyCommandPool(g_LogicalDevice, g_UploadCommandPool, NULL);
+        g_UploadCommandPool = VK_NULL_HANDLE;
+        printInfoMsg("destroy CommandPool (upload)\n");
+    }
+}
 
-            VkExtensionProperties* extensionProperties =
-            (VkExtensionProperties*) malloc(extensionCount * sizeof(VkExtensionProperties));
+/*
+==============================
+ pipelineCacheFileName();
+==============================
+*/
 
-            if (extensionProperties==NULL)
-            {
-                printErrorMsg("unable to allocate memory (9)\n");
-                return false;
-            }
+//one file per vendor/device, the driver's pipelineCacheUUID is checked against the header
+void pipelineCacheFileName(char *name, size_t size)
+{
+    snprintf(name, size, PIPELINE_CACHE_FILE_FORMAT,
+        g_PhysicalDeviceProperties.vendorID, g_PhysicalDeviceProperties.deviceID);
+}
 
-            pfn_vkEnumerateDeviceExtensionProperties(g_SelectedPhysicalDevice,
-                                                        NULL,
-                                                        &extensionCount,
-                                                        extensionProperties);
+/*
+==============================
+ isPipelineCacheValid();
+==============================
+*/
 
-            for (uint32_t i=0 ; i < extensionCount; ++i)
-            {
-                printf("\t%s\n", extensionProperties[i].extensionName);
-            }
+//VkPipelineCacheHeaderVersionOne: length, version, vendorID, deviceID, pipelineCacheUUID
+bool isPipelineCacheValid(const char *data, size_t size)
+{
+    uint32_t headerLength, headerVersion, vendorID, deviceID;
 
-            uint32_t numberOfEllements = 0;
+    if (size < 16 + VK_UUID_SIZE) return false;
 
-            numberOfEllements = sizeof g_DeviceExtensions / sizeof g_DeviceExtensions[0];
+    memcpy(&headerLength, data, 4);
+    memcpy(&headerVersion, data + 4, 4);
+    memcpy(&vendorID, data + 8, 4);
+    memcpy(&deviceID, data + 12, 4);
 
-            if(numberOfEllements == 1 && g_DeviceExtensions[0] == NULL) numberOfEllements = 0;
+    if (headerLength < 16 + VK_UUID_SIZE || headerLength > size)
+    {
+        printWarningMsg("pipeline cache, bad header length %u.\n", headerLength);
+        return false;
+    }
 
-            if (numberOfEllements)
-            {
+    if (headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    {
+        printWarningMsg("pipeline cache, unknown header version %u.\n", headerVersion);
+        return false;
+    }
 
-                for (uint32_t a = 0; a < numberOfEllements; ++a)
-                {
-                    for (uint32_t i = 0 ; i < extensionCount; ++i)
-                    {
-                        if (!strcmp(g_DeviceExtensions[a], extensionProperties[i].extensionName))
-                        {
+    if (vendorID != g_PhysicalDeviceProperties.vendorID || deviceID != g_PhysicalDeviceProperties.deviceID)
+    {
+        printWarningMsg("pipeline cache, made for another device (%04x:%04x).\n", vendorID, deviceID);
+        return false;
+    }
 
-                            char** pDeviceExtensionsArrayTmp = (char**) realloc(g_DeviceExtArray,
-                                    sizeof g_DeviceExtensions[0] * (g_DeviceExtArrayCount+1));
+    //a driver update changes the UUID
+    if (memcmp(data + 16, g_PhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        printWarningMsg("pipeline cache, made by another driver version.\n");
+        return false;
+    }
 
-                            if (!pDeviceExtensionsArrayTmp)
-                            {
-                                printErrorMsg("unable to reallocate memory (4)\n");
-                                free(extensionProperties);
-                                return false;
-                            }
+    return true;
+}
 
-                            g_DeviceExtArray = pDeviceExtensionsArrayTmp;
+/*
+==============================
+ createPipelineCache();
+==============================
+*/
 
-                            g_DeviceExtArray[g_DeviceExtArrayCount] =
-                                (char*) malloc(strlen(extensionProperties[i].extensionName) + 1);
+bool createPipelineCache()
+{
+    char fileName[64];
+    char *data = NULL;
+    size_t size = 0;
 
+    pipelineCacheFileName(fileName, sizeof fileName);
 
-                            if (g_DeviceExtArray[g_DeviceExtArrayCount] == NULL)
-                            {
-                                printErrorMsg("unable to allocate memory (10)[%d]\n",g_DeviceExtArrayCount);
-                                free(extensionProperties);
-                                return false;
-                            }
+    FILE *fp = fopen(fileName, "rb");
 
-                            strcpy(g_DeviceExtArray[g_DeviceExtArrayCount],
-                                extensionProperties[i].extensionName);
+    if (fp)
+    {
+        fseek(fp, 0, SEEK_END);
+        long fileSize = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
 
-                            g_DeviceExtArrayCount++;
+        if (fileSize > 0)
+        {
+            data = malloc(fileSize);
 
-                        }
-                    }
-                }
+            if (!data)
+            {
+                printErrorMsg("unable to allocate memory (29)\n");
+                fclose(fp);
+                return false;
+            }
 
+            size = fread(data, 1, fileSize, fp);
 
+            if (size != (size_t)fileSize || !isPipelineCacheValid(data, size))
+            {
+                free(data);
+                data = NULL;
+                size = 0;
             }
-           free(extensionProperties);
         }
-        else printf("none.\n");
 
-	}
+        fclose(fp);
+    }
 
-    printInfoMsg("count of device extensions to be used: %d\n",g_DeviceExtArrayCount);
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {0};
 
-    if (g_DeviceExtArrayCount>0)
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = size;
+    pipelineCacheCreateInfo.pInitialData = data;
+
+    VkResult result = pfn_vkCreatePipelineCache(g_LogicalDevice, &pipelineCacheCreateInfo, NULL, &g_PipelineCache);
+
+    free(data);
+
+    if (result != VK_SUCCESS)
     {
-        printInfoMsg("list of device extensions to be used:\n");
-        for (uint32_t i = 0; i < g_DeviceExtArrayCount; ++i)
-        {
-            printf("\t%s\n",g_DeviceExtArray[i]);
-        }
+        printErrorMsg("vkCreatePipelineCache() (%d).\n", result);
+        return false;
     }
 
-    //queue families
+    g_PipelineCacheWarm = size > 0;
+
+    if (g_PipelineCacheWarm)
+        printInfoMsg("pipeline cache: %zu bytes loaded from %s\n", size, fileName);
+    else
+        printInfoMsg("pipeline cache: %s not usable, starting empty\n", fileName);
+
+    return true;
+}
+
+/*
+==============================
+ savePipelineCache();
+==============================
+*/
+
+//written to a temporary file first, an interrupted write never leaves a truncated cache behind
+void savePipelineCache()
+{
+    size_t size = 0;
+
+    VkResult result = pfn_vkGetPipelineCacheData(g_LogicalDevice, g_PipelineCache, &size, NULL);
+
+    if (result != VK_SUCCESS || size == 0)
     {
-        uint32_t queueFamilyCount = 0;
+        printWarningMsg("pipeline cache, vkGetPipelineCacheData() (%d).\n", result);
+        return;
+    }
 
-        pfn_vkGetPhysicalDeviceQueueFamilyProperties(g_SelectedPhysicalDevice, &queueFamilyCount, NULL);
+    char *data = malloc(size);
 
-        printInfoMsg("queue family count %d\n",queueFamilyCount);
+    if (!data)
+    {
+        printErrorMsg("unable to allocate memory (30)\n");
+        return;
+    }
 
-        if (queueFamilyCount<1)
-        {
-            printErrorMsg("queue family count is not greater than zero, exitting.\n");
-            return false;
-        }
+    result = pfn_vkGetPipelineCacheData(g_LogicalDevice, g_PipelineCache, &size, data);
 
-        VkQueueFamilyProperties* familyProperties =
-            (VkQueueFamilyProperties*) malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    if (result != VK_SUCCESS)
+    {
+        printWarningMsg("pipeline cache, vkGetPipelineCacheData() (%d).\n", result);
+        free(data);
+        return;
+    }
 
-        if (familyProperties == NULL)
-        {
-            printErrorMsg("unable to allocate memory (11)\n");
-            return false;
-        }
+    char fileName[64];
+    char tmpFileName[72];
 
-        pfn_vkGetPhysicalDeviceQueueFamilyProperties(g_SelectedPhysicalDevice,	&queueFamilyCount, familyProperties);
+    pipelineCacheFileName(fileName, sizeof fileName);
+    snprintf(tmpFileName, sizeof tmpFileName, "%s.tmp", fileName);
 
-        for (uint32_t i = 0; i < queueFamilyCount; ++i)
-        {
-            printInfoMsg("count of queues in queue family [%d]: %d\n", i, familyProperties[i].queueCount);
+    FILE *fp = fopen(tmpFileName, "wb");
 
-            printInfoMsg("Supported operations on this queue family [%d]:\n",i);
+    if (!fp)
+    {
+        printWarningMsg("pipeline cache, cannot open %s\n", tmpFileName);
+        free(data);
+        return;
+    }
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-                printf("\tGraphics\n");
+    bool written = fwrite(data, 1, size, fp) == size;
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
-                printf("\tCompute\n");
+    written = fclose(fp) == 0 && written;
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
-                printf("\tTransfer\n");
+    free(data);
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT)
-                printf("\tSparse Binding\n");
+    if (!written || rename(tmpFileName, fileName) != 0)
+    {
+        printWarningMsg("pipeline cache, cannot write %s\n", fileName);
+        remove(tmpFileName);
+        return;
+    }
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_PROTECTED_BIT)
-                printf("\tProtected\n");
+    printInfoMsg("pipeline cache: %zu bytes saved to %s\n", size, fileName);
+}
 
-        }
+/*
+==============================
+ workerMain();
+==============================
+*/
 
-        /*
-         find the first matching index for g_GraphicsQueueFamilyIndex and g_PresentQueueFamilyIndex
-         if there is none, find first for g_GraphicsQueueFamilyIndex and first for g_PresentQueueFamilyIndex
-        */
+void *workerMain(void *arg)
+{
+    (void)arg;
 
-        for (uint32_t i = 0; i<queueFamilyCount; ++i)
-        {
-            VkBool32 presentationSupported;
+    pthread_mutex_lock(&g_JobMutex);
 
-            VkResult result = pfn_vkGetPhysicalDeviceSurfaceSupportKHR( g_SelectedPhysicalDevice,
-                i, g_Surface, &presentationSupported);
+    for (;;)
+    {
+        while (g_JobCount == 0 && !g_WorkersQuit) pthread_cond_wait(&g_JobAvailable, &g_JobMutex);
 
-            if (result != VK_SUCCESS)
-            {
-                free(familyProperties);
-                printErrorMsg("vkGetPhysicalDeviceSurfaceSupportKHR().\n");
-                return false;
-            }
+        //quit only once the queue is drained
+        if (g_JobCount == 0) break;
 
-            if (familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && presentationSupported)
-            {
-                g_GraphicsQueueFamilyIndex = i;
-                g_PresentQueueFamilyIndex = i;
-                break;
-            }
+        Job job = g_Jobs[g_JobHead];
 
-            if( g_GraphicsQueueFamilyIndex == -1 )
-            {
-                if( familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT ) g_GraphicsQueueFamilyIndex = i;
-            }
+        g_JobHead = (g_JobHead + 1) % MAX_JOBS;
+        g_JobCount--;
 
-            if( g_PresentQueueFamilyIndex == -1 )
-            {
-                if( presentationSupported ) g_PresentQueueFamilyIndex = i;
-            }
-        }
+        pthread_mutex_unlock(&g_JobMutex);
 
-        /*
-         find matching index for g_TransferQueueFamilyIndex, using first one at the moment
-        */
+        job.function(job.data);
 
-        for (uint32_t i = 0; i<queueFamilyCount; ++i)
-        {
-            if (familyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
-            {
-                g_TransferQueueFamilyIndex = i;
-                break;
-            }
-        }
+        pthread_mutex_lock(&g_JobMutex);
 
-        free(familyProperties);
+        if (job.counter && --job.counter->remaining == 0) pthread_cond_broadcast(&g_JobDone);
     }
 
-    if (g_GraphicsQueueFamilyIndex == -1)
+    pthread_mutex_unlock(&g_JobMutex);
+
+    return NULL;
+}
+
+/*
+==============================
+ createWorkers();
+==============================
+*/
+
+//with no worker threads jobs run on the calling thread in submitJob()
+void createWorkers(uint32_t count)
+{
+    g_WorkersQuit = false;
+
+    for (uint32_t i = 0; i < count && i < MAX_WORKER_THREADS; ++i)
     {
-        printErrorMsg("no Queue Family with VkQueue Graphics Transfer Bit.\n");
-        return false;
+        if (pthread_create(&g_Workers[i], NULL, workerMain, NULL) != 0)
+        {
+            printWarningMsg("pthread_create(), worker %u.\n", i);
+            break;
+        }
+
+        g_WorkerCount++;
     }
 
-    if (g_PresentQueueFamilyIndex == -1)
+    printInfoMsg("worker threads: %u\n", g_WorkerCount);
+}
+
+/*
+==============================
+ submitJob();
+==============================
+*/
+
+//jobs start in submission order, a job may wait for jobs submitted before it, never after
+bool submitJob(void (*function)(void *data), void *data, JobCounter *counter)
+{
+    if (g_WorkerCount == 0)
     {
-        printErrorMsg("no Queue Family with Present Queue.\n");
-        return false;
+        function(data);
+        return true;
     }
 
-    if (g_TransferQueueFamilyIndex == -1)
+    pthread_mutex_lock(&g_JobMutex);
+
+    if (g_JobCount == MAX_JOBS)
     {
-        printErrorMsg("no Queue Family with Transfer Bit.\n");
+        pthread_mutex_unlock(&g_JobMutex);
+        printErrorMsg("job queue is full.\n");
         return false;
     }
 
-    printInfoMsg("Graphics Bit on Queue Family [%d]\n", g_GraphicsQueueFamilyIndex);
-    printInfoMsg("Present Queue on Queue Family [%d]\n", g_PresentQueueFamilyIndex);
-    printInfoMsg("Transfer Queue on Queue Family [%d]\n", g_TransferQueueFamilyIndex);
+    Job *job = &g_Jobs[(g_JobHead + g_JobCount) % MAX_JOBS];
 
-    //create logical device
-    {
-        int32_t queueInfoCount;
+    job->function = function;
+    job->data = data;
+    job->counter = counter;
 
-        if (g_GraphicsQueueFamilyIndex != g_PresentQueueFamilyIndex) queueInfoCount = 2;
-        else queueInfoCount = 1;
+    g_JobCount++;
 
-        VkDeviceQueueCreateInfo queueCreateInfo[queueInfoCount];
+    if (counter) counter->remaining++;
 
-        memset( queueCreateInfo, 0, sizeof queueCreateInfo);
+    pthread_cond_signal(&g_JobAvailable);
+    pthread_mutex_unlock(&g_JobMutex);
 
-        float queuePriorities[queueInfoCount];
+    return true;
+}
 
-        queuePriorities[0] = 1.0f;
+/*
+==============================
+ waitJobs();
+==============================
+*/
 
-        queueCreateInfo[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo[0].pNext = NULL;
-        queueCreateInfo[0].queueFamilyIndex = g_GraphicsQueueFamilyIndex;
-        queueCreateInfo[0].queueCount = 1;
-        queueCreateInfo[0].pQueuePriorities = queuePriorities;
+void waitJobs(JobCounter *counter)
+{
+    pthread_mutex_lock(&g_JobMutex);
 
-        if (queueInfoCount==2)
-        {
-            queuePriorities[1] = 1.0f;
+    while (counter->remaining) pthread_cond_wait(&g_JobDone, &g_JobMutex);
 
-            queueCreateInfo[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo[1].pNext = NULL;
-            queueCreateInfo[1].queueFamilyIndex = g_PresentQueueFamilyIndex;
-            queueCreateInfo[1].queueCount = 1;
-            queueCreateInfo[1].pQueuePriorities = queuePriorities;
-        }
+    pthread_mutex_unlock(&g_JobMutex);
+}
 
-        VkDeviceCreateInfo deviceCreateInfo = {0};
+/*
+==============================
+ jobsDone();
+==============================
+*/
 
-        deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        deviceCreateInfo.pNext = NULL;
-        deviceCreateInfo.queueCreateInfoCount = queueInfoCount;
-        deviceCreateInfo.pQueueCreateInfos = queueCreateInfo;
-        deviceCreateInfo.enabledLayerCount = g_DeviceLayersArrayCount;
-        if (g_DeviceLayersArrayCount) deviceCreateInfo.ppEnabledLayerNames =
-            (const char* const*) g_DeviceLayersArray;
-        else deviceCreateInfo.ppEnabledLayerNames = NULL;
-        deviceCreateInfo.enabledExtensionCount = g_DeviceExtArrayCount;
-        if (g_DeviceExtArrayCount) deviceCreateInfo.ppEnabledExtensionNames =
-            (const char* const*) g_DeviceExtArray;
-        else deviceCreateInfo.ppEnabledExtensionNames = NULL;
-        deviceCreateInfo.pEnabledFeatures = NULL;
+bool jobsDone(JobCounter *counter)
+{
+    pthread_mutex_lock(&g_JobMutex);
 
-        VkResult result = pfn_vkCreateDevice( g_SelectedPhysicalDevice,
-            &deviceCreateInfo, NULL, &g_LogicalDevice);
+    bool done = counter->remaining == 0;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("failed to create logical device.\n");
-            return false;
-        }
-    }
+    pthread_mutex_unlock(&g_JobMutex);
 
-    printInfoMsg("Create Logical Device. OK.\n");
+    return done;
+}
 
-    //get device level fnc address
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDevice);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkGetDeviceQueue);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateSemaphore);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroySemaphore);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateFence);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkResetFences);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkWaitForFences);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyFence);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateSwapchainKHR);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroySwapchainKHR);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkGetSwapchainImagesKHR);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateImageView);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyImageView);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateRenderPass);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyRenderPass);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateFramebuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyFramebuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateMemory);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeMemory);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkGetBufferMemoryRequirements);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkBindBufferMemory);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkMapMemory);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkUnmapMemory);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateCommandPool);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyCommandPool);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateCommandBuffers);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeCommandBuffers);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateShaderModule);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyShaderModule);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateDescriptorSetLayout);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDescriptorSetLayout);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateDescriptorPool);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDescriptorPool);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateDescriptorSets);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkUpdateDescriptorSets);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeDescriptorSets);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreatePipelineLayout);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyPipelineLayout);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateGraphicsPipelines);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyPipeline);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkAcquireNextImageKHR);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkBeginCommandBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBeginRenderPass);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindPipeline);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindDescriptorSets);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindVertexBuffers);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindIndexBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdEndRenderPass);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkEndCommandBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkQueueSubmit);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkQueuePresentKHR);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDraw);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDrawIndexed);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkDeviceWaitIdle);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdCopyBuffer);
-    GET_DEVICE_LEVEL_FUN_ADDR(vkQueueWaitIdle);
+/*
+==============================
+ destroyWorkers();
+==============================
+*/
 
-    //get device queues
-    pfn_vkGetDeviceQueue(g_LogicalDevice, g_GraphicsQueueFamilyIndex, 0, &g_GraphicsQueue);
+void destroyWorkers()
+{
+    if (g_WorkerCount == 0) return;
 
-    if (g_GraphicsQueueFamilyIndex != g_PresentQueueFamilyIndex)
+    pthread_mutex_lock(&g_JobMutex);
+    g_WorkersQuit = true;
+    pthread_cond_broadcast(&g_JobAvailable);
+    pthread_mutex_unlock(&g_JobMutex);
+
+    for (uint32_t i = 0; i < g_WorkerCount; ++i) pthread_join(g_Workers[i], NULL);
+
+    printInfoMsg("worker threads joined (%u)\n", g_WorkerCount);
+
+    g_WorkerCount = 0;
+}
+
+/*
+==============================
+ computeFrustumPlanes();
+==============================
+*/
+
+//planes of proj * view * model, so they test model space points, normal points inside
+void computeFrustumPlanes(float planes[6][4])
+{
+    mat4x4 viewModel, clip;
+
+    mat4x4_mul(viewModel, viewMatrix, modelMatrix);
+    mat4x4_mul(clip, projectionMatrix, viewModel);
+
+    //clip[column][row], rows 0..3 are x, y, z, w of the clip space position
+    for (int i = 0; i < 4; ++i)
     {
-        pfn_vkGetDeviceQueue(g_LogicalDevice, g_PresentQueueFamilyIndex, 0, &g_PresentQueue);
+        planes[0][i] = clip[i][3] + clip[i][0];
+        planes[1][i] = clip[i][3] - clip[i][0];
+        planes[2][i] = clip[i][3] + clip[i][1];
+        planes[3][i] = clip[i][3] - clip[i][1];
+        planes[4][i] = clip[i][3] + clip[i][2];
+        planes[5][i] = clip[i][3] - clip[i][2];
     }
-    else
+
+    for (int p = 0; p < 6; ++p)
     {
-        g_PresentQueue = g_GraphicsQueue;
+        float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+
+        if (length > 0.0f)
+            for (int i = 0; i < 4; ++i) planes[p][i] /= length;
     }
+}
 
-    pfn_vkGetDeviceQueue(g_LogicalDevice, g_TransferQueueFamilyIndex, 0, &g_TransferQueue);
+/*
+==============================
+ recordCulling();
+==============================
+*/
 
-    //create semaphores
-    {
-        VkSemaphoreCreateInfo semaphoreCreateInfo = {0};
+//outside the render pass, fills the frame's region of g_CullOutputBuffer and its visible count
+void recordCulling(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    pfn_vkCmdFillBuffer(commandBuffer, g_CullCountBuffer, frame * sizeof(uint32_t), sizeof(uint32_t), 0);
 
-        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkMemoryBarrier memoryBarrier = {0};
 
-        for(uint32_t i = 0; i < SWAP_CHAIN_IMAGE_COUNT; ++i)
-        {
-            VkResult result = pfn_vkCreateSemaphore (g_LogicalDevice, &semaphoreCreateInfo,
-                NULL, &g_semaphoreImageAvailableArr[i]);
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
-            if (result != VK_SUCCESS)
-            {
-                printErrorMsg("cannot create semaphore (image available) [%d].\n", i);
-                return false;
-            }
+    pfn_vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
 
-            result = pfn_vkCreateSemaphore (g_LogicalDevice, &semaphoreCreateInfo, NULL,
-                &g_semaphoreRenderFinishedArr[i]);
+    CullPushConstants pushConstants = {0};
 
-            if (result != VK_SUCCESS)
+    computeFrustumPlanes(pushConstants.planes);
+
+    pushConstants.objectCount = g_DrawCount;
+    pushConstants.drawBase = frame * g_DrawCount;
+    pushConstants.countIndex = frame;
+    pushConstants.compact = g_CullCompact ? 1 : 0;
+
+    pfn_vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, g_CullPipeline);
+
+    pfn_vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, g_CullPipelineLayout,
+        0, 1, &g_CullDescriptorSet, 0, NULL);
+
+    pfn_vkCmdPushConstants(commandBuffer, g_CullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof pushConstants, &pushConstants);
+
+    pfn_vkCmdDispatch(commandBuffer, (g_DrawCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    //the count is also read back by the CPU for the statistics once the fence is signaled
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    pfn_vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+/*
+==============================
+ readCullStats();
+==============================
+*/
+
+//called after fenceArr[frame] is signaled
+void readCullStats(uint32_t frame)
+{
+    if (!g_CullCountPending[frame]) return;
+
+    g_CullCountPending[frame] = false;
+
+    uint32_t visible = ((const uint32_t*)g_CullCountMemory.mapped)[frame];
+
+    if (!g_CullFrames || visible < g_CullVisibleMin) g_CullVisibleMin = visible;
+    if (!g_CullFrames || visible > g_CullVisibleMax) g_CullVisibleMax = visible;
+
+    g_CullVisibleSum += visible;
+    g_CullFrames++;
+}
+
+/*
+==============================
+ printCullStats();
+==============================
+*/
+
+void printCullStats()
+{
+    if (!g_CullFrames) return;
+
+    double average = (double)g_CullVisibleSum / g_CullFrames;
+
+    printInfoMsg("gpu culling: %u frames, visible objects avg %.1f, min %u, max %u of %u (%.1f%%)\n",
+        g_CullFrames, average, g_CullVisibleMin, g_CullVisibleMax, g_DrawCount,
+        g_DrawCount ? 100.0 * average / g_DrawCount : 0.0);
+}
+
+/*
+==============================
+ destroySwapChainResources();
+==============================
+*/
+
+//framebuffers, image views and the render targets, the swapchain itself is retired by the caller
+void destroySwapChainResources()
+{
+    if (g_FrameBuffers && pfn_vkDestroyFramebuffer)
+    {
+        for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+        {
+            if (g_FrameBuffers[i])
             {
-                printErrorMsg("cannot create semaphore (render finished) [%d].\n", i);
-                return false;
+                pfn_vkDestroyFramebuffer(g_LogicalDevice, g_FrameBuffers[i], NULL);
+                printInfoMsg("free vkDestroyFramebuffer() (%d)\n",i);
             }
         }
     }
 
-    printInfoMsg("create semaphores: OK.\n");
+    if (g_FrameBuffers)
+    {
+        free(g_FrameBuffers);
+        g_FrameBuffers = NULL;
+        printInfoMsg("free g_FrameBuffers\n");
+    }
 
-    //create fences
+    if (g_SwapChainImageViews && pfn_vkDestroyImageView)
     {
-        for ( int32_t i = 0; i < SWAP_CHAIN_IMAGE_COUNT; ++i )
+        for ( uint32_t i = 0; i < g_SwapChainImageCount; ++i )
         {
-            VkFenceCreateInfo fenceCreateInfo = {0};
-            fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+            pfn_vkDestroyImageView(g_LogicalDevice, g_SwapChainImageViews[i], NULL);
+            printInfoMsg("vkDestroyImageView() (%d)\n",i);
+        }
 
-            VkResult result = pfn_vkCreateFence( g_LogicalDevice, &fenceCreateInfo, NULL, &fenceArr[i]);
+        free(g_SwapChainImageViews);
+        g_SwapChainImageViews = NULL;
+		printInfoMsg("free SwapChain Image Views.\n");
+    }
 
-            if (result != VK_SUCCESS)
-            {
-                printErrorMsg("cannot create fence. [%d].\n", i);
-                return false;
-            }
+    if (g_DepthImageView && pfn_vkDestroyImageView)
+    {
+        pfn_vkDestroyImageView(g_LogicalDevice, g_DepthImageView, NULL);
+        g_DepthImageView = VK_NULL_HANDLE;
+        printInfoMsg("vkDestroyImageView() depth\n");
     }
+
+    if (g_DepthImage && pfn_vkDestroyImage)
+    {
+        pfn_vkDestroyImage(g_LogicalDevice, g_DepthImage, NULL);
+        g_DepthImage = VK_NULL_HANDLE;
+        printInfoMsg("vkDestroyImage() depth\n");
     }
 
-    printInfoMsg("create fences: OK.\n");
+    if (g_DepthImageMemory.memory)
+    {
+        freeMemory(&g_DepthImageMemory);
+        printInfoMsg("free g_DepthImageMemory\n");
+    }
 
-    //get surface capabilities
+    if (g_MsaaColorImageView && pfn_vkDestroyImageView)
+    {
+        pfn_vkDestroyImageView(g_LogicalDevice, g_MsaaColorImageView, NULL);
+        g_MsaaColorImageView = VK_NULL_HANDLE;
+        printInfoMsg("vkDestroyImageView() msaa color\n");
+    }
 
-    VkSurfaceCapabilitiesKHR surfaceCapabilities = {0};
+    if (g_MsaaColorImage && pfn_vkDestroyImage)
+    {
+        pfn_vkDestroyImage(g_LogicalDevice, g_MsaaColorImage, NULL);
+        g_MsaaColorImage = VK_NULL_HANDLE;
+        printInfoMsg("vkDestroyImage() msaa color\n");
+    }
 
+    if (g_MsaaColorImageMemory.memory)
     {
-        VkResult result = pfn_vkGetPhysicalDeviceSurfaceCapabilitiesKHR(g_SelectedPhysicalDevice,
-            g_Surface, &surfaceCapabilities );
+        freeMemory(&g_MsaaColorImageMemory);
+        printInfoMsg("free g_MsaaColorImageMemory\n");
+    }
+}
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("vkGetPhysicalDeviceSurfaceCapabilitiesKHR().\n");
-            return false;
-        }
+/*
+==============================
+ shutdownVulkan();
+==============================
+*/
 
-        printInfoMsg("surfaceCapabilities.minImageCount %d\n",surfaceCapabilities.minImageCount);
-        printInfoMsg("surfaceCapabilities.maxImageCount %d\n",surfaceCapabilities.maxImageCount);
-        printInfoMsg("surfaceCapabilities.currentExtent.width %d\n",surfaceCapabilities.currentExtent.width);
-        printInfoMsg("surfaceCapabilities.currentExtent.height %d\n",surfaceCapabilities.currentExtent.height);
-        printInfoMsg("surfaceCapabilities.minImageExtent.width %d\n",surfaceCapabilities.minImageExtent.width);
-        printInfoMsg("surfaceCapabilities.minImageExtent.height %d\n",surfaceCapabilities.minImageExtent.height);
-        printInfoMsg("surfaceCapabilities.maxImageExtent.width %d\n",surfaceCapabilities.maxImageExtent.width);
-        printInfoMsg("surfaceCapabilities.maxImageExtent.height %d\n",surfaceCapabilities.maxImageExtent.height);
-        printInfoMsg("surfaceCapabilities.maxImageArrayLayers %d\n",surfaceCapabilities.maxImageArrayLayers);
+void shutdownVulkan()
+{
+    //jobs may still use the device if initVulkan() failed half way
+    destroyWorkers();
 
-        printInfoMsg("surfaceCapabilities.supportedTransforms:\n");
-        print_VkSurfaceTransformFlagBitsKHR(surfaceCapabilities.supportedTransforms);
+    if (g_ShaderReloadRunning)
+    {
+        pthread_join(g_ShaderReloadThread, NULL);
+        g_ShaderReloadRunning = false;
+    }
 
-        printInfoMsg("surfaceCapabilities.currentTransform:\n");
-        print_VkSurfaceTransformFlagBitsKHR(surfaceCapabilities.currentTransform);
+    if (g_TimestampQueryPool && pfn_vkDestroyQueryPool)
+    {
+        pfn_vkDestroyQueryPool(g_LogicalDevice, g_TimestampQueryPool, NULL);
+        printInfoMsg("vkDestroyQueryPool()\n");
+    }
 
-        printInfoMsg("surfaceCapabilities.supportedCompositeAlpha:\n");
-        print_VkCompositeAlphaFlagBitsKHR(surfaceCapabilities.supportedCompositeAlpha);
+    if (g_ShaderWatchFd >= 0)
+    {
+        close(g_ShaderWatchFd);
+        g_ShaderWatchFd = -1;
+    }
 
-        printInfoMsg("surfaceCapabilities.supportedUsageFlags:\n");
-        print_VkImageUsageFlagBits(surfaceCapabilities.supportedUsageFlags);
+    //a reload that finished but was never swapped in
+    if (g_ShaderReloadJob.pipeline && pfn_vkDestroyPipeline)
+    {
+        pfn_vkDestroyPipeline(g_LogicalDevice, g_ShaderReloadJob.pipeline, NULL);
+        g_ShaderReloadJob.pipeline = VK_NULL_HANDLE;
+    }
+
+    if (g_RetiredPipelineCount && pfn_vkDestroyPipeline)
+    {
+        for (uint32_t i = 0; i < g_RetiredPipelineCount; ++i)
+            pfn_vkDestroyPipeline(g_LogicalDevice, g_RetiredPipelines[i], NULL);
+
+        printInfoMsg("vkDestroyPipeline(), %u retired pipelines\n", g_RetiredPipelineCount);
 
+        g_RetiredPipelineCount = 0;
     }
 
-    //get surface formats
+    if (g_Pipeline && pfn_vkDestroyPipeline)
     {
-        uint32_t surfaceFormatCount = 0;
+        pfn_vkDestroyPipeline(g_LogicalDevice, g_Pipeline, NULL);
+        printInfoMsg("vkDestroyPipeline()\n");
+    }
+
+    if (g_PipelineLayout && pfn_vkDestroyPipelineLayout)
+    {
+        pfn_vkDestroyPipelineLayout(g_LogicalDevice, g_PipelineLayout, NULL);
+        printInfoMsg("vkDestroyPipelineLayout()\n");
+    }
+
+    if (g_PipelineCache && pfn_vkDestroyPipelineCache)
+    {
+        savePipelineCache();
+        pfn_vkDestroyPipelineCache(g_LogicalDevice, g_PipelineCache, NULL);
+        printInfoMsg("vkDestroyPipelineCache()\n");
+    }
+
+    if (g_DescriptorSets && pfn_vkFreeDescriptorSets)
+    {
+        pfn_vkFreeDescriptorSets(g_LogicalDevice,g_DescriptorPool,descriptorSetsCount,g_DescriptorSets);
+        free(g_DescriptorSets);
+        printInfoMsg("free descriptor sets\n");
+    }
+
+    if (g_DescriptorPool && pfn_vkDestroyDescriptorPool)
+    {
+        pfn_vkDestroyDescriptorPool(g_LogicalDevice,g_DescriptorPool,NULL);
+        printInfoMsg("vkDestroyDescriptorPool()\n");
+    }
+
+    if (g_DescriptorSetLayout && pfn_vkDestroyDescriptorSetLayout)
+    {
+        pfn_vkDestroyDescriptorSetLayout(g_LogicalDevice,g_DescriptorSetLayout,NULL);
+        printInfoMsg("vkDestroyDescriptorSetLayout()\n");
+    }
+
+    if (g_DescrBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice,g_DescrBuffer,NULL);
+        printInfoMsg("vkDestroyBuffer(), descriptor buffer\n");
+    }
+
+    if (g_DescriptorBufferMemory.memory)
+    {
+        freeMemory(&g_DescriptorBufferMemory);
+        g_UniformRingMapped = NULL;
+        printInfoMsg("free descriptor buffer memory\n");
+    }
+
+    //modules are owned by the dedup table, g_vertShaderModule/g_fragShaderModule only borrow them
+    if (g_ShaderModuleCount && pfn_vkDestroyShaderModule)
+    {
+        for (uint32_t i = 0; i < g_ShaderModuleCount; ++i)
+        {
+            pfn_vkDestroyShaderModule(g_LogicalDevice, g_ShaderModules[i].module, NULL);
+            free(g_ShaderModules[i].code);
+        }
+
+        printInfoMsg("vkDestroyShaderModule(), %u modules, %u loads deduplicated\n",
+            g_ShaderModuleCount, g_ShaderModuleDedupCount);
+
+        g_ShaderModuleCount = 0;
+        g_vertShaderModule = VK_NULL_HANDLE;
+        g_fragShaderModule = VK_NULL_HANDLE;
+    }
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        if (g_FrameCommandBuffers[i] && pfn_vkFreeCommandBuffers)
+        {
+            pfn_vkFreeCommandBuffers(g_LogicalDevice, g_FrameCommandPools[i], 1, &g_FrameCommandBuffers[i]);
+            printInfoMsg("free CommandBuffers [%d]\n", i);
+            g_FrameCommandBuffers[i] = NULL;
+        }
+    }
+
+    if (g_ImagesInFlight)
+    {
+        free(g_ImagesInFlight);
+        g_ImagesInFlight = NULL;
+    }
+
+    //secondaries are freed with their pools
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        for (uint32_t s = 0; s < MAX_RECORD_SLICES; ++s)
+        {
+            if (g_RecordCommandPools[i][s] && pfn_vkDestroyCommandPool)
+            {
+                pfn_vkDestroyCommandPool( g_LogicalDevice, g_RecordCommandPools[i][s], NULL );
+                g_RecordCommandPools[i][s] = NULL;
+                g_RecordCommandBuffers[i][s] = NULL;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        if (g_FrameCommandPools[i] && pfn_vkDestroyCommandPool)
+        {
+            pfn_vkDestroyCommandPool( g_LogicalDevice, g_FrameCommandPools[i], NULL );
+            printInfoMsg("destroy CommandPool() [%d]\n", i);
+            g_FrameCommandPools[i] = NULL;
+        }
+    }
+
+    if (g_Draws)
+    {
+        free(g_Draws);
+        g_Draws = NULL;
+    }
+
+    if (g_DrawObjects)
+    {
+        free(g_DrawObjects);
+        g_DrawObjects = NULL;
+    }
+
+    //still mapped if initVulkan() failed before the upload
+    if (g_MeshFileData)
+    {
+        munmap((void*)g_MeshFileData, g_MeshFileSize);
+        g_MeshFileData = NULL;
+        printInfoMsg("munmap %s\n", g_MeshFileName);
+    }
+
+    if (g_VertexBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice,g_VertexBuffer,NULL);
+        printInfoMsg("destroy vertex buffer\n");
+    }
+
+    if (g_VertexBufferMemory.memory)
+    {
+        freeMemory(&g_VertexBufferMemory);
+        printInfoMsg("free vertex buffer memory\n");
+    }
+
+    if (g_IndexBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice,g_IndexBuffer,NULL);
+        printInfoMsg("destroy index buffer\n");
+    }
+
+    if (g_IndexBufferMemory.memory)
+    {
+        freeMemory(&g_IndexBufferMemory);
+        printInfoMsg("free index buffer memory\n");
+    }
+
+    printCullStats();
+
+    if (g_CullPipeline && pfn_vkDestroyPipeline)
+    {
+        pfn_vkDestroyPipeline(g_LogicalDevice, g_CullPipeline, NULL);
+        printInfoMsg("vkDestroyPipeline(), culling\n");
+    }
+
+    if (g_CullPipelineLayout && pfn_vkDestroyPipelineLayout)
+    {
+        pfn_vkDestroyPipelineLayout(g_LogicalDevice, g_CullPipelineLayout, NULL);
+        printInfoMsg("vkDestroyPipelineLayout(), culling\n");
+    }
+
+    if (g_CullDescriptorPool && pfn_vkDestroyDescriptorPool)
+    {
+        pfn_vkDestroyDescriptorPool(g_LogicalDevice, g_CullDescriptorPool, NULL);
+        printInfoMsg("vkDestroyDescriptorPool(), culling\n");
+    }
+
+    if (g_CullDescriptorSetLayout && pfn_vkDestroyDescriptorSetLayout)
+    {
+        pfn_vkDestroyDescriptorSetLayout(g_LogicalDevice, g_CullDescriptorSetLayout, NULL);
+        printInfoMsg("vkDestroyDescriptorSetLayout(), culling\n");
+    }
+
+    {
+        VkBuffer *cullBuffers[] = {&g_CullBoundsBuffer, &g_CullOutputBuffer, &g_CullCountBuffer};
+        MemoryAllocation *cullMemory[] = {&g_CullBoundsMemory, &g_CullOutputMemory, &g_CullCountMemory};
+
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            if (*cullBuffers[i] && pfn_vkDestroyBuffer)
+            {
+                pfn_vkDestroyBuffer(g_LogicalDevice, *cullBuffers[i], NULL);
+                *cullBuffers[i] = NULL;
+            }
+
+            if (cullMemory[i]->memory) freeMemory(cullMemory[i]);
+        }
+    }
+
+    if (g_IndirectBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice,g_IndirectBuffer,NULL);
+        printInfoMsg("destroy indirect buffer\n");
+    }
+
+    if (g_IndirectBufferMemory.memory)
+    {
+        freeMemory(&g_IndirectBufferMemory);
+        printInfoMsg("free indirect buffer memory\n");
+    }
+
+    if (g_InstanceBuffer && pfn_vkDestroyBuffer)
+    {
+        pfn_vkDestroyBuffer(g_LogicalDevice,g_InstanceBuffer,NULL);
+        printInfoMsg("destroy instance buffer\n");
+    }
+
+    if (g_InstanceBufferMemory.memory)
+    {
+        freeMemory(&g_InstanceBufferMemory);
+        printInfoMsg("free instance buffer memory\n");
+    }
+
+    destroyUploadEngine();
+
+    destroySwapChainResources();
+
+    if (g_RenderPass)
+    {
+        pfn_vkDestroyRenderPass( g_LogicalDevice, g_RenderPass, NULL);
+        printInfoMsg("vkDestroyRenderPass()\n");
+
+    }
+
+    if (g_OffscreenImageMemory)
+    {
+        for ( uint32_t i = 0; i < g_SwapChainImageCount; ++i )
+        {
+            if (g_SwapChainImages && g_SwapChainImages[i] && pfn_vkDestroyImage)
+            {
+                pfn_vkDestroyImage(g_LogicalDevice, g_SwapChainImages[i], NULL);
+                printInfoMsg("vkDestroyImage() (%d) (offscreen)\n",i);
+            }
+
+            if (g_OffscreenImageMemory[i].memory)
+            {
+                freeMemory(&g_OffscreenImageMemory[i]);
+                printInfoMsg("free offscreen image memory (%d)\n",i);
+            }
+        }
+
+        free(g_OffscreenImageMemory);
+        printInfoMsg("free g_OffscreenImageMemory\n");
+    }
+
+    if (g_SwapChainImages)
+    {
+        free(g_SwapChainImages);
+        printInfoMsg("free SwapChain images.\n");
+    }
+
+    if (g_SwapChain && pfn_vkDestroySwapchainKHR)
+    {
+        pfn_vkDestroySwapchainKHR(g_LogicalDevice, g_SwapChain, NULL);
+        printInfoMsg("vkDestroySwapchainKHR().\n");
+    }
+
+    if(pfn_vkDestroyFence)
+    {
+        for ( int32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i )
+        {
+            if(fenceArr[i])
+            {
+                pfn_vkDestroyFence( g_LogicalDevice, fenceArr[i], NULL );
+                printInfoMsg("vkDestroyFence() [%d]\n", i);
+            }
+        }
+    }
+
+    if(pfn_vkDestroySemaphore)
+    {
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            if (g_semaphoreImageAvailableArr[i])
+            {
+                pfn_vkDestroySemaphore(g_LogicalDevice, g_semaphoreImageAvailableArr[i], NULL);
+                printInfoMsg("vkDestroySemaphore() [%d] (image available)\n", i);
+            }
+        }
+
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            if (g_semaphoreRenderFinishedArr[i])
+            {
+                pfn_vkDestroySemaphore(g_LogicalDevice, g_semaphoreRenderFinishedArr[i], NULL);
+                printInfoMsg("vkDestroySemaphore() [%d] (render finished)\n", i);
+            }
+        }
+    }
+
+    if (g_LogicalDevice)
+    {
+        printMemoryStats();
+        destroyMemoryAllocator();
+    }
+
+    if (g_LogicalDevice && pfn_vkDestroyDevice)
+    {
+        pfn_vkDestroyDevice(g_LogicalDevice, NULL);
+        printInfoMsg("destroy a logical device, vkDestroyDevice()\n");
+    }
+
+    if (g_DeviceExtArrayCount)
+    {
+        for (uint32_t i = 0; i < g_DeviceExtArrayCount; ++i)
+        {
+            printInfoMsg("free device extensions array [%d]\n",i);
+            free(g_DeviceExtArray[i]);
+        }
+    }
+
+    g_DeviceExtArrayCount = 0;
+
+    if (g_DeviceExtArray)
+    {
+        free(g_DeviceExtArray);
+        printInfoMsg("free g_DeviceExtArray\n");
+    }
+
+    if (g_DeviceLayersArrayCount)
+    {
+        for ( uint32_t i = 0; i < g_DeviceLayersArrayCount; ++i)
+        {
+            printInfoMsg("free device layers array [%d]\n",i);
+            free(g_DeviceLayersArray[i]);
+        }
+    }
+
+    g_DeviceLayersArrayCount = 0;
+
+    if (g_DeviceLayersArray)
+    {
+        free(g_DeviceLayersArray);
+        printInfoMsg("free g_DeviceLayersArray\n");
+    }
+
+    if (g_PhysicalDevices)
+    {
+        free(g_PhysicalDevices);
+        printInfoMsg("free g_PhysicalDevices\n");
+    }
+
+    if (g_Surface && pfn_vkDestroySurfaceKHR)
+    {
+        pfn_vkDestroySurfaceKHR(g_Instance, g_Surface, NULL);
+        printInfoMsg("vkDestroySurfaceKHR()\n");
+    }
+
+#ifdef DEBUG
+    if (g_DebugMessenger && pfn_vkDestroyDebugUtilsMessengerEXT)
+    {
+        pfn_vkDestroyDebugUtilsMessengerEXT(g_Instance, g_DebugMessenger,NULL);
+        printInfoMsg("DestroyDebugUtilsMessenger()\n");
+    }
+#endif
+
+    if (g_Instance && pfn_vkDestroyInstance)
+    {
+        pfn_vkDestroyInstance(g_Instance, NULL);
+        printInfoMsg("vkDestroyInstance()\n");
+    }
+
+    if (g_InstanceExtensionArrayCount)
+    {
+        for ( uint32_t i = 0; i < g_InstanceExtensionArrayCount; ++i)
+        {
+            free(g_InstanceExtensionArray[i]);
+            printInfoMsg("free instance extensions array [%d]\n",i);
+        }
+    }
+
+    if (g_InstanceExtensionArray)
+    {
+        free(g_InstanceExtensionArray);
+        printInfoMsg("free g_InstanceExtensionArray\n");
+    }
+
+    if (g_InstanceLayersArrayCount)
+    {
+        for ( uint32_t i = 0; i < g_InstanceLayersArrayCount; ++i)
+        {
+            free(g_InstanceLayersArray[i]);
+            printInfoMsg("free instance layers array [%d]\n",i);
+        }
+    }
+
+    if (g_InstanceLayersArray)
+    {
+        free(g_InstanceLayersArray);
+        printInfoMsg("free g_InstanceLayersArray\n");
+    }
+}
+
+/*
+==============================
+ maxValU();
+==============================
+*/
+
+uint32_t maxValU(uint32_t a, uint32_t b)
+{
+    if (a > b) return a;
+    return b;
+}
+
+/*
+==============================
+ minValU();
+==============================
+*/
+
+uint32_t minValU(uint32_t a, uint32_t b)
+{
+    if (a < b) return a;
+    return b;
+}
+
+/*
+==============================
+ isAvailable();
+==============================
+*/
+
+bool isAvailable(char **array, uint32_t count, const char *name)
+{
+
+    if (count<1) return false;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (strcmp(array[i],name)==0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+==============================
+ createOffscreenImages();
+==============================
+*/
+
+//headless mode: render targets are allocated here instead of being taken from a swapchain
+
+bool createOffscreenImages()
+{
+    //at least one image per frame in flight, so no frame has to wait for another one's image
+    g_SwapChainImageCount = maxValU(SWAP_CHAIN_IMAGE_COUNT, g_FramesInFlight);
+
+    g_SwapChainImages = (VkImage*) calloc(g_SwapChainImageCount, sizeof(VkImage));
+    g_OffscreenImageMemory = (MemoryAllocation*) calloc(g_SwapChainImageCount, sizeof(MemoryAllocation));
+
+    if (g_SwapChainImages==NULL || g_OffscreenImageMemory==NULL)
+    {
+        printErrorMsg("unable to allocate memory (23)\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+    {
+        VkImageCreateInfo imageCreateInfo = {0};
+
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = g_SurfaceFormat.format;
+        imageCreateInfo.extent.width = g_SwapChainExtent.width;
+        imageCreateInfo.extent.height = g_SwapChainExtent.height;
+        imageCreateInfo.extent.depth = 1;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkResult result = pfn_vkCreateImage(g_LogicalDevice, &imageCreateInfo, NULL, &g_SwapChainImages[i]);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("offscreen image, vkCreateImage() (%d).\n", i);
+            return false;
+        }
+
+        if (!allocateImageMemory(g_SwapChainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &g_OffscreenImageMemory[i]))
+        {
+            printErrorMsg("offscreen image (%d), unable to allocate memory.\n", i);
+            return false;
+        }
+    }
+
+    printInfoMsg("create offscreen images OK, count %d (%dx%d)\n", g_SwapChainImageCount,
+        g_SwapChainExtent.width, g_SwapChainExtent.height);
+
+    return true;
+}
+
+/*
+==============================
+ addGpuTimeSample();
+==============================
+*/
+
+bool addGpuTimeSample(double ms)
+{
+    if (g_GpuTimeCount == g_GpuTimeCapacity)
+    {
+        uint32_t newCapacity = g_GpuTimeCapacity ? g_GpuTimeCapacity * 2 : 1024;
+
+        double *newTimes = realloc(g_GpuTimes, newCapacity * sizeof(double));
+
+        if (!newTimes)
+        {
+            printErrorMsg("unable to allocate memory (26)\n");
+            return false;
+        }
+
+        g_GpuTimes = newTimes;
+        g_GpuTimeCapacity = newCapacity;
+    }
+
+    g_GpuTimes[g_GpuTimeCount++] = ms;
+
+    return true;
+}
+
+/*
+==============================
+ readGpuTimestamps();
+==============================
+*/
+
+//called after fenceArr[frame] is signaled, so the results are read without waiting
+void readGpuTimestamps(int32_t frame)
+{
+    uint64_t timestamps[TIMESTAMP_QUERIES_PER_FRAME];
+
+    if (!g_TimestampQueryPool || !g_FrameTimestampPending[frame]) return;
+
+    g_FrameTimestampPending[frame] = false;
+
+    VkResult result = pfn_vkGetQueryPoolResults(g_LogicalDevice, g_TimestampQueryPool,
+        frame * TIMESTAMP_QUERIES_PER_FRAME, TIMESTAMP_QUERIES_PER_FRAME,
+        sizeof timestamps, timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS)
+    {
+        if (result != VK_NOT_READY) printErrorMsg("vkGetQueryPoolResults() %d\n", result);
+        return;
+    }
+
+    uint64_t mask = g_TimestampValidBits >= 64 ? UINT64_MAX : (1ull << g_TimestampValidBits) - 1;
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+
+    addGpuTimeSample(ticks * (double)g_PhysicalDeviceProperties.limits.timestampPeriod * 1e-6);
+}
+
+/*
+==============================
+ createSwapChain();
+==============================
+*/
+
+//oldSwapChain is VK_NULL_HANDLE on the first call, the caller destroys it afterwards
+bool createSwapChain(VkSwapchainKHR oldSwapChain)
+{
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {0};
+
+    VkResult result = pfn_vkGetPhysicalDeviceSurfaceCapabilitiesKHR(g_SelectedPhysicalDevice,
+        g_Surface, &surfaceCapabilities );
+
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("vkGetPhysicalDeviceSurfaceCapabilitiesKHR().\n");
+        return false;
+    }
+
+    //choose SwapChain Extent
+    {
+        if (surfaceCapabilities.currentExtent.width != UINT32_MAX )
+        {
+            g_SwapChainExtent = surfaceCapabilities.currentExtent;
+        }
+        else
+        {
+            //the window size, clamped to what the surface supports
+            g_SwapChainExtent.width = maxValU(surfaceCapabilities.minImageExtent.width,
+                minValU(g_Width, surfaceCapabilities.maxImageExtent.width));
+            g_SwapChainExtent.height = maxValU(surfaceCapabilities.minImageExtent.height,
+                minValU(g_Height, surfaceCapabilities.maxImageExtent.height));
+        }
+
+        printInfoMsg("SwapChain Extent width: %d\n", g_SwapChainExtent.width);
+        printInfoMsg("SwapChain Extent height: %d\n", g_SwapChainExtent.height);
+    }
+
+    //image count
+    {
+        //mailbox needs a third image to always have one to render into while one is queued
+        g_ImageCount = g_PresentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : SWAP_CHAIN_IMAGE_COUNT;
+        if (g_ImageCount<surfaceCapabilities.minImageCount)
+            g_ImageCount = surfaceCapabilities.minImageCount;
+        if (surfaceCapabilities.maxImageCount && g_ImageCount>surfaceCapabilities.maxImageCount)
+            g_ImageCount = surfaceCapabilities.maxImageCount;
+
+        printInfoMsg("image count: %d\n", g_ImageCount);
+    }
+
+    //swapchain
+    {
+        VkSwapchainCreateInfoKHR swapchainCreateInfo = {0};
+
+        uint32_t queueFamilyIndices[] = {g_GraphicsQueueFamilyIndex, g_PresentQueueFamilyIndex};
+
+        swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        swapchainCreateInfo.minImageCount = g_ImageCount;
+        swapchainCreateInfo.surface = g_Surface;
+        swapchainCreateInfo.imageFormat = g_SurfaceFormat.format;
+        swapchainCreateInfo.imageColorSpace = g_SurfaceFormat.colorSpace;
+        swapchainCreateInfo.imageExtent = g_SwapChainExtent;
+        swapchainCreateInfo.imageArrayLayers = 1;
+        swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        if (g_GraphicsQueueFamilyIndex != g_PresentQueueFamilyIndex)
+        {
+            swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            swapchainCreateInfo.queueFamilyIndexCount = 2;
+            swapchainCreateInfo.pQueueFamilyIndices = queueFamilyIndices;
+        }
+        else
+        {
+            swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        swapchainCreateInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+        swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        swapchainCreateInfo.presentMode = g_PresentMode;
+        swapchainCreateInfo.clipped = true;
+        swapchainCreateInfo.oldSwapchain = oldSwapChain;
+
+        result = pfn_vkCreateSwapchainKHR( g_LogicalDevice,
+            &swapchainCreateInfo, NULL,	&g_SwapChain );
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("faied to create SwapChain.\n");
+            return false;
+        }
+
+        printInfoMsg("create SwapChain OK.\n");
+    }
+
+    //images
+    {
+        result = pfn_vkGetSwapchainImagesKHR( g_LogicalDevice,
+            g_SwapChain, &g_SwapChainImageCount, NULL );
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkGetSwapchainImagesKHR() (1).\n");
+            return false;
+        }
+
+        printInfoMsg("SwapChain image count %d\n", g_SwapChainImageCount);
+
+        if (g_SwapChainImageCount>1)
+        {
+            free(g_SwapChainImages);
+
+            g_SwapChainImages = (VkImage*) malloc(g_SwapChainImageCount * sizeof(VkImage));
+
+            if (g_SwapChainImages==NULL)
+            {
+                printErrorMsg("unable to allocate memory (14)\n");
+                return false;
+            }
+
+            // link the images to the swapchain
+            result = pfn_vkGetSwapchainImagesKHR(g_LogicalDevice,
+                g_SwapChain, &g_SwapChainImageCount, g_SwapChainImages);
+
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("vkGetSwapchainImagesKHR() (2).\n");
+                return false;
+            }
+        }
+        else
+        {
+            printErrorMsg("SwapChain image count less than 1.\n");
+            return false;
+        }
+
+        printInfoMsg("vkGetSwapchainImagesKHR() OK.\n");
+    }
+
+    return true;
+}
+
+/*
+==============================
+ createImageViews();
+==============================
+*/
+
+bool createImageViews()
+{
+    g_SwapChainImageViews = (VkImageView*) malloc(g_SwapChainImageCount * sizeof(VkImageView));
+
+    if (g_SwapChainImageViews==NULL)
+    {
+        printErrorMsg("unable to allocate memory (15)\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+    {
+
+        VkImageViewCreateInfo imageViewCreateInfo = {0};
+
+        imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCreateInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+        imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+        imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+        imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+        imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+        imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+        imageViewCreateInfo.subresourceRange.levelCount = 1;
+        imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+        imageViewCreateInfo.subresourceRange.layerCount = 1;
+        imageViewCreateInfo.image = g_SwapChainImages[i];
+
+        VkResult result = pfn_vkCreateImageView(g_LogicalDevice,
+            &imageViewCreateInfo, NULL, &g_SwapChainImageViews[i]);
+
+        if (result != VK_SUCCESS)
+        {
+            if (i>0)
+            {
+                for (uint32_t j = 0; j < i; ++j)
+                {
+                    pfn_vkDestroyImageView(g_LogicalDevice,
+                        g_SwapChainImageViews[j], NULL);
+                }
+            }
+
+            free(g_SwapChainImageViews);
+            g_SwapChainImageViews = NULL;
+            printErrorMsg("cannot create Image View (%d).\n",i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+==============================
+ chooseDepthFormat();
+==============================
+*/
+
+//first of the candidates usable as an optimal tiling depth attachment
+bool chooseDepthFormat()
+{
+    static const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+        VK_FORMAT_D16_UNORM
+    };
+
+    for (uint32_t i = 0; i < sizeof candidates / sizeof candidates[0]; ++i)
+    {
+        VkFormatProperties formatProperties = {0};
+
+        pfn_vkGetPhysicalDeviceFormatProperties(g_SelectedPhysicalDevice, candidates[i], &formatProperties);
+
+        if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            g_DepthFormat = candidates[i];
+            return true;
+        }
+    }
+
+    printErrorMsg("no supported depth format.\n");
+    return false;
+}
+
+/*
+==============================
+ chooseMsaaSamples();
+==============================
+*/
+
+//the requested count, or the highest one below it the device supports for both color and depth
+void chooseMsaaSamples()
+{
+    VkSampleCountFlags supported =
+        g_PhysicalDeviceProperties.limits.framebufferColorSampleCounts &
+        g_PhysicalDeviceProperties.limits.framebufferDepthSampleCounts;
+
+    VkSampleCountFlagBits samples = g_MsaaSamples;
+
+    while (samples > VK_SAMPLE_COUNT_1_BIT && !(supported & samples))
+    {
+        samples = (VkSampleCountFlagBits)(samples >> 1);
+    }
+
+    if (samples != g_MsaaSamples)
+    {
+        printWarningMsg("%dx msaa is not supported, using %dx.\n", g_MsaaSamples, samples);
+        g_MsaaSamples = samples;
+    }
+
+    printInfoMsg("msaa: %d samples.\n", g_MsaaSamples);
+}
+
+/*
+==============================
+ createTransientImage();
+==============================
+*/
+
+//attachment that lives only during the render pass, in lazily allocated memory where the device has it
+bool createTransientImage(const char *name, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+    VkImage *image, VkImageView *imageView, MemoryAllocation *memory)
+{
+    VkImageCreateInfo imageCreateInfo = {0};
+
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = format;
+    imageCreateInfo.extent.width = g_SwapChainExtent.width;
+    imageCreateInfo.extent.height = g_SwapChainExtent.height;
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = g_MsaaSamples;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkResult result = pfn_vkCreateImage(g_LogicalDevice, &imageCreateInfo, NULL, image);
+
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("%s image, vkCreateImage() (%d).\n", name, result);
+        return false;
+    }
+
+    //lazily allocated memory only exists on tilers, elsewhere the image is plain device local memory
+    VkMemoryRequirements memoryRequirements = {0};
+
+    pfn_vkGetImageMemoryRequirements(g_LogicalDevice, *image, &memoryRequirements);
+
+    VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    if (findMemoryType(memoryRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) >= 0)
+    {
+        memoryProperties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+
+    if (!allocateImageMemory(*image, memoryProperties, memory))
+    {
+        printErrorMsg("%s image, unable to allocate memory.\n", name);
+        return false;
+    }
+
+    VkImageViewCreateInfo imageViewCreateInfo = {0};
+
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.subresourceRange.aspectMask = aspect;
+    imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+    imageViewCreateInfo.subresourceRange.levelCount = 1;
+    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+    imageViewCreateInfo.subresourceRange.layerCount = 1;
+    imageViewCreateInfo.image = *image;
+
+    result = pfn_vkCreateImageView(g_LogicalDevice, &imageViewCreateInfo, NULL, imageView);
+
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("%s image, vkCreateImageView() (%d).\n", name, result);
+        return false;
+    }
+
+    printInfoMsg("%s image OK, format %d, %dx msaa, %s memory.\n", name, format, g_MsaaSamples,
+        (memoryProperties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ? "lazily allocated" : "device local");
+
+    return true;
+}
+
+/*
+==============================
+ createRenderTargets();
+==============================
+*/
+
+//depth buffer and, with --msaa, the multisampled color buffer resolved into the swapchain image;
+//sized by the swapchain extent, rebuilt with the framebuffers
+bool createRenderTargets()
+{
+    if (!createTransientImage("depth", g_DepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            VK_IMAGE_ASPECT_DEPTH_BIT, &g_DepthImage, &g_DepthImageView, &g_DepthImageMemory))
+        return false;
+
+    if (g_MsaaSamples == VK_SAMPLE_COUNT_1_BIT) return true;
+
+    return createTransientImage("msaa color", g_SurfaceFormat.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT, &g_MsaaColorImage, &g_MsaaColorImageView, &g_MsaaColorImageMemory);
+}
+
+/*
+==============================
+ createFrameBuffers();
+==============================
+*/
+
+bool createFrameBuffers()
+{
+    if (!createRenderTargets()) return false;
+
+    //color, depth and with --msaa the swapchain image the color is resolved into
+    VkImageView frameBufferAttachments[3] = {0};
+
+    VkFramebufferCreateInfo framebufferCreateInfo = {0};
+
+    framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferCreateInfo.renderPass = g_RenderPass;
+    framebufferCreateInfo.attachmentCount = g_MsaaSamples == VK_SAMPLE_COUNT_1_BIT ? 2 : 3;
+    framebufferCreateInfo.pAttachments = frameBufferAttachments;
+    framebufferCreateInfo.width = g_SwapChainExtent.width;
+    framebufferCreateInfo.height = g_SwapChainExtent.height;
+    framebufferCreateInfo.layers = 1;
+
+    g_FrameBuffers =
+        (VkFramebuffer*) malloc(g_SwapChainImageCount * sizeof(VkFramebuffer));
+
+    if (g_FrameBuffers==NULL)
+    {
+        printErrorMsg("unable to allocate memory (16)\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+    {
+        g_FrameBuffers[i] = NULL;
+    }
+
+    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+    {
+        if (g_MsaaSamples == VK_SAMPLE_COUNT_1_BIT)
+        {
+            frameBufferAttachments[0] = g_SwapChainImageViews[i];
+        }
+        else
+        {
+            frameBufferAttachments[0] = g_MsaaColorImageView;
+            frameBufferAttachments[2] = g_SwapChainImageViews[i];
+        }
+
+        frameBufferAttachments[1] = g_DepthImageView;
+
+        VkResult result = pfn_vkCreateFramebuffer(g_LogicalDevice,
+            &framebufferCreateInfo, NULL, &g_FrameBuffers[i]);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("failed to create framebuffer (%d).\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+==============================
+ allocateImageFences();
+==============================
+*/
+
+bool allocateImageFences()
+{
+    g_ImagesInFlight = calloc(g_SwapChainImageCount, sizeof(VkFence));
+
+    if(!g_ImagesInFlight)
+    {
+        printErrorMsg("unable to allocate memory (27).\n");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+==============================
+ recordDraws();
+==============================
+*/
+
+//state and draws of a slice of the draw list, inline in the primary or in a secondary
+void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount)
+{
+    pfn_vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_Pipeline);
+
+    VkViewport viewport = {0};
+    viewport.width = g_SwapChainExtent.width;
+    viewport.height = g_SwapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D rectangle = { {0, 0}, g_SwapChainExtent };
+
+    pfn_vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    pfn_vkCmdSetScissor(commandBuffer, 0, 1, &rectangle);
+
+    uint32_t dynamicOffset = frame * g_UniformRingStride;
+
+    pfn_vkCmdBindDescriptorSets(commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS, g_PipelineLayout, 0, 1, g_DescriptorSets, 1, &dynamicOffset);
+
+    VkBuffer vertexBuffers[] = {g_VertexBuffer, g_InstanceBuffer};
+
+    VkDeviceSize offsets[] = {0, 0};
+
+    pfn_vkCmdBindVertexBuffers( commandBuffer, 0, 2, vertexBuffers, offsets );
+
+    pfn_vkCmdBindIndexBuffer( commandBuffer, g_IndexBuffer, 0, g_IndexType);
+
+    if (g_IndirectDraws)
+    {
+        //one call per slice, split only by the device limits
+        uint32_t maxDraws = g_MultiDrawIndirect ? g_PhysicalDeviceProperties.limits.maxDrawIndirectCount : 1;
+        VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+        VkDeviceSize offset = ((VkDeviceSize)frame * g_DrawCount + firstDraw) * stride;
+        VkBuffer buffer = g_GpuCulling ? g_CullOutputBuffer : g_IndirectBuffer;
+
+        if (g_GpuCulling && g_CullCompact)
+        {
+            pfn_vkCmdDrawIndexedIndirectCountKHR(commandBuffer, buffer, offset,
+                g_CullCountBuffer, frame * sizeof(uint32_t), drawCount, stride);
+            return;
+        }
+
+        for (uint32_t d = 0; d < drawCount; )
+        {
+            uint32_t count = drawCount - d < maxDraws ? drawCount - d : maxDraws;
+
+            pfn_vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset + d * stride, count, stride);
+
+            d += count;
+        }
+
+        return;
+    }
+
+    for (uint32_t d = firstDraw; d < firstDraw + drawCount; ++d)
+    {
+        const VkDrawIndexedIndirectCommand *draw = &g_Draws[d];
+
+        pfn_vkCmdDrawIndexed(commandBuffer, draw->indexCount, draw->instanceCount,
+            draw->firstIndex, draw->vertexOffset, draw->firstInstance);
+    }
+}
+
+/*
+==============================
+ writeDrawCommands();
+==============================
+*/
+
+//the frame's region of the indirect buffer is free once its fence is signaled
+void writeDrawCommands(uint32_t frame)
+{
+    if (!g_IndirectDraws) return;
+
+    memcpy(g_IndirectBufferMemory.mapped + (size_t)frame * g_DrawCount * sizeof(VkDrawIndexedIndirectCommand),
+        g_Draws, g_DrawCount * sizeof(VkDrawIndexedIndirectCommand));
+}
+
+/*
+==============================
+ recordSliceJob();
+==============================
+*/
+
+//runs on a worker, the slice's command pool is used by this job only
+void recordSliceJob(void *data)
+{
+    RecordJob *job = data;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {0};
+
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = g_RenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = g_FrameBuffers[job->imageIndex];
+
+    VkCommandBufferBeginInfo beginInfo = {0};
+
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                      VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    pfn_vkBeginCommandBuffer(job->commandBuffer, &beginInfo);
+
+    recordDraws(job->commandBuffer, job->frame, job->firstDraw, job->drawCount);
+
+    pfn_vkEndCommandBuffer(job->commandBuffer);
+}
+
+/*
+==============================
+ resetFrameCommandPools();
+==============================
+*/
+
+void resetFrameCommandPools(uint32_t frame)
+{
+    pfn_vkResetCommandPool(g_LogicalDevice, g_FrameCommandPools[frame], 0);
+
+    for (uint32_t s = 0; s < g_RecordSliceCapacity; ++s)
+        pfn_vkResetCommandPool(g_LogicalDevice, g_RecordCommandPools[frame][s], 0);
+}
+
+/*
+==============================
+ recordFrame();
+==============================
+*/
+
+//records the draws of this frame into the frame's command buffer, its pools were reset already
+//with slices > 0 the draw list is split and recorded into secondaries by the worker pool
+void recordFrame(uint32_t frame, uint32_t imageIndex, uint32_t slices)
+{
+    VkCommandBuffer commandBuffer = g_FrameCommandBuffers[frame];
+
+    if (slices > g_DrawCount) slices = g_DrawCount;
+
+    //the compacted draws are only known to the GPU, one count draw covers them all
+    if (g_GpuCulling && g_CullCompact) slices = 0;
+
+    //secondaries first, the workers record while the primary is started
+    uint32_t drawsPerSlice = slices ? (g_DrawCount + slices - 1) / slices : 0;
+    uint32_t secondaryCount = 0;
+    VkCommandBuffer secondaries[MAX_RECORD_SLICES];
+
+    for (uint32_t s = 0; s < slices; ++s)
+    {
+        RecordJob *job = &g_RecordJobs[s];
+
+        job->frame = frame;
+        job->imageIndex = imageIndex;
+        job->firstDraw = s * drawsPerSlice;
+        job->drawCount = job->firstDraw + drawsPerSlice > g_DrawCount ? g_DrawCount - job->firstDraw : drawsPerSlice;
+        job->commandBuffer = g_RecordCommandBuffers[frame][s];
+
+        if (!job->drawCount) break;
+
+        //a full queue records on this thread instead
+        if (!submitJob(recordSliceJob, job, &g_RecordJobCounter)) recordSliceJob(job);
+
+        secondaries[secondaryCount++] = job->commandBuffer;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {0};
+
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    pfn_vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    if (g_TimestampQueryPool)
+    {
+        pfn_vkCmdResetQueryPool(commandBuffer, g_TimestampQueryPool,
+            frame * TIMESTAMP_QUERIES_PER_FRAME, TIMESTAMP_QUERIES_PER_FRAME);
+
+        pfn_vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            g_TimestampQueryPool, frame * TIMESTAMP_QUERIES_PER_FRAME);
+    }
+
+    if (g_GpuCulling) recordCulling(commandBuffer, frame);
+
+    VkClearValue clearValue[] = {
+        {.color = {.float32 = {0.0f,0.5f,0.5f,1.0f}}},
+        {.depthStencil = {.depth = 1.0,.stencil = 0}}
+    };
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {0};
+
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = g_RenderPass;
+    renderPassBeginInfo.framebuffer = g_FrameBuffers[imageIndex];
+
+    VkOffset2D offset = { 0, 0 };
+    VkRect2D rectangle = { offset, g_SwapChainExtent };
+    renderPassBeginInfo.renderArea = rectangle;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = clearValue;
+
+    if (secondaryCount)
+    {
+        pfn_vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        waitJobs(&g_RecordJobCounter);
+
+        pfn_vkCmdExecuteCommands(commandBuffer, secondaryCount, secondaries);
+    }
+    else
+    {
+        pfn_vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        recordDraws(commandBuffer, frame, 0, g_DrawCount);
+    }
+
+    pfn_vkCmdEndRenderPass(commandBuffer);
+
+    if (g_TimestampQueryPool)
+    {
+        pfn_vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            g_TimestampQueryPool, frame * TIMESTAMP_QUERIES_PER_FRAME + 1);
+    }
+
+    pfn_vkEndCommandBuffer(commandBuffer);
+
+    g_FramePipelines[frame] = g_Pipeline;
+}
+
+/*
+==============================
+ destroyRetiredPipelines();
+==============================
+*/
+
+//a pipeline no frame in flight was recorded with anymore, its last submission has finished
+void destroyRetiredPipelines()
+{
+    for (uint32_t r = 0; r < g_RetiredPipelineCount; )
+    {
+        bool used = false;
+
+        for (uint32_t i = 0; i < g_FramesInFlight; ++i)
+            if (g_FramePipelines[i] == g_RetiredPipelines[r]) used = true;
+
+        if (used)
+        {
+            ++r;
+            continue;
+        }
+
+        pfn_vkDestroyPipeline(g_LogicalDevice, g_RetiredPipelines[r], NULL);
+        printInfoMsg("vkDestroyPipeline(), retired pipeline\n");
+
+        g_RetiredPipelines[r] = g_RetiredPipelines[--g_RetiredPipelineCount];
+    }
+}
+
+/*
+==============================
+ recreateSwapChain();
+==============================
+*/
+
+bool recreateSwapChain()
+{
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {0};
+
+    VkResult result = pfn_vkGetPhysicalDeviceSurfaceCapabilitiesKHR(g_SelectedPhysicalDevice,
+        g_Surface, &surfaceCapabilities );
+
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("vkGetPhysicalDeviceSurfaceCapabilitiesKHR().\n");
+        return false;
+    }
+
+    //minimized, nothing to render into, try again on the next resize
+    if (surfaceCapabilities.currentExtent.width == 0 || surfaceCapabilities.currentExtent.height == 0)
+    {
+        g_SwapChainOutOfDate = true;
+        return true;
+    }
+
+    pfn_vkDeviceWaitIdle(g_LogicalDevice);
+
+    //every frame is finished, collect its timestamps before the queries are reused
+    for (uint32_t i = 0; i < g_FramesInFlight; ++i) readGpuTimestamps(i);
+
+    uint32_t oldImageCount = g_SwapChainImageCount;
+    VkSwapchainKHR oldSwapChain = g_SwapChain;
+
+    destroySwapChainResources();
+
+    g_SwapChain = NULL;
+
+    bool created = createSwapChain(oldSwapChain);
+
+    pfn_vkDestroySwapchainKHR(g_LogicalDevice, oldSwapChain, NULL);
+
+    if (!created) return false;
+
+    //command buffers, uniform ring slots and queries are per frame in flight,
+    //only the image fences follow the image count
+    if (g_SwapChainImageCount != oldImageCount)
+    {
+        printInfoMsg("swapchain image count changed (%u -> %u).\n", oldImageCount, g_SwapChainImageCount);
+
+        free(g_ImagesInFlight);
+        g_ImagesInFlight = NULL;
+
+        if (!allocateImageFences()) return false;
+    }
+
+    if (!createImageViews()) return false;
+
+    if (!createFrameBuffers()) return false;
+
+    for (uint32_t i = 0; i < g_SwapChainImageCount; ++i) g_ImagesInFlight[i] = NULL;
+
+    g_Width = g_SwapChainExtent.width;
+    g_Height = g_SwapChainExtent.height;
+
+    g_SwapChainDirty = false;
+    g_SwapChainOutOfDate = false;
+
+    printInfoMsg("swapchain recreated %ux%u.\n", g_SwapChainExtent.width, g_SwapChainExtent.height);
+
+    return true;
+}
+
+/*
+==============================
+ writeUniforms();
+==============================
+*/
+
+//the caller makes sure the GPU is no longer reading the slot
+void writeUniforms(uint32_t slot)
+{
+    char *pMem = g_UniformRingMapped + slot * g_UniformRingStride;
+
+    memcpy(pMem, modelMatrix, sizeof modelMatrix);
+    memcpy(pMem + sizeof modelMatrix, viewMatrix, sizeof viewMatrix);
+    memcpy(pMem + sizeof modelMatrix + sizeof viewMatrix, projectionMatrix, sizeof projectionMatrix);
+}
+
+/*
+==============================
+ hashData();
+==============================
+*/
+
+//FNV-1a, 64 bit
+uint64_t hashData(const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/*
+==============================
+ findShaderModule();
+==============================
+*/
+
+//g_ShaderModuleMutex must be held
+ShaderModuleEntry *findShaderModule(uint64_t hash, const uint32_t *code, size_t size)
+{
+    for (uint32_t i = 0; i < g_ShaderModuleCount; ++i)
+    {
+        if (g_ShaderModules[i].hash == hash && g_ShaderModules[i].size == size &&
+            memcmp(g_ShaderModules[i].code, code, size) == 0)
+            return &g_ShaderModules[i];
+    }
+
+    return NULL;
+}
+
+/*
+==============================
+ loadShaderModule();
+==============================
+*/
+
+//maps shaders/<fileName> and hands the mapping to the driver, identical code yields the same module
+bool loadShaderModule(const char *fileName, VkShaderModule *module)
+{
+    char fullPath[256];
+
+    if (snprintf(fullPath, sizeof fullPath, "shaders/%s", fileName) >= (int)sizeof fullPath)
+    {
+        printErrorMsg("shader path too long %s\n", fileName);
+        return false;
+    }
+
+    int fd = open(fullPath, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printErrorMsg("cannot open file %s\n", fileName);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+    {
+        printErrorMsg("%s fstat(), %s.\n", fileName, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = st.st_size;
+
+    printInfoMsg("%s size: %zu\n", fileName, fileSize);
+
+    //SPIR-V is a stream of 32 bit words, at least the 5 word header
+    if (fileSize < 5 * sizeof(uint32_t) || fileSize % sizeof(uint32_t))
+    {
+        printErrorMsg("%s is not SPIR-V, size %zu.\n", fileName, fileSize);
+        close(fd);
+        return false;
+    }
+
+    //the mapping is page aligned, which covers the 4 byte alignment pCode requires
+    const uint32_t *code = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (code == MAP_FAILED)
+    {
+        printErrorMsg("%s mmap(), %s.\n", fileName, strerror(errno));
+        return false;
+    }
+
+    if (code[0] != SPIRV_MAGIC)
+    {
+        if (code[0] == SPIRV_MAGIC_SWAPPED)
+            printErrorMsg("%s is SPIR-V of the wrong endianness.\n", fileName);
+        else
+            printErrorMsg("%s bad SPIR-V magic 0x%08x.\n", fileName, code[0]);
+
+        munmap((void*)code, fileSize);
+        return false;
+    }
+
+    uint64_t hash = hashData(code, fileSize);
+
+    pthread_mutex_lock(&g_ShaderModuleMutex);
+
+    ShaderModuleEntry *entry = findShaderModule(hash, code, fileSize);
+
+    if (entry)
+    {
+        entry->refCount++;
+        *module = entry->module;
+        g_ShaderModuleDedupCount++;
+    }
+
+    pthread_mutex_unlock(&g_ShaderModuleMutex);
+
+    if (entry)
+    {
+        munmap((void*)code, fileSize);
+        printInfoMsg("%s reuses shader module %016llx.\n", fileName, (unsigned long long)hash);
+        return true;
+    }
+
+    //created unlocked so modules build in parallel, a racing duplicate is resolved below
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {0};
+
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = fileSize;
+    shaderModuleCreateInfo.pCode = code;
+
+    VkShaderModule newModule = VK_NULL_HANDLE;
+
+    VkResult result = pfn_vkCreateShaderModule(g_LogicalDevice,
+        &shaderModuleCreateInfo,NULL,&newModule);
+
+    if (result != VK_SUCCESS)
+    {
+        munmap((void*)code, fileSize);
+        printErrorMsg("failed to create shader module %s.\n", fileName);
+        return false;
+    }
+
+    uint32_t *codeCopy = malloc(fileSize);
+
+    if (!codeCopy)
+    {
+        munmap((void*)code, fileSize);
+        pfn_vkDestroyShaderModule(g_LogicalDevice, newModule, NULL);
+        printErrorMsg("unable to allocate memory (35).\n");
+        return false;
+    }
+
+    memcpy(codeCopy, code, fileSize);
+
+    pthread_mutex_lock(&g_ShaderModuleMutex);
+
+    entry = findShaderModule(hash, code, fileSize);
+
+    if (entry)
+    {
+        entry->refCount++;
+        g_ShaderModuleDedupCount++;
+    }
+    else if (g_ShaderModuleCount < MAX_SHADER_MODULES)
+    {
+        entry = &g_ShaderModules[g_ShaderModuleCount++];
+
+        entry->hash = hash;
+        entry->size = fileSize;
+        entry->code = codeCopy;
+        entry->module = newModule;
+        entry->refCount = 1;
+        newModule = VK_NULL_HANDLE;
+        codeCopy = NULL;
+    }
+
+    if (entry) *module = entry->module;
+
+    pthread_mutex_unlock(&g_ShaderModuleMutex);
+
+    munmap((void*)code, fileSize);
+    free(codeCopy);
+
+    //lost the race, or the table is full
+    if (newModule && entry)
+    {
+        pfn_vkDestroyShaderModule(g_LogicalDevice, newModule, NULL);
+    }
+    else if (!entry)
+    {
+        pfn_vkDestroyShaderModule(g_LogicalDevice, newModule, NULL);
+        printErrorMsg("shader module table is full (%d).\n", MAX_SHADER_MODULES);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+==============================
+ releaseShaderModule();
+==============================
+*/
+
+void releaseShaderModule(VkShaderModule module)
+{
+    pthread_mutex_lock(&g_ShaderModuleMutex);
+
+    for (uint32_t i = 0; i < g_ShaderModuleCount; ++i)
+    {
+        if (g_ShaderModules[i].module != module) continue;
+
+        if (--g_ShaderModules[i].refCount == 0)
+        {
+            pfn_vkDestroyShaderModule(g_LogicalDevice, module, NULL);
+            free(g_ShaderModules[i].code);
+            g_ShaderModules[i] = g_ShaderModules[--g_ShaderModuleCount];
+        }
+
+        break;
+    }
+
+    pthread_mutex_unlock(&g_ShaderModuleMutex);
+}
+
+/*
+==============================
+ shaderModuleJob();
+==============================
+*/
+
+void shaderModuleJob(void *data)
+{
+    ShaderModuleJob *job = data;
+    uint64_t timeStart = getTimeNs();
+
+    job->ok = loadShaderModule(job->fileName, job->module);
+
+    if (job->ok)
+        printInfoMsg("load shader %s OK, %.3f ms.\n", job->fileName, (getTimeNs() - timeStart) * 1e-6);
+}
+
+/*
+==============================
+ createGraphicsPipeline();
+==============================
+*/
+
+//called from a worker thread, g_PipelineCache is internally synchronized
+bool createGraphicsPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, VkPipeline *pipeline)
+{
+    VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {0};
+
+    vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertexShaderStageInfo.module = vertShaderModule;
+    vertexShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo fragmentShaderStageInfo = {0};
+
+    fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragmentShaderStageInfo.module = fragShaderModule;
+    fragmentShaderStageInfo.pName = "main";
+
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {vertexShaderStageInfo, fragmentShaderStageInfo};
+
+    const MeshVertexLayout *vertexLayout = &meshVertexLayouts[g_VertexFormat];
+
+    VkVertexInputBindingDescription vertexInputBindingDescriptions[2] = {0};
+
+    vertexInputBindingDescriptions[0].binding = 0;
+    vertexInputBindingDescriptions[0].stride = vertexLayout->stride;
+    vertexInputBindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    vertexInputBindingDescriptions[1].binding = 1;
+    vertexInputBindingDescriptions[1].stride = sizeof(InstanceData);
+    vertexInputBindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    VkVertexInputAttributeDescription vertexInputAttributeDescriptions[5]={0};
+
+    vertexInputAttributeDescriptions[0].location = 0;
+    vertexInputAttributeDescriptions[0].binding = 0;
+    vertexInputAttributeDescriptions[0].format = g_VertexPositionFormats[g_VertexFormat];
+    vertexInputAttributeDescriptions[0].offset = 0;
+
+    vertexInputAttributeDescriptions[1].location = 1;
+    vertexInputAttributeDescriptions[1].binding = 0;
+    vertexInputAttributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    vertexInputAttributeDescriptions[1].offset = vertexLayout->colorOffset;
+
+    vertexInputAttributeDescriptions[2].location = 2;
+    vertexInputAttributeDescriptions[2].binding = 1;
+    vertexInputAttributeDescriptions[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    vertexInputAttributeDescriptions[2].offset = offsetof( InstanceData, x );
+
+    vertexInputAttributeDescriptions[3].location = 3;
+    vertexInputAttributeDescriptions[3].binding = 1;
+    vertexInputAttributeDescriptions[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    vertexInputAttributeDescriptions[3].offset = offsetof( InstanceData, r );
+
+    vertexInputAttributeDescriptions[4].location = 4;
+    vertexInputAttributeDescriptions[4].binding = 0;
+    vertexInputAttributeDescriptions[4].format = VK_FORMAT_R16G16_SNORM;
+    vertexInputAttributeDescriptions[4].offset = vertexLayout->normalOffset;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {0};
+
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount = 2;
+    vertexInputStateCreateInfo.pVertexBindingDescriptions = vertexInputBindingDescriptions;
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = 5;
+    vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescriptions;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {0};
+
+    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    //viewport and scissor are set in the command buffer, the pipeline survives a resize
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {0};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.pViewports = NULL;
+    viewportStateCreateInfo.scissorCount = 1;
+    viewportStateCreateInfo.pScissors = NULL;
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {0};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = sizeof dynamicStates / sizeof dynamicStates[0];
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {0};
+
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.depthClampEnable = VK_FALSE;
+    rasterizationStateCreateInfo.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizationStateCreateInfo.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {0};
+
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;
+    multisampleStateCreateInfo.rasterizationSamples = g_MsaaSamples;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {0};
+
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
+    depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {0};
+    colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+                                        | VK_COLOR_COMPONENT_G_BIT
+                                        | VK_COLOR_COMPONENT_B_BIT
+                                        | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentState.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {0};
+
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.logicOpEnable = VK_FALSE;
+    colorBlendStateCreateInfo.logicOp = VK_LOGIC_OP_COPY;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+    colorBlendStateCreateInfo.blendConstants[0] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[1] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[2] = 0.0f;
+    colorBlendStateCreateInfo.blendConstants[3] = 0.0f;
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {0};
+
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 2;
+    pipelineCreateInfo.pStages = shaderStages;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.layout = g_PipelineLayout;
+    pipelineCreateInfo.renderPass = g_RenderPass;
+    pipelineCreateInfo.subpass = 0;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    uint64_t timePipelineStart = getTimeNs();
+
+    VkResult result = pfn_vkCreateGraphicsPipelines(g_LogicalDevice,
+                        g_PipelineCache,1,&pipelineCreateInfo,NULL,pipeline);
+
+    if (result != VK_SUCCESS)
+    {
+        printErrorMsg("vkCreateGraphicsPipelines.\n");
+        return false;
+    }
+
+    printInfoMsg("vkCreatePipeline() OK, %.3f ms, %s.\n", (getTimeNs() - timePipelineStart) * 1e-6,
+        g_PipelineCacheWarm ? "warm cache" : "cold cache");
+
+    return true;
+}
+
+/*
+==============================
+ graphicsPipelineJob();
+==============================
+*/
+
+void graphicsPipelineJob(void *data)
+{
+    PipelineJob *job = data;
+
+    //the shader jobs were submitted first, they are running or done already
+    waitJobs(job->shaders);
+
+    for (uint32_t i = 0; i < sizeof g_ShaderModuleJobs / sizeof g_ShaderModuleJobs[0]; ++i)
+    {
+        if (!g_ShaderModuleJobs[i].ok)
+        {
+            job->ok = false;
+            return;
+        }
+    }
+
+    job->ok = createGraphicsPipeline(g_vertShaderModule, g_fragShaderModule, job->pipeline);
+}
+
+/*
+==============================
+ shaderReloadJob();
+==============================
+*/
+
+//builds the modules and pipeline of the edited shaders, the render loop keeps the old ones meanwhile
+void shaderReloadJob(void *data)
+{
+    ShaderReloadJob *job = data;
+    uint64_t timeStart = getTimeNs();
+
+    job->vertShaderModule = VK_NULL_HANDLE;
+    job->fragShaderModule = VK_NULL_HANDLE;
+    job->pipeline = VK_NULL_HANDLE;
+
+    job->ok = loadShaderModule(vertexShaderFileName, &job->vertShaderModule) &&
+              loadShaderModule(fragmentShaderFileName, &job->fragShaderModule) &&
+              createGraphicsPipeline(job->vertShaderModule, job->fragShaderModule, &job->pipeline);
+
+    if (!job->ok)
+    {
+        if (job->vertShaderModule) releaseShaderModule(job->vertShaderModule);
+        if (job->fragShaderModule) releaseShaderModule(job->fragShaderModule);
+        return;
+    }
+
+    printInfoMsg("shaders rebuilt, %.3f ms.\n", (getTimeNs() - timeStart) * 1e-6);
+}
+
+/*
+==============================
+ shaderReloadThread();
+==============================
+*/
+
+//g_ShaderReloadCounter is done when the thread is about to exit, so the join never waits long
+void *shaderReloadThread(void *arg)
+{
+    shaderReloadJob(arg);
+
+    pthread_mutex_lock(&g_JobMutex);
+    g_ShaderReloadCounter.remaining = 0;
+    pthread_mutex_unlock(&g_JobMutex);
+
+    return NULL;
+}
+
+/*
+==============================
+ initShaderWatch();
+==============================
+*/
+
+bool initShaderWatch()
+{
+    g_ShaderWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (g_ShaderWatchFd < 0)
+    {
+        printWarningMsg("inotify_init1(), %s, shader hot reload is off.\n", strerror(errno));
+        return false;
+    }
+
+    //compilers either rewrite the file in place or rename a temporary over it
+    if (inotify_add_watch(g_ShaderWatchFd, "shaders", IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        printWarningMsg("inotify_add_watch(shaders), %s, shader hot reload is off.\n", strerror(errno));
+        close(g_ShaderWatchFd);
+        g_ShaderWatchFd = -1;
+        return false;
+    }
+
+    printInfoMsg("watching shaders/ for changes.\n");
+
+    return true;
+}
+
+/*
+==============================
+ pollShaderWatch();
+==============================
+*/
+
+//called between frames, never blocks
+void pollShaderWatch()
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+
+    while ((length = read(g_ShaderWatchFd, buffer, sizeof buffer)) > 0)
+    {
+        for (char *ptr = buffer; ptr < buffer + length; )
+        {
+            const struct inotify_event *event = (const struct inotify_event*)ptr;
+
+            if (event->len && (!strcmp(event->name, vertexShaderFileName) ||
+                               !strcmp(event->name, fragmentShaderFileName)))
+            {
+                printInfoMsg("shader changed: %s\n", event->name);
+
+                g_ShaderChangePending = true;
+                g_ShaderChangeTime = getTimeNs();
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    //a build may touch both files, start once the writes settle
+    if (g_ShaderChangePending && !g_ShaderReloadRunning &&
+        getTimeNs() - g_ShaderChangeTime >= SHADER_RELOAD_SETTLE_TIME_NS)
+    {
+        g_ShaderChangePending = false;
+
+        pthread_mutex_lock(&g_JobMutex);
+        g_ShaderReloadCounter.remaining = 1;
+        pthread_mutex_unlock(&g_JobMutex);
+
+        if (pthread_create(&g_ShaderReloadThread, NULL, shaderReloadThread, &g_ShaderReloadJob) != 0)
+        {
+            printWarningMsg("pthread_create(), shader reload.\n");
+
+            pthread_mutex_lock(&g_JobMutex);
+            g_ShaderReloadCounter.remaining = 0;
+            pthread_mutex_unlock(&g_JobMutex);
+            return;
+        }
+
+        g_ShaderReloadRunning = true;
+    }
+
+    if (!g_ShaderReloadRunning || !jobsDone(&g_ShaderReloadCounter)) return;
+
+    //every retired pipeline is still recorded somewhere, swap on a later frame
+    if (g_ShaderReloadJob.ok && g_RetiredPipelineCount == MAX_RETIRED_PIPELINES) return;
+
+    pthread_join(g_ShaderReloadThread, NULL);
+
+    g_ShaderReloadRunning = false;
+
+    if (!g_ShaderReloadJob.ok)
+    {
+        printWarningMsg("shader reload failed, keeping the current pipeline.\n");
+        return;
+    }
+
+    //frames in flight still use the old pipeline, it is destroyed once they have finished
+    g_RetiredPipelines[g_RetiredPipelineCount++] = g_Pipeline;
+    g_Pipeline = g_ShaderReloadJob.pipeline;
+    g_ShaderReloadJob.pipeline = VK_NULL_HANDLE;
+
+    //the new pipeline no longer needs the old modules
+    releaseShaderModule(g_vertShaderModule);
+    releaseShaderModule(g_fragShaderModule);
+
+    g_vertShaderModule = g_ShaderReloadJob.vertShaderModule;
+    g_fragShaderModule = g_ShaderReloadJob.fragShaderModule;
+
+    printInfoMsg("pipeline swapped.\n");
+}
+
+/*
+==============================
+ recordBenchmark();
+==============================
+*/
+
+//records frame 0 over and over with 0 (inline) to g_RecordSliceCapacity slices, nothing is submitted
+void recordBenchmark()
+{
+    double inlineTime = 0.0;
+    double oneSliceTime = 0.0;
+
+    printInfoMsg("record benchmark: %u draws, %u iterations\n", g_DrawCount, g_RecordBenchIterations);
+    printInfoMsg("%8s %12s %10s\n", "threads", "ms/frame", "speedup");
+
+    for (uint32_t slices = 0; slices <= g_RecordSliceCapacity; ++slices)
+    {
+        uint64_t timeStart = getTimeNs();
+
+        for (uint32_t i = 0; i < g_RecordBenchIterations; ++i)
+        {
+            resetFrameCommandPools(0);
+            recordFrame(0, 0, slices);
+        }
+
+        double time = (getTimeNs() - timeStart) * 1e-6 / g_RecordBenchIterations;
+
+        if (slices == 0) inlineTime = time;
+        if (slices == 1) oneSliceTime = time;
+
+        if (slices == 0)
+            printInfoMsg("%8s %12.4f %10s\n", "inline", time, "-");
+        else
+            printInfoMsg("%8u %12.4f %9.2fx\n", slices, time, oneSliceTime / time);
+    }
+
+    printInfoMsg("inline vs 1 thread: %.2fx\n", inlineTime > 0.0 ? oneSliceTime / inlineTime : 0.0);
+
+    resetFrameCommandPools(0);
+}
+
+/*
+==============================
+ updateData();
+==============================
+*/
+
+void updateData()
+{
+
+    float aspectRatio = (float) g_Width / (float) g_Height;
+    float nearZ  = 0.1f;
+	float farZ   = 1000.0f;
+    float fieldOfView = 45.0f;
+
+    projectionMatrix[0][0]= 1.0f / (aspectRatio * (float) tanf(fieldOfView / 2.0f * TORAD));
+    projectionMatrix[0][1]=0;
+    projectionMatrix[0][2]=0;
+    projectionMatrix[0][3]=0;
+    projectionMatrix[1][0]=0;
+    projectionMatrix[1][1]= 1.0f / (float) tanf(fieldOfView / 2.0f * TORAD);
+    projectionMatrix[1][2]=0;
+    projectionMatrix[1][3]=0;
+    projectionMatrix[2][0]=0;
+    projectionMatrix[2][1]=0;
+    projectionMatrix[2][2]= (-nearZ - farZ ) / (nearZ - farZ);
+    projectionMatrix[2][3]= 1.0f;
+    projectionMatrix[3][0]=0;
+    projectionMatrix[3][1]=0;
+    projectionMatrix[3][2]= 2.0f * nearZ * farZ / (nearZ - farZ);
+    projectionMatrix[3][3]=0;
+
+    static float vx = 0.0f;
+    static float vy = 0.0f;
+    static float vz = 1.0f;
+
+    viewMatrix[3][0] = vx;
+    viewMatrix[3][1] = vy;
+    viewMatrix[3][2] = vz;
+
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 1.0f;
+
+    modelMatrix[3][0] = x;
+    modelMatrix[3][1] = y;
+    modelMatrix[3][2] = z;
+
+}
+
+/*
+==============================
+ objectPosition();
+==============================
+*/
+
+//objects are laid out on a square grid around the origin, in model space
+void objectPosition(uint32_t object, float position[3])
+{
+    if (!g_PlaceObjects)
+    {
+        position[0] = position[1] = position[2] = 0.0f;
+        return;
+    }
+
+    uint32_t side = (uint32_t)ceilf(sqrtf((float)g_ObjectCount));
+
+    position[0] = ((float)(object % side) - (side - 1) * 0.5f) * OBJECT_SPACING;
+    position[1] = ((float)(object / side) - (side - 1) * 0.5f) * OBJECT_SPACING;
+    position[2] = 0.0f;
+}
+
+/*
+==============================
+ sortDrawsFrontToBack();
+==============================
+*/
+
+typedef struct DrawSortKey {
+    float distance;
+    uint32_t object;
+    VkDrawIndexedIndirectCommand draw;
+} DrawSortKey;
+
+int compareDrawSortKeys(const void *a, const void *b)
+{
+    const DrawSortKey *keyA = a;
+    const DrawSortKey *keyB = b;
+
+    if (keyA->distance != keyB->distance) return keyA->distance < keyB->distance ? -1 : 1;
+
+    return keyA->object < keyB->object ? -1 : (keyA->object > keyB->object);
+}
+
+//the camera doesn't move, so the order is computed once from the matrices of the first frame;
+//draws are sorted by the distance of their object to the eye, the instances of a draw keep their order
+bool sortDrawsFrontToBack()
+{
+    if (!g_PlaceObjects)
+    {
+        printWarningMsg("--sort, all objects are at the origin, the draw order is kept.\n");
+        return true;
+    }
+
+    DrawSortKey *keys = malloc(g_DrawCount * sizeof(DrawSortKey));
+
+    if (!keys)
+    {
+        printErrorMsg("unable to allocate memory (33).\n");
+        return false;
+    }
+
+    updateData();
+
+    mat4x4 viewModel;
+
+    mat4x4_mul(viewModel, viewMatrix, modelMatrix);
+
+    for (uint32_t i = 0; i < g_DrawCount; ++i)
+    {
+        float position[3];
+        float eye[3];
+
+        objectPosition(g_DrawObjects[i], position);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            eye[j] = viewModel[0][j] * position[0] + viewModel[1][j] * position[1] +
+                viewModel[2][j] * position[2] + viewModel[3][j];
+        }
+
+        keys[i].distance = sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+        keys[i].object = g_DrawObjects[i];
+        keys[i].draw = g_Draws[i];
+    }
+
+    qsort(keys, g_DrawCount, sizeof(DrawSortKey), compareDrawSortKeys);
+
+    for (uint32_t i = 0; i < g_DrawCount; ++i)
+    {
+        g_DrawObjects[i] = keys[i].object;
+        g_Draws[i] = keys[i].draw;
+    }
+
+    free(keys);
+
+    printInfoMsg("draws sorted front to back.\n");
+
+    return true;
+}
+
+/*
+==============================
+ createCulling();
+==============================
+*/
+
+//compute pipeline and buffers of --gpu-cull, g_IndirectBuffer is the source of the scene draws
+bool createCulling()
+{
+    VkDeviceSize drawRegionSize = (VkDeviceSize)g_DrawCount * sizeof(VkDrawIndexedIndirectCommand);
+
+    g_CullCompact = g_DrawIndirectCountSupported && !g_SortDraws;
+
+    if (g_DrawIndirectCountSupported && g_SortDraws)
+        printInfoMsg("--sort, culled draws are kept in place to preserve the front to back order.\n");
+
+    //bounds
+    {
+        float *bounds = malloc(g_DrawCount * 4 * sizeof(float));
+
+        if (!bounds)
+        {
+            printErrorMsg("unable to allocate memory (32).\n");
+            return false;
+        }
+
+        uint32_t side = (uint32_t)ceilf(sqrtf((float)g_InstanceCount));
+        float cell = 1.0f / side;
+
+        for (uint32_t i = 0; i < g_DrawCount; ++i)
+        {
+            const Mesh *mesh = &g_Meshes[g_DrawObjects[i] % g_MeshCount];
+
+            objectPosition(g_DrawObjects[i], &bounds[i * 4]);
+
+            //instance grid offsets and the scaled mesh
+            bounds[i * 4 + 3] = sqrtf(2.0f) * (0.5f - cell * 0.5f) + mesh->radius * cell;
+        }
+
+        VkBufferCreateInfo bufferCreateInfo = {0};
+
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCreateInfo.size = g_DrawCount * 4 * sizeof(float);
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice, &bufferCreateInfo, NULL, &g_CullBoundsBuffer);
+
+        bool ok = result == VK_SUCCESS &&
+            allocateBufferMemory(g_CullBoundsBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &g_CullBoundsMemory) &&
+            uploadData(bounds, g_DrawCount * 4 * sizeof(float), g_CullBoundsBuffer, 0,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT) &&
+            flushUploads();
+
+        free(bounds);
+
+        if (!ok)
+        {
+            printErrorMsg("culling bounds buffer.\n");
+            return false;
+        }
+    }
+
+    //visible draws, a region per frame in flight
+    {
+        VkBufferCreateInfo bufferCreateInfo = {0};
+
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        bufferCreateInfo.size = g_FramesInFlight * drawRegionSize;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice, &bufferCreateInfo, NULL, &g_CullOutputBuffer);
+
+        if (result != VK_SUCCESS ||
+            !allocateBufferMemory(g_CullOutputBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &g_CullOutputMemory))
+        {
+            printErrorMsg("culling output buffer.\n");
+            return false;
+        }
+    }
+
+    //visible counts, one per frame in flight, host visible for the statistics
+    {
+        VkBufferCreateInfo bufferCreateInfo = {0};
+
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferCreateInfo.size = g_FramesInFlight * sizeof(uint32_t);
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice, &bufferCreateInfo, NULL, &g_CullCountBuffer);
+
+        if (result != VK_SUCCESS ||
+            !allocateBufferMemory(g_CullCountBuffer,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &g_CullCountMemory))
+        {
+            printErrorMsg("culling count buffer.\n");
+            return false;
+        }
+    }
+
+    //descriptors
+    {
+        VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[4] = {0};
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            descriptorSetLayoutBindings[i].binding = i;
+            descriptorSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorSetLayoutBindings[i].descriptorCount = 1;
+            descriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+
+        descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCreateInfo.bindingCount = 4;
+        descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
+
+        VkResult result = pfn_vkCreateDescriptorSetLayout(g_LogicalDevice,
+            &descriptorSetLayoutCreateInfo, NULL, &g_CullDescriptorSetLayout);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkCreateDescriptorSetLayout(), culling.\n");
+            return false;
+        }
+
+        VkDescriptorPoolSize descriptorPoolSize = {0};
+
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = 4;
+
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.maxSets = 1;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+
+        result = pfn_vkCreateDescriptorPool(g_LogicalDevice, &descriptorPoolCreateInfo, NULL, &g_CullDescriptorPool);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkCreateDescriptorPool(), culling.\n");
+            return false;
+        }
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+
+        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocateInfo.descriptorPool = g_CullDescriptorPool;
+        descriptorSetAllocateInfo.descriptorSetCount = 1;
+        descriptorSetAllocateInfo.pSetLayouts = &g_CullDescriptorSetLayout;
+
+        result = pfn_vkAllocateDescriptorSets(g_LogicalDevice, &descriptorSetAllocateInfo, &g_CullDescriptorSet);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkAllocateDescriptorSets(), culling.\n");
+            return false;
+        }
+
+        VkBuffer buffers[4] = {g_CullBoundsBuffer, g_IndirectBuffer, g_CullOutputBuffer, g_CullCountBuffer};
+        VkDescriptorBufferInfo descriptorBufferInfos[4] = {0};
+        VkWriteDescriptorSet writeDescriptorSets[4] = {0};
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            descriptorBufferInfos[i].buffer = buffers[i];
+            descriptorBufferInfos[i].offset = 0;
+            descriptorBufferInfos[i].range = VK_WHOLE_SIZE;
+
+            writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[i].dstSet = g_CullDescriptorSet;
+            writeDescriptorSets[i].dstBinding = i;
+            writeDescriptorSets[i].descriptorCount = 1;
+            writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSets[i].pBufferInfo = &descriptorBufferInfos[i];
+        }
+
+        pfn_vkUpdateDescriptorSets(g_LogicalDevice, 4, writeDescriptorSets, 0, NULL);
+    }
+
+    //compute pipeline
+    {
+        VkPushConstantRange pushConstantRange = {0};
+
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(CullPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = &g_CullDescriptorSetLayout;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkResult result = pfn_vkCreatePipelineLayout(g_LogicalDevice,
+            &pipelineLayoutCreateInfo, NULL, &g_CullPipelineLayout);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkCreatePipelineLayout(), culling.\n");
+            return false;
+        }
+
+        if (!loadShaderModule(cullShaderFileName, &g_CullShaderModule)) return false;
+
+        VkComputePipelineCreateInfo computePipelineCreateInfo = {0};
+
+        computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computePipelineCreateInfo.stage.module = g_CullShaderModule;
+        computePipelineCreateInfo.stage.pName = "main";
+        computePipelineCreateInfo.layout = g_CullPipelineLayout;
+
+        result = pfn_vkCreateComputePipelines(g_LogicalDevice, g_PipelineCache, 1,
+            &computePipelineCreateInfo, NULL, &g_CullPipeline);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkCreateComputePipelines(), culling.\n");
+            return false;
+        }
+    }
+
+    printInfoMsg("gpu culling OK, %s.\n", g_CullCompact ?
+        "compacted, vkCmdDrawIndexedIndirectCountKHR" : "no draw count, culled draws have 0 instances");
+
+    return true;
+}
+
+/*
+==============================
+ chooseVertexFormat();
+==============================
+*/
+
+//the position format must be a vertex buffer format of the device, float always is,
+//a mesh file can't fall back, its vertices are uploaded as they are
+bool chooseVertexFormat()
+{
+    VkFormatProperties formatProperties = {0};
+
+    pfn_vkGetPhysicalDeviceFormatProperties(g_SelectedPhysicalDevice,
+        g_VertexPositionFormats[g_VertexFormat], &formatProperties);
+
+    if (!(formatProperties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT))
+    {
+        if (g_MeshFileData)
+        {
+            printErrorMsg("%s, %s vertex positions are not supported.\n", g_MeshFileName,
+                meshVertexLayouts[g_VertexFormat].name);
+            return false;
+        }
+
+        printWarningMsg("%s vertex positions are not supported, using float.\n", meshVertexLayouts[g_VertexFormat].name);
+        g_VertexFormat = MESH_VERTEX_FORMAT_FLOAT;
+    }
+
+    printInfoMsg("vertex format %s, %u bytes/vertex (%u unpacked).\n", meshVertexLayouts[g_VertexFormat].name,
+        meshVertexLayouts[g_VertexFormat].stride, (uint32_t)sizeof(Vertex));
+
+    return true;
+}
+
+/*
+==============================
+ openMeshFile();
+==============================
+*/
+
+//maps --mesh and checks its header, the vertex format, index type and mega buffer sizes follow the file
+bool openMeshFile()
+{
+    int fd = open(g_MeshFileName, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printErrorMsg("cannot open file %s\n", g_MeshFileName);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+    {
+        printErrorMsg("%s fstat(), %s.\n", g_MeshFileName, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = st.st_size;
+
+    if (fileSize < sizeof(MeshFileHeader))
+    {
+        printErrorMsg("%s is not a mesh file, size %zu.\n", g_MeshFileName, fileSize);
+        close(fd);
+        return false;
+    }
+
+    const unsigned char *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printErrorMsg("%s mmap(), %s.\n", g_MeshFileName, strerror(errno));
+        return false;
+    }
+
+    //read once front to back, into the staging ring
+    posix_madvise((void*)data, fileSize, POSIX_MADV_SEQUENTIAL);
+
+    g_MeshFileData = data;
+    g_MeshFileSize = fileSize;
+
+    const MeshFileHeader *header = (const MeshFileHeader*)data;
+
+    if (header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION ||
+        header->headerSize != sizeof(MeshFileHeader))
+    {
+        printErrorMsg("%s bad mesh file header, magic 0x%08x, version %u.\n", g_MeshFileName,
+            header->magic, header->version);
+        return false;
+    }
+
+    const MeshFileLayout *layout = &header->layout;
+
+    if (layout->format >= MESH_VERTEX_FORMAT_COUNT ||
+        layout->stride != meshVertexLayouts[layout->format].stride ||
+        layout->normalOffset != meshVertexLayouts[layout->format].normalOffset ||
+        layout->colorOffset != meshVertexLayouts[layout->format].colorOffset)
+    {
+        printErrorMsg("%s unknown vertex layout.\n", g_MeshFileName);
+        return false;
+    }
+
+    uint64_t vertexDataSize = (uint64_t)header->vertexCount * layout->stride;
+    uint64_t indexDataSize = (uint64_t)header->indexCount * header->indexSize;
+
+    if ((header->indexSize != 2 && header->indexSize != 4) ||
+        !header->vertexCount || !header->indexCount || header->indexCount % 3 ||
+        header->vertexDataOffset % MESH_FILE_ALIGNMENT || header->indexDataOffset % MESH_FILE_ALIGNMENT ||
+        header->vertexDataOffset > fileSize || vertexDataSize > fileSize - header->vertexDataOffset ||
+        header->indexDataOffset > fileSize || indexDataSize > fileSize - header->indexDataOffset)
+    {
+        printErrorMsg("%s bad mesh file, %u vertices, %u indices of %u bytes.\n", g_MeshFileName,
+            header->vertexCount, header->indexCount, header->indexSize);
+        return false;
+    }
+
+    //the transform and the bounds end up in the instance data, a NaN or zero scale would draw nothing
+    bool transformOk = isfinite(header->dequantScale) && header->dequantScale > 0.0f;
+
+    for (int j = 0; j < 3; ++j)
+    {
+        transformOk = transformOk && isfinite(header->dequantOffset[j]) &&
+            isfinite(header->boundsMin[j]) && isfinite(header->boundsMax[j]);
+    }
+
+    if (!transformOk)
+    {
+        printErrorMsg("%s bad mesh file, dequantization scale %g, offset or bounds out of range.\n", g_MeshFileName,
+            header->dequantScale);
+        return false;
+    }
+
+    //an index past the vertices would read outside the mesh, or outside the buffer
+    const unsigned char *indices = data + header->indexDataOffset;
+    uint32_t maxIndex = 0;
+
+    for (uint32_t i = 0; i < header->indexCount; ++i)
+    {
+        uint32_t index;
+
+        if (header->indexSize == 2)
+        {
+            uint16_t index16;
+
+            memcpy(&index16, indices + i * 2, sizeof index16);
+            index = index16;
+        }
+        else
+        {
+            memcpy(&index, indices + i * 4, sizeof index);
+        }
+
+        if (index > maxIndex) maxIndex = index;
+    }
+
+    if (maxIndex >= header->vertexCount)
+    {
+        printErrorMsg("%s index %u out of %u vertices.\n", g_MeshFileName, maxIndex, header->vertexCount);
+        return false;
+    }
+
+    g_VertexFormat = (MeshVertexFormat)layout->format;
+    g_IndexType = header->indexSize == 4 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+    g_IndexSize = header->indexSize;
+
+    if (vertexDataSize > g_MegaVertexBufferSize) g_MegaVertexBufferSize = vertexDataSize;
+    if (indexDataSize > g_MegaIndexBufferSize) g_MegaIndexBufferSize = indexDataSize;
+
+    printInfoMsg("%s: %u vertices %s, %u indices %u bit, %zu bytes mapped.\n", g_MeshFileName,
+        header->vertexCount, meshVertexLayouts[g_VertexFormat].name, header->indexCount,
+        header->indexSize * 8, fileSize);
+
+    return true;
+}
+
+/*
+==============================
+ closeMeshFile();
+==============================
+*/
+
+void closeMeshFile()
+{
+    if (g_MeshFileData)
+    {
+        munmap((void*)g_MeshFileData, g_MeshFileSize);
+        g_MeshFileData = NULL;
+        g_MeshFileSize = 0;
+    }
+}
+
+/*
+==============================
+ packVertices();
+==============================
+*/
+
+//vertices in meshVertexLayouts[g_VertexFormat], positions quantized with the transform of the mesh
+void packVertices(const Vertex *vertices, uint32_t vertexCount, float dequantScale, const float dequantOffset[3],
+    uint8_t *packed)
+{
+    uint32_t stride = meshVertexLayouts[g_VertexFormat].stride;
+
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        const Vertex *v = &vertices[i];
+
+        float position[3] = { v->x, v->y, v->z };
+        float normal[3] = { v->nx, v->ny, v->nz };
+        float color[3] = { v->r, v->g, v->b };
+
+        meshPackVertex(g_VertexFormat, position, normal, color, dequantScale, dequantOffset,
+            packed + (size_t)i * stride);
+    }
+}
+
+/*
+==============================
+ addPackedMesh();
+==============================
+*/
+
+//appends vertices already in the layout of g_VertexFormat and indices of g_IndexType
+//to the mega buffers, returns the mesh index or -1
+int32_t addPackedMesh(const void *vertices, uint32_t vertexCount, const void *indices, uint32_t indexCount,
+    float radius, float dequantScale, const float dequantOffset[3])
+{
+    uint32_t stride = meshVertexLayouts[g_VertexFormat].stride;
+
+    if (g_MeshCount == MAX_MESHES)
+    {
+        printErrorMsg("too many meshes (%d).\n", MAX_MESHES);
+        return -1;
+    }
+
+    if ((uint64_t)(g_MegaVertexCount + vertexCount) * stride > g_MegaVertexBufferSize ||
+        (uint64_t)(g_MegaIndexCount + indexCount) * g_IndexSize > g_MegaIndexBufferSize)
+    {
+        printErrorMsg("mega buffers are full, mesh of %u vertices, %u indices.\n", vertexCount, indexCount);
+        return -1;
+    }
+
+    if (!uploadData(vertices, (VkDeviceSize)vertexCount * stride, g_VertexBuffer,
+            (VkDeviceSize)g_MegaVertexCount * stride,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT) ||
+        !uploadData(indices, (VkDeviceSize)indexCount * g_IndexSize, g_IndexBuffer,
+            (VkDeviceSize)g_MegaIndexCount * g_IndexSize,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT))
+    {
+        return -1;
+    }
+
+    Mesh *mesh = &g_Meshes[g_MeshCount];
+
+    mesh->firstIndex = g_MegaIndexCount;
+    mesh->indexCount = indexCount;
+    mesh->vertexOffset = (int32_t)g_MegaVertexCount;
+    mesh->vertexCount = vertexCount;
+    mesh->radius = radius;
+    mesh->dequantScale = dequantScale;
+    mesh->dequantOffset[0] = dequantOffset[0];
+    mesh->dequantOffset[1] = dequantOffset[1];
+    mesh->dequantOffset[2] = dequantOffset[2];
+
+    g_MegaVertexCount += vertexCount;
+    g_MegaIndexCount += indexCount;
+
+    return (int32_t)g_MeshCount++;
+}
+
+/*
+==============================
+ addMesh();
+==============================
+*/
+
+//packs a built-in mesh and appends it to the mega buffers, returns its index or -1
+int32_t addMesh(const Vertex *vertices, uint32_t vertexCount, const uint16_t *indices, uint32_t indexCount)
+{
+    const MeshVertexLayout *layout = &meshVertexLayouts[g_VertexFormat];
+
+    float radius = 0.0f;
+    float dequantScale = 1.0f;
+    float dequantOffset[3] = { 0.0f, 0.0f, 0.0f };
+
+    float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        const Vertex *v = &vertices[i];
+        float position[3] = { v->x, v->y, v->z };
+
+        radius = fmaxf(radius, sqrtf(v->x * v->x + v->y * v->y + v->z * v->z));
+
+        for (int j = 0; j < 3; ++j)
+        {
+            boundsMin[j] = fminf(boundsMin[j], position[j]);
+            boundsMax[j] = fmaxf(boundsMax[j], position[j]);
+        }
+    }
+
+    //the transform is folded into the instances of the object drawing the mesh, objects sharing
+    //an instance range share the identity transform and so their meshes have to fit in [-1,1]
+    if (layout->quantized && vertexCount && (g_PlaceObjects || g_ObjectCount == 1))
+    {
+        float extent = 0.0f;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            dequantOffset[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+            extent = fmaxf(extent, (boundsMax[j] - boundsMin[j]) * 0.5f);
+        }
+
+        if (extent > 0.0f) dequantScale = extent;
+    }
+
+    uint8_t *packed = malloc((size_t)vertexCount * layout->stride);
+
+    if (!packed)
+    {
+        printErrorMsg("unable to allocate memory (34).\n");
+        return -1;
+    }
+
+    packVertices(vertices, vertexCount, dequantScale, dequantOffset, packed);
+
+    int32_t meshIndex = addPackedMesh(packed, vertexCount, indices, indexCount, radius, dequantScale, dequantOffset);
+
+    free(packed);
+
+    return meshIndex;
+}
+
+/*
+==============================
+ addMeshFile();
+==============================
+*/
+
+//the blobs go from the mapping straight into the staging ring, the mesh is scaled
+//to the size of the built-in quad by its dequantization transform
+bool addMeshFile()
+{
+    const MeshFileHeader *header = (const MeshFileHeader*)g_MeshFileData;
+
+    float center[3];
+    float halfDiagonal = 0.0f;
+
+    for (int j = 0; j < 3; ++j)
+    {
+        center[j] = (header->boundsMin[j] + header->boundsMax[j]) * 0.5f;
+        halfDiagonal += (header->boundsMax[j] - center[j]) * (header->boundsMax[j] - center[j]);
+    }
+
+    halfDiagonal = sqrtf(halfDiagonal);
+
+    float fit = halfDiagonal > 0.0f ? 0.5f / halfDiagonal : 1.0f;
+    float dequantOffset[3];
+
+    for (int j = 0; j < 3; ++j)
+    {
+        dequantOffset[j] = (header->dequantOffset[j] - center[j]) * fit;
+    }
+
+    int32_t meshIndex = addPackedMesh(g_MeshFileData + header->vertexDataOffset, header->vertexCount,
+        g_MeshFileData + header->indexDataOffset, header->indexCount,
+        halfDiagonal * fit, header->dequantScale * fit, dequantOffset);
+
+    //uploadData() copied everything into the staging ring
+    closeMeshFile();
+
+    if (meshIndex < 0)
+    {
+        printErrorMsg("%s upload.\n", g_MeshFileName);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+==============================
+ uploadInstances();
+==============================
+*/
+
+//lays the instances out on a square grid over the quad, one instance covers the quad as before,
+//with g_PlaceObjects every object repeats the grid at its own position
+bool uploadInstances()
+{
+    InstanceData *instances = malloc(g_InstanceBufferCount * sizeof(InstanceData));
+
+    if (!instances)
+    {
+        printErrorMsg("unable to allocate memory (31).\n");
+        return false;
+    }
+
+    uint32_t side = (uint32_t)ceilf(sqrtf((float)g_InstanceCount));
+    float cell = 1.0f / side;
+
+    for (uint32_t n = 0; n < g_InstanceBufferCount; ++n)
+    {
+        InstanceData *instance = &instances[n];
+        uint32_t i = n % g_InstanceCount;
+        float position[3];
+
+        objectPosition(n / g_InstanceCount, position);
+
+        //the mesh of the object, dequantization happens before the instance scale and offset
+        const Mesh *mesh = &g_Meshes[(g_PlaceObjects ? n / g_InstanceCount : 0) % g_MeshCount];
+
+        instance->x = (i % side + 0.5f) * cell - 0.5f + position[0] + mesh->dequantOffset[0] * cell;
+        instance->y = (i / side + 0.5f) * cell - 0.5f + position[1] + mesh->dequantOffset[1] * cell;
+        instance->z = position[2] + mesh->dequantOffset[2] * cell;
+        instance->scale = cell * mesh->dequantScale;
+
+        instance->r = g_InstanceCount > 1 ? 0.6f + 0.4f * sinf(i * 0.37f) : 1.0f;
+        instance->g = g_InstanceCount > 1 ? 0.6f + 0.4f * sinf(i * 0.53f + 2.0f) : 1.0f;
+        instance->b = g_InstanceCount > 1 ? 0.6f + 0.4f * sinf(i * 0.71f + 4.0f) : 1.0f;
+        instance->a = 1.0f;
+    }
+
+    bool ok = uploadData(instances, g_InstanceBufferCount * sizeof(InstanceData), g_InstanceBuffer, 0,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+    free(instances);
+
+    if (!ok) printErrorMsg("instance upload.\n");
+
+    return ok;
+}
+
+/*
+==============================
+ initVulkan();
+==============================
+*/
+
+bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
+{
+    startupPhaseBegin("instance creation");
+
+    //get global level fnc address
+
+    GET_GLOBAL_LEVEL_FUN_ADDR(vkEnumerateInstanceLayerProperties);
+    GET_GLOBAL_LEVEL_FUN_ADDR(vkEnumerateInstanceExtensionProperties);
+    GET_GLOBAL_LEVEL_FUN_ADDR(vkCreateInstance);
+
+    //enumerate instance layers
+    {
+        uint32_t layerCount = 0;
+
+        pfn_vkEnumerateInstanceLayerProperties(&layerCount,NULL);
+
+        printInfoMsg("number of instance layer properties available: %d\n",layerCount);
+
+        printInfoMsg("available instance layers: ");
+
+        if (layerCount>0)
+        {
+
+            printf("\n");
+
+            VkLayerProperties *layerProperties = NULL;
+
+            layerProperties = (VkLayerProperties*) malloc(layerCount * sizeof(VkLayerProperties));
+
+            if (layerProperties==NULL)
+            {
+                printErrorMsg("unable to allocate memory (1)\n");
+                return false;
+            }
+
+            pfn_vkEnumerateInstanceLayerProperties(&layerCount,layerProperties);
+
+            for ( uint32_t i = 0; i < layerCount; ++i)
+            {
+                printf("\t%s | %s\n", layerProperties[i].layerName, layerProperties[i].description);
+            }
+
+            uint32_t numberOfEllementsInst = sizeof g_InstanceLayers / sizeof g_InstanceLayers[0];
+
+            if(numberOfEllementsInst == 1 && g_InstanceLayers[0] == NULL) numberOfEllementsInst = 0;
+
+            if (numberOfEllementsInst)
+            {
+                for (uint32_t i = 0 ; i < layerCount; ++i)
+                {
+                    for (uint32_t a = 0; a < numberOfEllementsInst; ++a)
+                    {
+                        if (!strcmp(g_InstanceLayers[a], layerProperties[i].layerName))
+                        {
+                            char **pInstanceLayersArrayTmp =
+                                (char**) realloc(g_InstanceLayersArray,
+                                sizeof g_InstanceLayers[0] * (g_InstanceLayersArrayCount+1));
+
+                            if (!pInstanceLayersArrayTmp)
+                            {
+                                printErrorMsg("unable to reallocate memory (1)\n");
+                                free(layerProperties);
+                                return false;
+                            }
+
+                            g_InstanceLayersArray = pInstanceLayersArrayTmp;
+
+                            g_InstanceLayersArray[g_InstanceLayersArrayCount] =
+                                (char*) malloc(strlen(layerProperties[i].layerName) + 1);
+
+                            if (g_InstanceLayersArray[g_InstanceLayersArrayCount] == NULL)
+                            {
+                                printErrorMsg("unable to allocate memory (2)[%d]\n",g_InstanceLayersArrayCount);
+                                free(layerProperties);
+                                return false;
+                            }
+
+                            strcpy(g_InstanceLayersArray[g_InstanceLayersArrayCount], layerProperties[i].layerName);
+
+                            g_InstanceLayersArrayCount++;
+                        }
+
+                    }
+                }
+            }
+
+            free(layerProperties);
+        }
+        else printf("none.\n");
+    }
+
+#ifdef DEBUG
+    if (!isAvailable(g_InstanceLayersArray, g_InstanceLayersArrayCount, "VK_LAYER_KHRONOS_validation"))
+    {
+        printErrorMsg("requested layer not available: VK_LAYER_KHRONOS_validation\n");
+		return false;
+    }
+    else printInfoMsg("VK_LAYER_KHRONOS_validation available OK.\n");
+#endif
+
+    printInfoMsg("count of instance layers to be used: %d\n",g_InstanceLayersArrayCount);
+
+    if (g_InstanceLayersArrayCount>0)
+    {
+        printInfoMsg("list of instance layers to be used:\n");
+        for (uint32_t i = 0; i < g_InstanceLayersArrayCount; ++i)
+        {
+            printf("\t%s\n",g_InstanceLayersArray[i]);
+        }
+    }
+
+    //enumerate instance extensions
+    {
+
+        uint32_t extensionCount = 0;
+
+        pfn_vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL);
+
+        printInfoMsg("instance extension count: %d\n", extensionCount);
+
+        printInfoMsg("available instance extensions: ");
+
+        if (extensionCount>0)
+        {
+
+            printf("\n");
+
+            VkExtensionProperties *extensionProperties =
+                (VkExtensionProperties*) malloc(extensionCount * sizeof(VkExtensionProperties));
+
+            if (extensionProperties==NULL)
+            {
+                printErrorMsg("unable to allocate memory (3)\n");
+                return false;
+            }
+
+            pfn_vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, extensionProperties);
+
+            for (uint32_t i = 0 ; i < extensionCount; ++i)
+            {
+                printf("\t%s\n",extensionProperties[i].extensionName);
+            }
+
+            uint32_t numberOfEllementsExt = sizeof g_InstanceExtensions / sizeof g_InstanceExtensions[0];
+
+            if(numberOfEllementsExt == 1 && g_InstanceExtensions[0] == NULL) numberOfEllementsExt = 0;
+
+            if (numberOfEllementsExt)
+            {
+                for (uint32_t i = 0 ; i < extensionCount; ++i)
+                {
+                    for (uint32_t a = 0; a < numberOfEllementsExt; ++a)
+                    {
+                        if (!strcmp(g_InstanceExtensions[a], extensionProperties[i].extensionName))
+                        {
+                            char **pInstanceExtensionArrayTmp = (char**) realloc(g_InstanceExtensionArray,
+                                    sizeof g_InstanceExtensionArray[0] * (g_InstanceExtensionArrayCount+1));
+
+                            if (!pInstanceExtensionArrayTmp)
+                            {
+                                printErrorMsg("unable to reallocate memory (2)\n");
+                                free(extensionProperties);
+                                return false;
+                            }
+
+                            g_InstanceExtensionArray = pInstanceExtensionArrayTmp;
+
+                            g_InstanceExtensionArray[g_InstanceExtensionArrayCount] =
+                                (char*) malloc(strlen(extensionProperties[i].extensionName) + 1);
+
+                            if (g_InstanceExtensionArray[g_InstanceExtensionArrayCount] == NULL)
+                            {
+                                printErrorMsg("unable to allocate memory (4)[%d]\n",g_InstanceExtensionArrayCount);
+                                free(extensionProperties);
+                                return false;
+                            }
+
+                            strcpy(g_InstanceExtensionArray[g_InstanceExtensionArrayCount],
+                                extensionProperties[i].extensionName);
+
+                            g_InstanceExtensionArrayCount++;
+                        }
+                    }
+                }
+            }
+
+            free(extensionProperties);
+
+        }
+        else printf("none.\n");
+
+    }
+
+    printInfoMsg("count of instance extensions to be used: %d\n",g_InstanceExtensionArrayCount);
+
+    if (g_InstanceExtensionArrayCount>0)
+    {
+        printInfoMsg("list of instance extensions to be used:\n");
+        for (uint32_t i = 0; i < g_InstanceExtensionArrayCount; ++i)
+        {
+            printf("\t%s\n",g_InstanceExtensionArray[i]);
+        }
+    }
+
+#ifdef DEBUG
+    VkDebugUtilsMessengerCreateInfoEXT debugMsgrCreateInfo = {0};
+
+    debugMsgrCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    debugMsgrCreateInfo.flags = 0;
+    //| VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
+    debugMsgrCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+                                            | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    debugMsgrCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+                                            | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+                                            | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    debugMsgrCreateInfo.pfnUserCallback = debugMessengerCallback;
+    debugMsgrCreateInfo.pUserData = &sUsrDt;
+#endif
+
+    //create instance
+    {
+        VkApplicationInfo applicationInfo = {0};
+
+        applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        applicationInfo.pNext = NULL;
+        applicationInfo.pApplicationName = "Triangle";
+        applicationInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);
+        applicationInfo.pEngineName = "Triangle";
+        applicationInfo.engineVersion = VK_MAKE_VERSION(1,0,0);
+        //vkEnumerateInstanceVersion is missing from 1.0 loaders
+        pfn_vkEnumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)
+            pfn_vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+
+        if (pfn_vkEnumerateInstanceVersion)
+        {
+            uint32_t apiVersion = VK_API_VERSION_1_0;
+
+            if (pfn_vkEnumerateInstanceVersion(&apiVersion) == VK_SUCCESS && apiVersion >= VK_API_VERSION_1_2)
+                g_InstanceApiVersion = VK_API_VERSION_1_2;
+        }
+
+        printInfoMsg("instance API version %d.%d\n", VK_VERSION_MAJOR(g_InstanceApiVersion),
+            VK_VERSION_MINOR(g_InstanceApiVersion));
+
+        applicationInfo.apiVersion = g_InstanceApiVersion;
+
+        VkInstanceCreateInfo instanceCreateInfo = {0};
+
+        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+#ifdef DEBUG
+        instanceCreateInfo.pNext = &debugMsgrCreateInfo;
+#else
+        instanceCreateInfo.pNext = NULL;
+#endif
+        instanceCreateInfo.flags = 0;
+        instanceCreateInfo.pApplicationInfo = &applicationInfo;
+        instanceCreateInfo.enabledLayerCount = g_InstanceLayersArrayCount;
+        if (g_InstanceLayersArrayCount)
+            instanceCreateInfo.ppEnabledLayerNames = (const char* const*) g_InstanceLayersArray;
+        else instanceCreateInfo.ppEnabledLayerNames = NULL;
+        instanceCreateInfo.enabledExtensionCount = g_InstanceExtensionArrayCount;
+        if (g_InstanceExtensionArrayCount)
+            instanceCreateInfo.ppEnabledExtensionNames = (const char* const*) g_InstanceExtensionArray;
+        else instanceCreateInfo.ppEnabledExtensionNames = NULL;
+
+       	VkResult result = pfn_vkCreateInstance(&instanceCreateInfo, NULL, &g_Instance);
+
+        //TODO: free g_InstanceExtensionArray here
+
+        if (result != VK_SUCCESS)
+        {
+            if (result == VK_ERROR_INCOMPATIBLE_DRIVER)
+                printErrorMsg("failed to create Vulkan instance, can't find a compatible Vulkan driver.\n");
+            else printErrorMsg("failed to create Vulkan instance\n");
+
+            return false;
+        }
+
+        printInfoMsg("create vulkan instance OK.\n");
+
+    }
+
+    //get inst level fnc address
+
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroyInstance);
+#ifdef DEBUG
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateDebugUtilsMessengerEXT);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroyDebugUtilsMessengerEXT);
+#endif
+    if (!g_Headless)
+    {
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateXcbSurfaceKHR);
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkDestroySurfaceKHR);
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceSupportKHR);
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceCapabilitiesKHR);
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfaceFormatsKHR);
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceSurfacePresentModesKHR);
+    }
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumeratePhysicalDevices);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceProperties);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceFeatures);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceFormatProperties);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumerateDeviceLayerProperties);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkEnumerateDeviceExtensionProperties);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceQueueFamilyProperties);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkCreateDevice);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetDeviceProcAddr);
+    GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceMemoryProperties);
+    if (g_InstanceApiVersion >= VK_API_VERSION_1_2)
+    {
+        GET_INSTANCE_LEVEL_FUN_ADDR(vkGetPhysicalDeviceFeatures2);
+    }
+
+#ifdef DEBUG
+    {
+        VkResult result = pfn_vkCreateDebugUtilsMessengerEXT(g_Instance, &debugMsgrCreateInfo, NULL, &g_DebugMessenger);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("CreateDebugUtilsMessengerEXT()\n");
+            return false;
+        }
+
+        printInfoMsg("CreateDebugUtilsMessengerEXT() OK.\n");
+
+    }
+#endif
+
+    //create surface
+    if (!g_Headless)
+    {
+        VkXcbSurfaceCreateInfoKHR surfaceCreateInfo = {0};
+
+        surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+        surfaceCreateInfo.connection = conn;
+        surfaceCreateInfo.window = wnd;
+
+        VkResult result = pfn_vkCreateXcbSurfaceKHR(g_Instance, &surfaceCreateInfo, NULL, &g_Surface);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("vkCreateXcbSurfaceKHR().");
+            return false;
+        }
+
+        printInfoMsg("create surface OK.\n");
+    }
+
+    startupPhaseBegin("physical device enumeration");
+
+    //enumerate physical devices (1)
+    {
+        VkResult result = pfn_vkEnumeratePhysicalDevices(g_Instance, &g_PhysicalDeviceCount, NULL);
+
+        if (result != VK_SUCCESS)
+        {
+            printErrorMsg("failed to query the number of physical devices present.\n");
+            return false;
+        }
+
+        // there has to be at least one device present
+        if (g_PhysicalDeviceCount == 0)
+        {
+            printErrorMsg("couldn't detect any device present with Vulkan support.\n");
+            return false;
+        }
+
+        printInfoMsg("number of Vulkan physical devices found: %d\n", g_PhysicalDeviceCount);
+
+    }
+
+    g_PhysicalDevices = (VkPhysicalDevice*) malloc(g_PhysicalDeviceCount * sizeof(VkPhysicalDevice));
+
+    if (g_PhysicalDevices == NULL) {
+        printErrorMsg("unable to allocate memory (5)\n");
+        return false;
+    }
 
-        VkResult result = pfn_vkGetPhysicalDeviceSurfaceFormatsKHR(g_SelectedPhysicalDevice,
-            g_Surface, &surfaceFormatCount, NULL);
+    //enumerate physical devices (2)
+    {
+        VkResult result = pfn_vkEnumeratePhysicalDevices(g_Instance, &g_PhysicalDeviceCount, g_PhysicalDevices);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg("vkGetPhysicalDeviceSurfaceFormatsKHR() (1).\n");
+            printErrorMsg("faied to enumerate physical devices present.\n");
             return false;
         }
+    }
 
-        printInfoMsg("surface format count %d\n",surfaceFormatCount);
+    for (uint32_t i = 0; i < g_PhysicalDeviceCount; ++i)
+    {
 
-        if (surfaceFormatCount>0)
-        {
+        VkPhysicalDeviceProperties deviceProperties ={0};
+        pfn_vkGetPhysicalDeviceProperties(g_PhysicalDevices[i], &deviceProperties);
+        printInfoMsg("device number (%d):\n", i+1);
 
-            VkSurfaceFormatKHR* surfaceFormats =
-                (VkSurfaceFormatKHR*) malloc(surfaceFormatCount * sizeof(VkSurfaceFormatKHR));
+        printf("\tdevice name: %s\n", deviceProperties.deviceName);
 
-            if (surfaceFormats==NULL)
-            {
-                printErrorMsg("unable to allocate memory (12)\n");
-                return false;
-            }
+        printf("\t%s\n", str_VkPhysicalDeviceType(deviceProperties.deviceType));
 
-            result = pfn_vkGetPhysicalDeviceSurfaceFormatsKHR(g_SelectedPhysicalDevice,
-                g_Surface, &surfaceFormatCount, surfaceFormats);
+        printf("\tAPI version: %d.%d.%d\n", (deviceProperties.apiVersion >> 22),
+                                            (deviceProperties.apiVersion >> 12) & 0x3FF,
+                                            (deviceProperties.apiVersion & 0xFFF));
+    }
 
-            if (result != VK_SUCCESS)
-            {
-                free(surfaceFormats);
-                printErrorMsg("vkGetPhysicalDeviceSurfaceFormatsKHR() (2).\n");
-                return false;
-            }
 
-            printInfoMsg("SurfaceFormats:\n");
+    if(g_RequestedDeviceNum > g_PhysicalDeviceCount)
+    {
+        printErrorMsg("there is no physical device with such number.\n");
+        printf("\tyou have requested physical device number: %d\n", g_RequestedDeviceNum);
+        if(g_PhysicalDeviceCount == 1)
+        {
+            printf("\tbut there is only %d physical device found\n", g_PhysicalDeviceCount);
+            printf("\trequested physical device number on this mashine can be only 1\n");
+        }
+        else
+        {
+            printf("\trequested physical device number on this mashine should be within range 1-%d\n",
+                g_PhysicalDeviceCount);
+            printf("\tbut there is only %d physical devices found\n", g_PhysicalDeviceCount);
+        }
 
-            for (uint32_t i = 0; i < surfaceFormatCount; ++i)
-            {
-                printf("\tformat (%d): %s\n", i, str_VkFormat(surfaceFormats[i].format));
-                printf("\tcolor space (%d): %s\n", i,
-                    str_VkColorSpaceKHR(surfaceFormats[i].colorSpace));
-            }
 
-            //choose SwapChain Surface Format
+        return false;
+    }
 
-            if (surfaceFormatCount == 1 && surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
-            {
-                g_SurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
-                g_SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-            }
+    if (g_RequestedDeviceNum > 0)
+    {
+        printInfoMsg("requested physical device number: %d\n", g_RequestedDeviceNum);
+    }
+    else
+        printInfoMsg("by default using first available physical device.\n");
 
-            for (uint32_t i = 0; i < surfaceFormatCount; ++i)
-            {
-                if (surfaceFormats[i].format == VK_FORMAT_B8G8R8A8_UNORM &&
-                    surfaceFormats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-                {
-                    g_SurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
-                    g_SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-                }
-            }
+    if (g_RequestedDeviceNum > 0)
+        g_SelectedPhysicalDevice = g_PhysicalDevices[g_RequestedDeviceNum-1];
+    else
+        g_SelectedPhysicalDevice = g_PhysicalDevices[0];
 
-            printInfoMsg("g_SurfaceFormat.format: %s\n",str_VkFormat(g_SurfaceFormat.format));
-            printInfoMsg("g_SurfaceFormat.colorSpace: %s\n",str_VkColorSpaceKHR(g_SurfaceFormat.colorSpace));
+    pfn_vkGetPhysicalDeviceProperties(g_SelectedPhysicalDevice, &g_PhysicalDeviceProperties);
 
-            free(surfaceFormats);
-        }
-    }
+    //memory types are looked up in this copy by the allocator
+    pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &g_MemoryProperties);
 
-    //present modes
+    //enumerate device layers
     {
-        uint32_t presentModeCount = 0;
 
-        VkResult result = pfn_vkGetPhysicalDeviceSurfacePresentModesKHR(g_SelectedPhysicalDevice,
-            g_Surface, &presentModeCount, NULL);
+        uint32_t layerCount = 0;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("vkGetPhysicalDeviceSurfacePresentModesKHR (1).\n");
-            return false;
-        }
+        pfn_vkEnumerateDeviceLayerProperties(g_SelectedPhysicalDevice, &layerCount, NULL);
 
-        printInfoMsg("present mode count %d\n",presentModeCount);
+        printInfoMsg("available device layers count %d\n",layerCount);
 
-        if (presentModeCount>0)
-        {
+        printInfoMsg("available device layers: ");
 
-            VkPresentModeKHR* presentModes =
-                (VkPresentModeKHR*) malloc(presentModeCount * sizeof(VkPresentModeKHR));
+        if (layerCount>0)
+        {
+            printf("\n");
 
-            if (presentModes==NULL)
-            {
-                printErrorMsg("unable to allocate memory (13)\n");
-                return false;
-            }
+            VkLayerProperties* layerProperties = NULL;
 
-            result = pfn_vkGetPhysicalDeviceSurfacePresentModesKHR(g_SelectedPhysicalDevice,
-                g_Surface, &presentModeCount, presentModes);
+            layerProperties = (VkLayerProperties*) malloc(layerCount * sizeof(VkLayerProperties));
 
-            if (result != VK_SUCCESS)
+            if (layerProperties == NULL)
             {
-                free(presentModes);
-                printErrorMsg("vkGetPhysicalDeviceSurfacePresentModesKHR (2).\n");
+                printErrorMsg("unable to allocate memory (7)\n");
                 return false;
             }
 
-            printInfoMsg("Present modes:\n");
+            pfn_vkEnumerateDeviceLayerProperties(g_SelectedPhysicalDevice, &layerCount, layerProperties);
 
-            for (uint32_t i = 0; i < presentModeCount; ++i)
+            for (uint32_t i=0 ; i < layerCount; ++i)
             {
-                printf("\t%s\n",str_VkPresentModeKHR(presentModes[i]));
+                printf("\t%s | %s\n", layerProperties[i].layerName, layerProperties[i].description);
             }
 
-            //here g_PresentMode is VK_PRESENT_MODE_FIFO_KHR
+            uint32_t numberOfEllements = sizeof g_DeviceLayers / sizeof g_DeviceLayers[0];
 
-            //choose SwapChain Present Mode
+            if(numberOfEllements == 1 && g_DeviceLayers[0] == NULL) numberOfEllements = 0;
 
-            for (uint32_t i = 0; i < presentModeCount; ++i)
+            if (numberOfEllements)
             {
-                if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-                {
-                    g_PresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-                    break;
-                }
 
-                if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR)
+                for (uint32_t i = 0 ; i < layerCount; ++i)
                 {
-                    g_PresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-                }
-            }
+                    for (uint32_t a = 0; a < numberOfEllements; ++a)
+                    {
+                        if (!strcmp(g_DeviceLayers[a], layerProperties[i].layerName))
+                        {
 
-            printInfoMsg("g_PresentMode: %s\n",str_VkPresentModeKHR(g_PresentMode));
+                            char** pDeviceLayersArrayTmp = (char**) realloc(g_DeviceLayersArray,
+                                sizeof g_DeviceLayers[0] * (g_DeviceLayersArrayCount+1));
 
-            free(presentModes);
-        }
-    }
+                            if (!pDeviceLayersArrayTmp)
+                            {
+                                printErrorMsg("unable to reallocate memory (3)\n");
+                                free(layerProperties);
+                                return false;
+                            }
 
-    //choose SwapChain Extent
-    {
-        if (surfaceCapabilities.currentExtent.width != UINT32_MAX )
-        {
-            g_SwapChainExtent = surfaceCapabilities.currentExtent;
-        }
-        else
-        {
-            g_SwapChainExtent.width = maxValU(surfaceCapabilities.minImageExtent.width,
-                surfaceCapabilities.maxImageExtent.width);
-            g_SwapChainExtent.height = maxValU(surfaceCapabilities.minImageExtent.height,
-                surfaceCapabilities.maxImageExtent.height);
-        }
+                            g_DeviceLayersArray = pDeviceLayersArrayTmp;
 
-        printInfoMsg("SwapChain Extent width: %d\n", g_SwapChainExtent.width);
-        printInfoMsg("SwapChain Extent height: %d\n", g_SwapChainExtent.height);
-    }
 
-    //image count
-    {
-        g_ImageCount = 2;
-        if (g_ImageCount<surfaceCapabilities.minImageCount)
-            g_ImageCount = surfaceCapabilities.minImageCount;
-        if (g_ImageCount>surfaceCapabilities.maxImageCount)
-            g_ImageCount = surfaceCapabilities.maxImageCount;
+                            g_DeviceLayersArray[g_DeviceLayersArrayCount] =
+                                (char*) malloc(strlen(layerProperties[i].layerName) + 1);
 
-        printInfoMsg("image count: %d\n", g_ImageCount);
-    }
+                            if (g_DeviceLayersArray[g_DeviceLayersArrayCount] == NULL)
+                            {
+                                printErrorMsg("unable to allocate memory (8)[%d]\n", g_DeviceLayersArrayCount);
+                                free(layerProperties);
+                                return false;
+                            }
 
-    //swapchain
-    {
-        VkSwapchainCreateInfoKHR swapchainCreateInfo = {0};
+                            strcpy(g_DeviceLayersArray[g_DeviceLayersArrayCount],layerProperties[i].layerName);
 
-        uint32_t queueFamilyIndices[] = {g_GraphicsQueueFamilyIndex, g_PresentQueueFamilyIndex};
+                            g_DeviceLayersArrayCount++;
 
-        swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        swapchainCreateInfo.minImageCount = g_ImageCount;
-        swapchainCreateInfo.surface = g_Surface;
-        swapchainCreateInfo.imageFormat = g_SurfaceFormat.format;
-        swapchainCreateInfo.imageColorSpace = g_SurfaceFormat.colorSpace;
-        swapchainCreateInfo.imageExtent = g_SwapChainExtent;
-        swapchainCreateInfo.imageArrayLayers = 1;
-        swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                        }
+                    }
+                }
+            }
 
-        if (g_GraphicsQueueFamilyIndex != g_PresentQueueFamilyIndex)
-        {
-            swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            swapchainCreateInfo.queueFamilyIndexCount = 2;
-            swapchainCreateInfo.pQueueFamilyIndices = queueFamilyIndices;
-        }
-        else
-        {
-            swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            free(layerProperties);
         }
+        else printf("none.\n");
+	}
 
-        swapchainCreateInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-        swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        swapchainCreateInfo.presentMode = g_PresentMode;
-        swapchainCreateInfo.clipped = true;
-        swapchainCreateInfo.oldSwapchain = NULL;
-
-        VkResult result = pfn_vkCreateSwapchainKHR( g_LogicalDevice,
-            &swapchainCreateInfo, NULL,	&g_SwapChain );
+    printInfoMsg("count of device layers to be used: %d\n",g_DeviceLayersArrayCount);
 
-        if (result != VK_SUCCESS)
+    if (g_DeviceLayersArrayCount>0)
+    {
+        printInfoMsg("list of device layers to be used:\n");
+        for (uint32_t i = 0; i < g_DeviceLayersArrayCount; ++i)
         {
-            printErrorMsg("faied to create SwapChain.\n");
-            return false;
+            printf("\t%s\n",g_DeviceLayersArray[i]);
         }
     }
 
-    printInfoMsg("create SwapChain OK.\n");
-
-    //images
+	//enumerate device extensions
     {
-        VkResult result = pfn_vkGetSwapchainImagesKHR( g_LogicalDevice,
-            g_SwapChain, &g_SwapChainImageCount, NULL );
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("vkGetSwapchainImagesKHR() (1).\n");
-            return false;
-        }
+        uint32_t extensionCount = 0;
 
-        printInfoMsg("SwapChain image count %d\n", g_SwapChainImageCount);
+        pfn_vkEnumerateDeviceExtensionProperties(g_SelectedPhysicalDevice, NULL, &extensionCount, NULL);
 
-        if (g_SwapChainImageCount>1)
+        printInfoMsg("available device extensions count: %d\n", extensionCount);
+
+        printInfoMsg("available device extensions: ");
+
+        if (extensionCount>0)
         {
-            g_SwapChainImages = (VkImage*) malloc(g_SwapChainImageCount * sizeof(VkImage));
+            printf("\n");
+
+            VkExtensionProperties* extensionProperties =
+            (VkExtensionProperties*) malloc(extensionCount * sizeof(VkExtensionProperties));
 
-            if (g_SwapChainImages==NULL)
+            if (extensionProperties==NULL)
             {
-                printErrorMsg("unable to allocate memory (14)\n");
+                printErrorMsg("unable to allocate memory (9)\n");
                 return false;
             }
 
-            // link the images to the swapchain
-            result = pfn_vkGetSwapchainImagesKHR(g_LogicalDevice,
-                g_SwapChain, &g_SwapChainImageCount, g_SwapChainImages);
+            pfn_vkEnumerateDeviceExtensionProperties(g_SelectedPhysicalDevice,
+                                                        NULL,
+                                                        &extensionCount,
+                                                        extensionProperties);
 
-            if (result != VK_SUCCESS)
+            for (uint32_t i=0 ; i < extensionCount; ++i)
             {
-                printErrorMsg("vkGetSwapchainImagesKHR() (2).\n");
-                return false;
+                printf("\t%s\n", extensionProperties[i].extensionName);
             }
-        }
-        else
-        {
-            printErrorMsg("SwapChain image count less than 1.\n");
-            return false;
-        }
-    }
-
-    printInfoMsg("vkGetSwapchainImagesKHR() OK.\n");
-
-    //image views
-    {
-        g_SwapChainImageViews = (VkImageView*) malloc(g_SwapChainImageCount * sizeof(VkImageView));
-
-        if (g_SwapChainImageViews==NULL)
-        {
-            printErrorMsg("unable to allocate memory (15)\n");
-            return false;
-        }
-
-        for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
-        {
 
-            VkImageViewCreateInfo imageViewCreateInfo = {0};
+            uint32_t numberOfEllements = 0;
 
-            imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            imageViewCreateInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
-            imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-            imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-            imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-            imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
-            imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-            imageViewCreateInfo.subresourceRange.levelCount = 1;
-            imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-            imageViewCreateInfo.subresourceRange.layerCount = 1;
-            imageViewCreateInfo.image = g_SwapChainImages[i];
+            numberOfEllements = sizeof g_DeviceExtensions / sizeof g_DeviceExtensions[0];
 
-            VkResult result = pfn_vkCreateImageView(g_LogicalDevice,
-                &imageViewCreateInfo, NULL, &g_SwapChainImageViews[i]);
+            if(numberOfEllements == 1 && g_DeviceExtensions[0] == NULL) numberOfEllements = 0;
 
-            if (result != VK_SUCCESS)
+            if (numberOfEllements)
             {
-                if (i>0)
+
+                for (uint32_t a = 0; a < numberOfEllements; ++a)
                 {
-                    for (uint32_t j = 0; j < i; ++j)
+                    for (uint32_t i = 0 ; i < extensionCount; ++i)
                     {
-                        pfn_vkDestroyImageView(g_LogicalDevice,
-                            g_SwapChainImageViews[j], NULL);
-                    }
-                }
-
-                free(g_SwapChainImageViews);
-                printErrorMsg("cannot create Image View (%d).\n",i);
-                return false;
-            }
-        }
-    }
+                        if (g_Headless && !strcmp(g_DeviceExtensions[a], "VK_KHR_swapchain")) continue;
 
-     printInfoMsg("create image view OK.\n");
+                        if (!strcmp(g_DeviceExtensions[a], extensionProperties[i].extensionName))
+                        {
 
-    //framebuffer
-    {
-        VkAttachmentDescription attachmentDescription[1] = {0};
+                            char** pDeviceExtensionsArrayTmp = (char**) realloc(g_DeviceExtArray,
+                                    sizeof g_DeviceExtensions[0] * (g_DeviceExtArrayCount+1));
 
-        attachmentDescription[0].format = VK_FORMAT_B8G8R8A8_UNORM;
-        attachmentDescription[0].samples = VK_SAMPLE_COUNT_1_BIT;
-        attachmentDescription[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachmentDescription[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        attachmentDescription[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachmentDescription[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachmentDescription[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachmentDescription[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+                            if (!pDeviceExtensionsArrayTmp)
+                            {
+                                printErrorMsg("unable to reallocate memory (4)\n");
+                                free(extensionProperties);
+                                return false;
+                            }
 
-        VkAttachmentReference attachmentReference = {0};
+                            g_DeviceExtArray = pDeviceExtensionsArrayTmp;
 
-        attachmentReference.attachment = 0;
-        attachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                            g_DeviceExtArray[g_DeviceExtArrayCount] =
+                                (char*) malloc(strlen(extensionProperties[i].extensionName) + 1);
 
-        VkSubpassDescription subpass = {0};
 
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &attachmentReference;
-        subpass.pDepthStencilAttachment = NULL;
+                            if (g_DeviceExtArray[g_DeviceExtArrayCount] == NULL)
+                            {
+                                printErrorMsg("unable to allocate memory (10)[%d]\n",g_DeviceExtArrayCount);
+                                free(extensionProperties);
+                                return false;
+                            }
 
-        VkRenderPassCreateInfo renderPassCreateInfo = {0};
+                            strcpy(g_DeviceExtArray[g_DeviceExtArrayCount],
+                                extensionProperties[i].extensionName);
 
-        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassCreateInfo.attachmentCount = 1;
-        renderPassCreateInfo.pAttachments = attachmentDescription;
-        renderPassCreateInfo.subpassCount = 1;
-        renderPassCreateInfo.pSubpasses = &subpass;
+                            g_DeviceExtArrayCount++;
 
-        VkResult result = pfn_vkCreateRenderPass(g_LogicalDevice,
-            &renderPassCreateInfo, NULL, &g_RenderPass);
+                        }
+                    }
+                }
 
-		if (result != VK_SUCCESS)
-        {
-			printErrorMsg("cannot create Render Pass.\n");
-			return false;
-		}
 
-        VkImageView frameBufferAttachments[1] = {0};
+            }
+           free(extensionProperties);
+        }
+        else printf("none.\n");
 
-        VkFramebufferCreateInfo framebufferCreateInfo = {0};
+	}
 
-        framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferCreateInfo.renderPass = g_RenderPass;
-        framebufferCreateInfo.attachmentCount = 1;
-        framebufferCreateInfo.pAttachments = frameBufferAttachments;
-        framebufferCreateInfo.width = g_Width;
-        framebufferCreateInfo.height = g_Height;
-        framebufferCreateInfo.layers = 1;
+    printInfoMsg("count of device extensions to be used: %d\n",g_DeviceExtArrayCount);
 
-        g_FrameBuffers =
-            (VkFramebuffer*) malloc(g_SwapChainImageCount * sizeof(VkFramebuffer));
+    for (uint32_t i = 0; i < g_DeviceExtArrayCount; ++i)
+    {
+        if (!strcmp(g_DeviceExtArray[i], "VK_KHR_draw_indirect_count")) g_DrawIndirectCountSupported = true;
+    }
 
-        if (g_FrameBuffers==NULL)
+    if (g_DeviceExtArrayCount>0)
+    {
+        printInfoMsg("list of device extensions to be used:\n");
+        for (uint32_t i = 0; i < g_DeviceExtArrayCount; ++i)
         {
-            printErrorMsg("unable to allocate memory (16)\n");
-            return false;
+            printf("\t%s\n",g_DeviceExtArray[i]);
         }
+    }
 
-        for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
-        {
-            g_FrameBuffers[i] = NULL;
-        }
+    //timeline semaphores, core in Vulkan 1.2 but still an optional feature there
+    if (g_InstanceApiVersion >= VK_API_VERSION_1_2 && g_PhysicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {0};
 
-        for (uint32_t i = 0; i < g_SwapChainImageCount; ++i)
-        {
-            frameBufferAttachments[0] = g_SwapChainImageViews[i];
+        timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
 
-            result = pfn_vkCreateFramebuffer(g_LogicalDevice,
-                &framebufferCreateInfo, NULL, &g_FrameBuffers[i]);
+        VkPhysicalDeviceFeatures2 physicalDeviceFeatures2 = {0};
 
-            if (result != VK_SUCCESS)
-            {
-                printErrorMsg("failed to create framebuffer (%d).\n", i);
-                return false;
-            }
-        }
+        physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        physicalDeviceFeatures2.pNext = &timelineSemaphoreFeatures;
 
-    }
+        pfn_vkGetPhysicalDeviceFeatures2(g_SelectedPhysicalDevice, &physicalDeviceFeatures2);
 
-    printInfoMsg("create framebuffer OK.\n");
+        g_TimelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+    }
 
-    static const Vertex vertices[] = {
-	    {-0.5f,-0.433f,0.0f,1.0f,1.0f,0.0f,0.0f},
-	    {0.5f,0.433f,0.0f,1.0f,0.0f,1.0f,0.0f},
-	    {-0.5f,0.433f,0.0f,1.0f,0.0f,0.0f,1.0f},
-        {0.5f,-0.433f,0.0f,1.0f,1.0f,1.0f,0.0f}
-	};
+    printInfoMsg("timeline semaphores: %s\n", g_TimelineSemaphoreSupported ? "yes" : "no");
 
-    uint32_t numOfVertices = sizeof vertices/sizeof vertices[0];
+    //without multiDrawIndirect an indirect call draws one command
+    {
+        VkPhysicalDeviceFeatures physicalDeviceFeatures = {0};
 
-    printInfoMsg("numOfVertices: %zu\n", numOfVertices);
+        pfn_vkGetPhysicalDeviceFeatures(g_SelectedPhysicalDevice, &physicalDeviceFeatures);
 
-    //uint16_t max. val 65535 , vkCmdBindIndexBuffer VK_INDEX_TYPE_UINT16
-    //uint32_t max. val 4294967295 , vkCmdBindIndexBuffer VK_INDEX_TYPE_UINT32
-    static const uint16_t indices[] = {0,1,2,0,3,1};
+        g_MultiDrawIndirect = physicalDeviceFeatures.multiDrawIndirect == VK_TRUE;
+        g_DrawIndirectFirstInstance = physicalDeviceFeatures.drawIndirectFirstInstance == VK_TRUE;
+    }
 
-    //vertex staging buffer
+    //queue families
     {
-        VkBufferCreateInfo stagingBufferCreateInfo ={0};
+        uint32_t queueFamilyCount = 0;
 
-        stagingBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        stagingBufferCreateInfo.size = sizeof vertices;
-        stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        stagingBufferCreateInfo.queueFamilyIndexCount = 0;
-	    stagingBufferCreateInfo.pQueueFamilyIndices = NULL;
+        pfn_vkGetPhysicalDeviceQueueFamilyProperties(g_SelectedPhysicalDevice, &queueFamilyCount, NULL);
 
-	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
-            &stagingBufferCreateInfo, NULL, &g_StagingBuffer);
+        printInfoMsg("queue family count %d\n",queueFamilyCount);
 
-	    if (result != VK_SUCCESS)
+        if (queueFamilyCount<1)
         {
-		    printErrorMsg("staging buffer, vkCreateBuffer().\n");
-		    return false;
+            printErrorMsg("queue family count is not greater than zero, exitting.\n");
+            return false;
         }
 
-        VkMemoryRequirements stagingBufferMemoryRequirements = {0};
+        VkQueueFamilyProperties* familyProperties =
+            (VkQueueFamilyProperties*) malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+
+        if (familyProperties == NULL)
+        {
+            printErrorMsg("unable to allocate memory (11)\n");
+            return false;
+        }
 
-        pfn_vkGetBufferMemoryRequirements(g_LogicalDevice,
-            g_StagingBuffer, &stagingBufferMemoryRequirements);
+        pfn_vkGetPhysicalDeviceQueueFamilyProperties(g_SelectedPhysicalDevice,	&queueFamilyCount, familyProperties);
+
+        for (uint32_t i = 0; i < queueFamilyCount; ++i)
+        {
+            printInfoMsg("count of queues in queue family [%d]: %d\n", i, familyProperties[i].queueCount);
+
+            printInfoMsg("Supported operations on this queue family [%d]:\n",i);
 
-        printInfoMsg("Staging Buffer Memory Requirements size: %zu\n",
-            stagingBufferMemoryRequirements.size );
-        printInfoMsg("Staging Buffer Memory Requirements alignment: %zu\n",
-            stagingBufferMemoryRequirements.alignment );
+            if (familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+                printf("\tGraphics\n");
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+            if (familyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
+                printf("\tCompute\n");
 
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = NULL;
-        memoryAllocateInfo.allocationSize = stagingBufferMemoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 0;
+            if (familyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
+                printf("\tTransfer\n");
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+            if (familyProperties[i].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT)
+                printf("\tSparse Binding\n");
 
-        pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &memoryProperties);
+            if (familyProperties[i].queueFlags & VK_QUEUE_PROTECTED_BIT)
+                printf("\tProtected\n");
 
-        bool flag = false;
+        }
 
-        VkMemoryPropertyFlags properties_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        /*
+         find the first matching index for g_GraphicsQueueFamilyIndex and g_PresentQueueFamilyIndex
+         if there is none, find first for g_GraphicsQueueFamilyIndex and first for g_PresentQueueFamilyIndex
+        */
 
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+        for (uint32_t i = 0; i<queueFamilyCount; ++i)
         {
-            VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+            VkBool32 presentationSupported = VK_FALSE;
 
-            if( stagingBufferMemoryRequirements.memoryTypeBits & (1 << i) )
+            //headless: nothing is presented, the graphics queue family is used as the "present" one
+            if (g_Headless)
             {
-                if ( (memoryType.propertyFlags & properties_flags) == properties_flags )
+                if (familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
                 {
-                    memoryAllocateInfo.memoryTypeIndex = i;
-                    flag = true;
+                    g_GraphicsQueueFamilyIndex = i;
+                    g_PresentQueueFamilyIndex = i;
                     break;
                 }
-            }
-        }
 
-        if (!flag)
-        {
-		    printErrorMsg("staging buffer, failed to find suitable memory type!\n");
-		    return false;
-        }
+                continue;
+            }
 
-        result = pfn_vkAllocateMemory(g_LogicalDevice,
-            &memoryAllocateInfo, NULL, &g_StagingBufferDeviceMemory);
+            VkResult result = pfn_vkGetPhysicalDeviceSurfaceSupportKHR( g_SelectedPhysicalDevice,
+                i, g_Surface, &presentationSupported);
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("unable to allocate device memory (3)\n");
-            return false;
-        }
+            if (result != VK_SUCCESS)
+            {
+                free(familyProperties);
+                printErrorMsg("vkGetPhysicalDeviceSurfaceSupportKHR().\n");
+                return false;
+            }
 
-        printInfoMsg("staging buffer vkAllocateMemory OK.\n");
+            if (familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && presentationSupported)
+            {
+                g_GraphicsQueueFamilyIndex = i;
+                g_PresentQueueFamilyIndex = i;
+                break;
+            }
 
-        result = pfn_vkBindBufferMemory(g_LogicalDevice,
-            g_StagingBuffer, g_StagingBufferDeviceMemory, 0);
+            if( g_GraphicsQueueFamilyIndex == -1 )
+            {
+                if( familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT ) g_GraphicsQueueFamilyIndex = i;
+            }
 
-	    if (result != VK_SUCCESS)
-        {
-            printErrorMsg("staging buffer vkBindBufferMemory().\n");
-            return false;
+            if( g_PresentQueueFamilyIndex == -1 )
+            {
+                if( presentationSupported ) g_PresentQueueFamilyIndex = i;
+            }
         }
 
-        printInfoMsg("staging buffer vkBindBufferMemory OK.\n");
+        /*
+         find matching index for g_TransferQueueFamilyIndex:
+         a transfer only family (DMA engine) first, then any family without graphics,
+         the graphics family otherwise (graphics implies transfer).
+         a separate family needs the timeline semaphore to hand the data over
+        */
 
-        void* mapMem;
+        if (g_TimelineSemaphoreSupported)
+        {
+            for (uint32_t i = 0; i<queueFamilyCount; ++i)
+            {
+                VkQueueFlags flags = familyProperties[i].queueFlags;
 
-        result = pfn_vkMapMemory(g_LogicalDevice,
-            g_StagingBufferDeviceMemory, 0, VK_WHOLE_SIZE, 0, &mapMem);
+                if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+                {
+                    g_TransferQueueFamilyIndex = i;
+                    break;
+                }
+            }
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("staging buffer vkMapMemory.\n");
-            return false;
-        }
+            for (uint32_t i = 0; i<queueFamilyCount && g_TransferQueueFamilyIndex == -1; ++i)
+            {
+                VkQueueFlags flags = familyProperties[i].queueFlags;
 
-        printInfoMsg("staging buffer vkMapMemory OK.\n");
+                if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+                {
+                    g_TransferQueueFamilyIndex = i;
+                    break;
+                }
+            }
+        }
 
-        memcpy(mapMem,vertices,sizeof vertices);
+        if (g_TransferQueueFamilyIndex == -1) g_TransferQueueFamilyIndex = g_GraphicsQueueFamilyIndex;
 
-        pfn_vkUnmapMemory(g_LogicalDevice, g_StagingBufferDeviceMemory);
+        if (g_GraphicsQueueFamilyIndex != -1)
+            g_TimestampValidBits = familyProperties[g_GraphicsQueueFamilyIndex].timestampValidBits;
 
+        free(familyProperties);
     }
 
-    printInfoMsg("vertex staging buffer OK.\n");
-
-    //vertex buffer
+    if (g_GraphicsQueueFamilyIndex == -1)
     {
-        VkBufferCreateInfo vertexBufferCreateInfo ={0};
-
-        vertexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	    vertexBufferCreateInfo.size = sizeof vertices;
-	    vertexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	    vertexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	    vertexBufferCreateInfo.queueFamilyIndexCount = 0;
-	    vertexBufferCreateInfo.pQueueFamilyIndices = NULL;
-
-	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
-            &vertexBufferCreateInfo, NULL, &g_VertexBuffer);
-
-	    if (result != VK_SUCCESS)
-        {
-		    printErrorMsg("vertex buffer, vkCreateBuffer().\n");
-		    return false;
-        }
+        printErrorMsg("no Queue Family with VkQueue Graphics Transfer Bit.\n");
+        return false;
+    }
 
-        VkMemoryRequirements vertexBufferMemoryRequirements = {0};
+    if (g_PresentQueueFamilyIndex == -1)
+    {
+        printErrorMsg("no Queue Family with Present Queue.\n");
+        return false;
+    }
 
-        pfn_vkGetBufferMemoryRequirements(g_LogicalDevice,
-            g_VertexBuffer, &vertexBufferMemoryRequirements);
+    if (g_TransferQueueFamilyIndex == -1)
+    {
+        printErrorMsg("no Queue Family with Transfer Bit.\n");
+        return false;
+    }
 
-        printInfoMsg("Buffer Memory Requirements size: %zu\n",
-            vertexBufferMemoryRequirements.size );
-        printInfoMsg("Buffer Memory Requirements alignment: %zu\n",
-            vertexBufferMemoryRequirements.alignment );
+    printInfoMsg("Graphics Bit on Queue Family [%d]\n", g_GraphicsQueueFamilyIndex);
+    printInfoMsg("Present Queue on Queue Family [%d]\n", g_PresentQueueFamilyIndex);
+    printInfoMsg("Transfer Queue on Queue Family [%d]\n", g_TransferQueueFamilyIndex);
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+    startupPhaseBegin("device creation");
 
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = NULL;
-        memoryAllocateInfo.allocationSize = vertexBufferMemoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 0;
+    //create logical device
+    {
+        //one queue from each distinct family: graphics, present, transfer
+        int32_t queueFamilies[3] = {g_GraphicsQueueFamilyIndex, g_PresentQueueFamilyIndex,
+            g_TransferQueueFamilyIndex};
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+        VkDeviceQueueCreateInfo queueCreateInfo[3];
 
-        pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &memoryProperties);
+        memset( queueCreateInfo, 0, sizeof queueCreateInfo);
 
-        bool flag = false;
+        float queuePriority = 1.0f;
 
-        VkMemoryPropertyFlags properties_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        uint32_t queueInfoCount = 0;
 
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+        for (uint32_t i = 0; i < 3; ++i)
         {
-            VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+            bool duplicate = false;
 
-            if( vertexBufferMemoryRequirements.memoryTypeBits & (1 << i) )
+            for (uint32_t j = 0; j < queueInfoCount; ++j)
             {
-                if ( (memoryType.propertyFlags & properties_flags) == properties_flags )
-                {
-                    memoryAllocateInfo.memoryTypeIndex = i;
-                    flag = true;
-                    break;
-                }   
+                if (queueCreateInfo[j].queueFamilyIndex == (uint32_t)queueFamilies[i]) duplicate = true;
             }
-        }
 
-        if (!flag)
-        {
-		    printErrorMsg("vertex buffer, failed to find suitable memory type!\n");
-		    return false;
-        }
+            if (duplicate) continue;
 
-        result = pfn_vkAllocateMemory(g_LogicalDevice,
-            &memoryAllocateInfo, NULL, &g_VertexBufferDeviceMemory);
+            queueCreateInfo[queueInfoCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo[queueInfoCount].pNext = NULL;
+            queueCreateInfo[queueInfoCount].queueFamilyIndex = queueFamilies[i];
+            queueCreateInfo[queueInfoCount].queueCount = 1;
+            queueCreateInfo[queueInfoCount].pQueuePriorities = &queuePriority;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("unable to allocate device memory (1)\n");
-            return false;
+            queueInfoCount++;
         }
 
-        printInfoMsg("vertex buffer vkAllocateMemory OK.\n");
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {0};
 
-        result = pfn_vkBindBufferMemory(g_LogicalDevice,
-            g_VertexBuffer, g_VertexBufferDeviceMemory, 0);
+        timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
 
-	    if (result != VK_SUCCESS)
+        VkDeviceCreateInfo deviceCreateInfo = {0};
+
+        deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceCreateInfo.pNext = g_TimelineSemaphoreSupported ? &timelineSemaphoreFeatures : NULL;
+        deviceCreateInfo.queueCreateInfoCount = queueInfoCount;
+        deviceCreateInfo.pQueueCreateInfos = queueCreateInfo;
+        deviceCreateInfo.enabledLayerCount = g_DeviceLayersArrayCount;
+        if (g_DeviceLayersArrayCount) deviceCreateInfo.ppEnabledLayerNames =
+            (const char* const*) g_DeviceLayersArray;
+        else deviceCreateInfo.ppEnabledLayerNames = NULL;
+        deviceCreateInfo.enabledExtensionCount = g_DeviceExtArrayCount;
+        if (g_DeviceExtArrayCount) deviceCreateInfo.ppEnabledExtensionNames =
+            (const char* const*) g_DeviceExtArray;
+        else deviceCreateInfo.ppEnabledExtensionNames = NULL;
+        VkPhysicalDeviceFeatures enabledFeatures = {0};
+
+        enabledFeatures.multiDrawIndirect = g_MultiDrawIndirect ? VK_TRUE : VK_FALSE;
+        enabledFeatures.drawIndirectFirstInstance = g_DrawIndirectFirstInstance ? VK_TRUE : VK_FALSE;
+
+        deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+
+        VkResult result = pfn_vkCreateDevice( g_SelectedPhysicalDevice,
+            &deviceCreateInfo, NULL, &g_LogicalDevice);
+
+        if (result != VK_SUCCESS)
         {
-            printErrorMsg("vertex buffer vkBindBufferMemory().\n");
+            printErrorMsg("failed to create logical device.\n");
             return false;
         }
+    }
 
-        printInfoMsg("vertex buffer vkBindBufferMemory OK.\n");
+    printInfoMsg("Create Logical Device. OK.\n");
 
+    //get device level fnc address
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDevice);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkGetDeviceQueue);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateSemaphore);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroySemaphore);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateFence);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkResetFences);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkWaitForFences);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyFence);
+    if (!g_Headless)
+    {
+        GET_DEVICE_LEVEL_FUN_ADDR(vkCreateSwapchainKHR);
+        GET_DEVICE_LEVEL_FUN_ADDR(vkDestroySwapchainKHR);
+        GET_DEVICE_LEVEL_FUN_ADDR(vkGetSwapchainImagesKHR);
+        GET_DEVICE_LEVEL_FUN_ADDR(vkAcquireNextImageKHR);
+        GET_DEVICE_LEVEL_FUN_ADDR(vkQueuePresentKHR);
+    }
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateImage);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyImage);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkGetImageMemoryRequirements);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkBindImageMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateImageView);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyImageView);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateRenderPass);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyRenderPass);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateFramebuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyFramebuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkGetBufferMemoryRequirements);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkBindBufferMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkMapMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkUnmapMemory);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateCommandPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyCommandPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateCommandBuffers);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeCommandBuffers);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkResetCommandPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdExecuteCommands);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateShaderModule);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyShaderModule);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateDescriptorSetLayout);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDescriptorSetLayout);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateDescriptorPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyDescriptorPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkAllocateDescriptorSets);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkUpdateDescriptorSets);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkFreeDescriptorSets);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreatePipelineLayout);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyPipelineLayout);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateGraphicsPipelines);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyPipeline);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreatePipelineCache);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyPipelineCache);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkGetPipelineCacheData);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkBeginCommandBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBeginRenderPass);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindPipeline);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindDescriptorSets);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindVertexBuffers);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdBindIndexBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdEndRenderPass);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkEndCommandBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkQueueSubmit);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDraw);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDrawIndexed);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDrawIndexedIndirect);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateComputePipelines);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDispatch);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdFillBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdPushConstants);
+    if (g_DrawIndirectCountSupported)
+    {
+        GET_DEVICE_LEVEL_FUN_ADDR(vkCmdDrawIndexedIndirectCountKHR);
+    }
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdSetViewport);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdSetScissor);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDeviceWaitIdle);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdCopyBuffer);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkQueueWaitIdle);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCreateQueryPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkDestroyQueryPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkGetQueryPoolResults);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdResetQueryPool);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdWriteTimestamp);
+    GET_DEVICE_LEVEL_FUN_ADDR(vkCmdPipelineBarrier);
+    if (g_TimelineSemaphoreSupported)
+    {
+        GET_DEVICE_LEVEL_FUN_ADDR(vkGetSemaphoreCounterValue);
+        GET_DEVICE_LEVEL_FUN_ADDR(vkWaitSemaphores);
     }
 
-    printInfoMsg("vertex buffer OK.\n");
+    //get device queues
+    pfn_vkGetDeviceQueue(g_LogicalDevice, g_GraphicsQueueFamilyIndex, 0, &g_GraphicsQueue);
 
-    //copy the data from the vertex staging buffer to the vertex buffer
+    if (g_GraphicsQueueFamilyIndex != g_PresentQueueFamilyIndex)
+    {
+        pfn_vkGetDeviceQueue(g_LogicalDevice, g_PresentQueueFamilyIndex, 0, &g_PresentQueue);
+    }
+    else
     {
-        VkCommandPool commandPool = 0;
+        g_PresentQueue = g_GraphicsQueue;
+    }
 
-        VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
+    if (g_TransferQueueFamilyIndex != g_GraphicsQueueFamilyIndex)
+    {
+        pfn_vkGetDeviceQueue(g_LogicalDevice, g_TransferQueueFamilyIndex, 0, &g_TransferQueue);
+    }
+    else
+    {
+        g_TransferQueue = g_GraphicsQueue;
+    }
 
-        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    //worker threads, shader modules are built while the rest is set up
+    {
+        createWorkers(g_WorkerThreadCount);
 
-        VkResult result  = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &commandPool);
+        const char *shaderFileNames[] = {vertexShaderFileName, fragmentShaderFileName};
+        VkShaderModule *shaderModules[] = {&g_vertShaderModule, &g_fragShaderModule};
 
-        if (result != VK_SUCCESS)
+        for (uint32_t i = 0; i < 2; ++i)
         {
-            printErrorMsg("cannot create CommandPool for copying.\n");
-            return false;
+            g_ShaderModuleJobs[i].fileName = shaderFileNames[i];
+            g_ShaderModuleJobs[i].module = shaderModules[i];
+            g_ShaderModuleJobs[i].ok = false;
+
+            if (!submitJob(shaderModuleJob, &g_ShaderModuleJobs[i], &g_ShaderJobCounter)) return false;
         }
+    }
+
+    //create semaphores
+    {
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {0};
 
-        VkCommandBuffer commandBuffer = NULL;
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+        for(uint32_t i = 0; i < g_FramesInFlight; ++i)
+        {
+            VkResult result = pfn_vkCreateSemaphore (g_LogicalDevice, &semaphoreCreateInfo,
+                NULL, &g_semaphoreImageAvailableArr[i]);
 
-        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        commandBufferAllocateInfo.commandPool = commandPool;
-        commandBufferAllocateInfo.commandBufferCount = 1;
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("cannot create semaphore (image available) [%d].\n", i);
+                return false;
+            }
+
+            result = pfn_vkCreateSemaphore (g_LogicalDevice, &semaphoreCreateInfo, NULL,
+                &g_semaphoreRenderFinishedArr[i]);
+
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("cannot create semaphore (render finished) [%d].\n", i);
+                return false;
+            }
+        }
+    }
 
-        result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo, &commandBuffer);
+    printInfoMsg("create semaphores: OK.\n");
 
-        if (result != VK_SUCCESS)
+    //create fences
+    {
+        for ( uint32_t i = 0; i < g_FramesInFlight; ++i )
         {
-			printErrorMsg("cannot allocate Command Buffers (copying).\n");
-			return false;
-		}
+            VkFenceCreateInfo fenceCreateInfo = {0};
+            fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
-        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            VkResult result = pfn_vkCreateFence( g_LogicalDevice, &fenceCreateInfo, NULL, &fenceArr[i]);
 
-        pfn_vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("cannot create fence. [%d].\n", i);
+                return false;
+            }
+    }
+    }
 
-        VkBufferCopy bufferCopy = {0};
-        bufferCopy.srcOffset = 0;
-        bufferCopy.dstOffset = 0;
-        bufferCopy.size = sizeof vertices;
+    printInfoMsg("create fences: OK, frames in flight %u.\n", g_FramesInFlight);
 
-        pfn_vkCmdCopyBuffer( commandBuffer, g_StagingBuffer, g_VertexBuffer, 1, &bufferCopy);
+    startupPhaseBegin("swapchain");
 
-        pfn_vkEndCommandBuffer(commandBuffer);
+    //get surface capabilities
 
-        VkSubmitInfo submitInfo = {0};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {0};
 
-        pfn_vkQueueSubmit(g_TransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        pfn_vkQueueWaitIdle(g_TransferQueue);
+    if (!g_Headless)
+    {
+        VkResult result = pfn_vkGetPhysicalDeviceSurfaceCapabilitiesKHR(g_SelectedPhysicalDevice,
+            g_Surface, &surfaceCapabilities );
 
-        if(commandBuffer)
+        if (result != VK_SUCCESS)
         {
-            pfn_vkFreeCommandBuffers(g_LogicalDevice, commandPool, 1, &commandBuffer);
-            printInfoMsg("free commandBuffer (copying)\n");
+            printErrorMsg("vkGetPhysicalDeviceSurfaceCapabilitiesKHR().\n");
+            return false;
         }
 
-        if (commandPool && pfn_vkDestroyCommandPool)
-        {
-            pfn_vkDestroyCommandPool( g_LogicalDevice, commandPool, NULL );
-            printInfoMsg("destroy commandPool (copying)\n");
-        }
+        printInfoMsg("surfaceCapabilities.minImageCount %d\n",surfaceCapabilities.minImageCount);
+        printInfoMsg("surfaceCapabilities.maxImageCount %d\n",surfaceCapabilities.maxImageCount);
+        printInfoMsg("surfaceCapabilities.currentExtent.width %d\n",surfaceCapabilities.currentExtent.width);
+        printInfoMsg("surfaceCapabilities.currentExtent.height %d\n",surfaceCapabilities.currentExtent.height);
+        printInfoMsg("surfaceCapabilities.minImageExtent.width %d\n",surfaceCapabilities.minImageExtent.width);
+        printInfoMsg("surfaceCapabilities.minImageExtent.height %d\n",surfaceCapabilities.minImageExtent.height);
+        printInfoMsg("surfaceCapabilities.maxImageExtent.width %d\n",surfaceCapabilities.maxImageExtent.width);
+        printInfoMsg("surfaceCapabilities.maxImageExtent.height %d\n",surfaceCapabilities.maxImageExtent.height);
+        printInfoMsg("surfaceCapabilities.maxImageArrayLayers %d\n",surfaceCapabilities.maxImageArrayLayers);
 
-        if (g_StagingBuffer && pfn_vkDestroyBuffer)
-        {
-            pfn_vkDestroyBuffer(g_LogicalDevice,g_StagingBuffer,NULL);
-            g_StagingBuffer = NULL;
-            printInfoMsg("destroy staging buffer\n");
-        }
+        printInfoMsg("surfaceCapabilities.supportedTransforms:\n");
+        print_VkSurfaceTransformFlagBitsKHR(surfaceCapabilities.supportedTransforms);
 
-        if (g_StagingBufferDeviceMemory && pfn_vkFreeMemory)
-        {
-            pfn_vkFreeMemory(g_LogicalDevice, g_StagingBufferDeviceMemory, NULL);
-            g_StagingBufferDeviceMemory = VK_NULL_HANDLE;
-            printInfoMsg("free staging buffer memory\n");
-        }
+        printInfoMsg("surfaceCapabilities.currentTransform:\n");
+        print_VkSurfaceTransformFlagBitsKHR(surfaceCapabilities.currentTransform);
+
+        printInfoMsg("surfaceCapabilities.supportedCompositeAlpha:\n");
+        print_VkCompositeAlphaFlagBitsKHR(surfaceCapabilities.supportedCompositeAlpha);
+
+        printInfoMsg("surfaceCapabilities.supportedUsageFlags:\n");
+        print_VkImageUsageFlagBits(surfaceCapabilities.supportedUsageFlags);
 
     }
 
-    //index staging buffer
+    //get surface formats
+    if (!g_Headless)
     {
-        VkBufferCreateInfo stagingBufferCreateInfo ={0};
-
-        stagingBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        stagingBufferCreateInfo.size = sizeof indices;
-        stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        stagingBufferCreateInfo.queueFamilyIndexCount = 0;
-	    stagingBufferCreateInfo.pQueueFamilyIndices = NULL;
+        uint32_t surfaceFormatCount = 0;
 
-	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
-            &stagingBufferCreateInfo, NULL, &g_StagingBuffer);
+        VkResult result = pfn_vkGetPhysicalDeviceSurfaceFormatsKHR(g_SelectedPhysicalDevice,
+            g_Surface, &surfaceFormatCount, NULL);
 
-	    if (result != VK_SUCCESS)
+        if (result != VK_SUCCESS)
         {
-		    printErrorMsg("staging buffer, vkCreateBuffer().\n");
-		    return false;
+            printErrorMsg("vkGetPhysicalDeviceSurfaceFormatsKHR() (1).\n");
+            return false;
         }
 
-        VkMemoryRequirements stagingBufferMemoryRequirements = {0};
+        printInfoMsg("surface format count %d\n",surfaceFormatCount);
 
-        pfn_vkGetBufferMemoryRequirements(g_LogicalDevice,
-            g_StagingBuffer, &stagingBufferMemoryRequirements);
+        if (surfaceFormatCount>0)
+        {
 
-        printInfoMsg("Staging Buffer Memory Requirements size: %zu\n",
-            stagingBufferMemoryRequirements.size );
-        printInfoMsg("Staging Buffer Memory Requirements alignment: %zu\n",
-            stagingBufferMemoryRequirements.alignment );
+            VkSurfaceFormatKHR* surfaceFormats =
+                (VkSurfaceFormatKHR*) malloc(surfaceFormatCount * sizeof(VkSurfaceFormatKHR));
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+            if (surfaceFormats==NULL)
+            {
+                printErrorMsg("unable to allocate memory (12)\n");
+                return false;
+            }
 
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = NULL;
-        memoryAllocateInfo.allocationSize = stagingBufferMemoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 0;
+            result = pfn_vkGetPhysicalDeviceSurfaceFormatsKHR(g_SelectedPhysicalDevice,
+                g_Surface, &surfaceFormatCount, surfaceFormats);
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+            if (result != VK_SUCCESS)
+            {
+                free(surfaceFormats);
+                printErrorMsg("vkGetPhysicalDeviceSurfaceFormatsKHR() (2).\n");
+                return false;
+            }
 
-        pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &memoryProperties);
+            printInfoMsg("SurfaceFormats:\n");
 
-        bool flag = false;
+            for (uint32_t i = 0; i < surfaceFormatCount; ++i)
+            {
+                printf("\tformat (%d): %s\n", i, str_VkFormat(surfaceFormats[i].format));
+                printf("\tcolor space (%d): %s\n", i,
+                    str_VkColorSpaceKHR(surfaceFormats[i].colorSpace));
+            }
 
-        VkMemoryPropertyFlags properties_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            //choose SwapChain Surface Format
 
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-        {
-            VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+            if (surfaceFormatCount == 1 && surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
+            {
+                g_SurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
+                g_SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+            }
 
-            if( stagingBufferMemoryRequirements.memoryTypeBits & (1 << i) )
+            for (uint32_t i = 0; i < surfaceFormatCount; ++i)
             {
-                if ( (memoryType.propertyFlags & properties_flags) == properties_flags )
+                if (surfaceFormats[i].format == VK_FORMAT_B8G8R8A8_UNORM &&
+                    surfaceFormats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
                 {
-                    memoryAllocateInfo.memoryTypeIndex = i;
-                    flag = true;
-                    break;
-                }   
+                    g_SurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
+                    g_SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+                }
             }
-        }
 
-        if (!flag)
-        {
-		    printErrorMsg("staging buffer, failed to find suitable memory type!\n");
-		    return false;
+            printInfoMsg("g_SurfaceFormat.format: %s\n",str_VkFormat(g_SurfaceFormat.format));
+            printInfoMsg("g_SurfaceFormat.colorSpace: %s\n",str_VkColorSpaceKHR(g_SurfaceFormat.colorSpace));
+
+            free(surfaceFormats);
         }
+    }
+
+    //present modes
+    if (!g_Headless)
+    {
+        uint32_t presentModeCount = 0;
 
-        result = pfn_vkAllocateMemory(g_LogicalDevice,
-            &memoryAllocateInfo, NULL, &g_StagingBufferDeviceMemory);
+        VkResult result = pfn_vkGetPhysicalDeviceSurfacePresentModesKHR(g_SelectedPhysicalDevice,
+            g_Surface, &presentModeCount, NULL);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg("unable to allocate device memory (3)\n");
+            printErrorMsg("vkGetPhysicalDeviceSurfacePresentModesKHR (1).\n");
             return false;
         }
 
-        printInfoMsg("staging buffer vkAllocateMemory OK.\n");
-
-        result = pfn_vkBindBufferMemory(g_LogicalDevice,
-            g_StagingBuffer, g_StagingBufferDeviceMemory, 0);
+        printInfoMsg("present mode count %d\n",presentModeCount);
 
-	    if (result != VK_SUCCESS)
+        if (presentModeCount>0)
         {
-            printErrorMsg("staging buffer vkBindBufferMemory().\n");
-            return false;
-        }
 
-        printInfoMsg("staging buffer vkBindBufferMemory OK.\n");
-
-        void* mapMem;
+            VkPresentModeKHR* presentModes =
+                (VkPresentModeKHR*) malloc(presentModeCount * sizeof(VkPresentModeKHR));
 
-        result = pfn_vkMapMemory(g_LogicalDevice,
-            g_StagingBufferDeviceMemory, 0, VK_WHOLE_SIZE, 0, &mapMem);
+            if (presentModes==NULL)
+            {
+                printErrorMsg("unable to allocate memory (13)\n");
+                return false;
+            }
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("staging buffer vkMapMemory.\n");
-            return false;
-        }
+            result = pfn_vkGetPhysicalDeviceSurfacePresentModesKHR(g_SelectedPhysicalDevice,
+                g_Surface, &presentModeCount, presentModes);
 
-        printInfoMsg("staging buffer vkMapMemory OK.\n");
+            if (result != VK_SUCCESS)
+            {
+                free(presentModes);
+                printErrorMsg("vkGetPhysicalDeviceSurfacePresentModesKHR (2).\n");
+                return false;
+            }
 
-        memcpy(mapMem,indices,sizeof indices);
+            printInfoMsg("Present modes:\n");
 
-        pfn_vkUnmapMemory(g_LogicalDevice, g_StagingBufferDeviceMemory);
-    }
+            for (uint32_t i = 0; i < presentModeCount; ++i)
+            {
+                printf("\t%s\n",str_VkPresentModeKHR(presentModes[i]));
+            }
 
-    printInfoMsg("index staging buffer OK.\n");
+            //here g_PresentMode is VK_PRESENT_MODE_FIFO_KHR, it is always supported
 
-    //index buffer
-    {
-        VkBufferCreateInfo indexBufferCreateInfo ={0};
+            //choose SwapChain Present Mode, first supported one of the fallback chain
 
-        indexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        indexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-        indexBufferCreateInfo.size = sizeof indices;
-	    indexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	    indexBufferCreateInfo.queueFamilyIndexCount = 0;
-	    indexBufferCreateInfo.pQueueFamilyIndices = NULL;
+            VkPresentModeKHR fallbackChain[3];
+            uint32_t fallbackCount = 0;
 
-	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
-            &indexBufferCreateInfo, NULL, &g_IndexBuffer);
+            if (!g_PresentModeRequested || g_RequestedPresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+            {
+                fallbackChain[fallbackCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+                fallbackChain[fallbackCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            else if (g_RequestedPresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+            {
+                fallbackChain[fallbackCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                fallbackChain[fallbackCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            else if (g_RequestedPresentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR)
+            {
+                fallbackChain[fallbackCount++] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
 
-	    if (result != VK_SUCCESS)
-        {
-		    printErrorMsg("index buffer, vkCreateBuffer().\n");
-		    return false;
-        }
+            fallbackChain[fallbackCount++] = VK_PRESENT_MODE_FIFO_KHR;
 
-        VkMemoryRequirements indexBufferMemoryRequirements = {0};
+            for (uint32_t j = 0; j < fallbackCount; ++j)
+            {
+                bool supported = false;
 
-        pfn_vkGetBufferMemoryRequirements(g_LogicalDevice,
-            g_IndexBuffer, &indexBufferMemoryRequirements);
+                for (uint32_t i = 0; i < presentModeCount; ++i)
+                {
+                    if (presentModes[i] == fallbackChain[j]) supported = true;
+                }
 
-        printInfoMsg("Buffer Memory Requirements size: %zu\n",
-            indexBufferMemoryRequirements.size );
-        printInfoMsg("Buffer Memory Requirements alignment: %zu\n",
-            indexBufferMemoryRequirements.alignment );
+                if (supported)
+                {
+                    g_PresentMode = fallbackChain[j];
+                    break;
+                }
+            }
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+            if (g_PresentModeRequested && g_PresentMode != g_RequestedPresentMode)
+            {
+                printWarningMsg("requested present mode %s is not supported, falling back.\n",
+                    str_VkPresentModeKHR(g_RequestedPresentMode));
+            }
 
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = NULL;
-        memoryAllocateInfo.allocationSize = indexBufferMemoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 0;
+            printInfoMsg("g_PresentMode: %s\n",str_VkPresentModeKHR(g_PresentMode));
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+            free(presentModes);
+        }
+    }
 
-        pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &memoryProperties);
+    //swapchain, images
+    if (g_Headless)
+    {
+        g_SwapChainExtent.width = g_Width;
+        g_SwapChainExtent.height = g_Height;
 
-        bool flag = false;
+        printInfoMsg("SwapChain Extent width: %d\n", g_SwapChainExtent.width);
+        printInfoMsg("SwapChain Extent height: %d\n", g_SwapChainExtent.height);
 
-        VkMemoryPropertyFlags properties_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (!createOffscreenImages()) return false;
+    }
+    else if (!createSwapChain(VK_NULL_HANDLE))
+    {
+        return false;
+    }
 
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-        {
-            VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+    //image views
+    if (!createImageViews()) return false;
 
-            if( indexBufferMemoryRequirements.memoryTypeBits & (1 << i) )
-            {
-                if ( (memoryType.propertyFlags & properties_flags) == properties_flags )
-                {
-                    memoryAllocateInfo.memoryTypeIndex = i;
-                    flag = true;
-                    break;
-                }   
-            }
-        }
+    printInfoMsg("create image view OK.\n");
 
-        if (!flag)
-        {
-		    printErrorMsg("index buffer, failed to find suitable memory type!\n");
-		    return false;
-        }
+    //render pass
+    {
+        if (!chooseDepthFormat()) return false;
 
-        result = pfn_vkAllocateMemory(g_LogicalDevice,
-            &memoryAllocateInfo, NULL, &g_IndexBufferDeviceMemory);
+        chooseMsaaSamples();
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("unable to allocate device memory (1)\n");
-            return false;
-        }
+        bool msaa = g_MsaaSamples != VK_SAMPLE_COUNT_1_BIT;
 
-        printInfoMsg("index buffer vkAllocateMemory OK.\n");
+        VkAttachmentDescription attachmentDescription[3] = {0};
 
-        result = pfn_vkBindBufferMemory(g_LogicalDevice,
-            g_IndexBuffer, g_IndexBufferDeviceMemory, 0);
+        //with msaa the swapchain image is the resolve attachment, fully overwritten so never loaded
+        VkAttachmentDescription *presentAttachment = msaa ? &attachmentDescription[2] : &attachmentDescription[0];
 
-	    if (result != VK_SUCCESS)
-        {
-            printErrorMsg("index buffer vkBindBufferMemory().\n");
-            return false;
+        presentAttachment->format = VK_FORMAT_B8G8R8A8_UNORM;
+        presentAttachment->samples = VK_SAMPLE_COUNT_1_BIT;
+        presentAttachment->loadOp = msaa ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        presentAttachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        presentAttachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        presentAttachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        presentAttachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (g_Headless)
+            presentAttachment->finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        else
+            presentAttachment->finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        //the multisampled color is only needed during the pass, like the depth
+        if (msaa)
+        {
+            attachmentDescription[0].format = g_SurfaceFormat.format;
+            attachmentDescription[0].samples = g_MsaaSamples;
+            attachmentDescription[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachmentDescription[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachmentDescription[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachmentDescription[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachmentDescription[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachmentDescription[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         }
 
-        printInfoMsg("index buffer vkBindBufferMemory OK.\n");
+        //depth is only needed during the pass, it is neither loaded nor stored
+        attachmentDescription[1].format = g_DepthFormat;
+        attachmentDescription[1].samples = g_MsaaSamples;
+        attachmentDescription[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachmentDescription[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachmentDescription[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachmentDescription[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachmentDescription[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachmentDescription[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    }
+        VkAttachmentReference attachmentReference = {0};
 
-    printInfoMsg("index buffer OK.\n");
+        attachmentReference.attachment = 0;
+        attachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    //copy the data from the index staging buffer to the index buffer
-    {
-        VkCommandPool commandPool = 0;
+        VkAttachmentReference depthAttachmentReference = {0};
 
-        VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
+        depthAttachmentReference.attachment = 1;
+        depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        VkAttachmentReference resolveAttachmentReference = {0};
 
-        VkResult result  = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &commandPool);
+        resolveAttachmentReference.attachment = 2;
+        resolveAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("cannot create CommandPool for copying.\n");
-            return false;
-        }
+        VkSubpassDescription subpass = {0};
 
-        VkCommandBuffer commandBuffer = NULL;
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &attachmentReference;
+        subpass.pDepthStencilAttachment = &depthAttachmentReference;
+        subpass.pResolveAttachments = msaa ? &resolveAttachmentReference : NULL;
+
+        //the layout transition waits for the image available semaphore,
+        //the depth clear waits for the depth writes of the previous frame, the depth buffer is shared,
+        //so is the msaa color image, its clear waits for the color writes and the resolve of that frame
+        VkSubpassDependency subpassDependency = {0};
+
+        subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        subpassDependency.dstSubpass = 0;
+        subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        subpassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            (msaa ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0);
+        subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+        VkRenderPassCreateInfo renderPassCreateInfo = {0};
 
-        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        commandBufferAllocateInfo.commandPool = commandPool;
-        commandBufferAllocateInfo.commandBufferCount = 1;
+        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCreateInfo.attachmentCount = msaa ? 3 : 2;
+        renderPassCreateInfo.pAttachments = attachmentDescription;
+        renderPassCreateInfo.subpassCount = 1;
+        renderPassCreateInfo.pSubpasses = &subpass;
+        renderPassCreateInfo.dependencyCount = 1;
+        renderPassCreateInfo.pDependencies = &subpassDependency;
 
-        result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo, &commandBuffer);
+        VkResult result = pfn_vkCreateRenderPass(g_LogicalDevice,
+            &renderPassCreateInfo, NULL, &g_RenderPass);
 
-        if (result != VK_SUCCESS)
+		if (result != VK_SUCCESS)
         {
-			printErrorMsg("cannot allocate Command Buffers (copying).\n");
+			printErrorMsg("cannot create Render Pass.\n");
 			return false;
 		}
+    }
 
-        VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
-        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    printInfoMsg("create Render Pass OK.\n");
 
-        pfn_vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+    //framebuffer
+    if (!createFrameBuffers()) return false;
 
-        VkBufferCopy bufferCopy = {0};
-        bufferCopy.srcOffset = 0;
-        bufferCopy.dstOffset = 0;
-        bufferCopy.size = sizeof indices;
+    printInfoMsg("create framebuffer OK.\n");
 
-        pfn_vkCmdCopyBuffer( commandBuffer, g_StagingBuffer, g_IndexBuffer, 1, &bufferCopy);
+    //the meshes face the camera, which looks down +z
+    static const Vertex vertices[] = {
+	    {-0.5f,-0.433f,0.0f,1.0f,1.0f,0.0f,0.0f,0.0f,0.0f,-1.0f},
+	    {0.5f,0.433f,0.0f,1.0f,0.0f,1.0f,0.0f,0.0f,0.0f,-1.0f},
+	    {-0.5f,0.433f,0.0f,1.0f,0.0f,0.0f,1.0f,0.0f,0.0f,-1.0f},
+        {0.5f,-0.433f,0.0f,1.0f,1.0f,1.0f,0.0f,0.0f,0.0f,-1.0f}
+	};
 
-        pfn_vkEndCommandBuffer(commandBuffer);
+    //uint16_t max. val 65535 , vkCmdBindIndexBuffer VK_INDEX_TYPE_UINT16
+    //uint32_t max. val 4294967295 , vkCmdBindIndexBuffer VK_INDEX_TYPE_UINT32
+    //indices are local to a mesh, vertexOffset of the draw selects its vertices in the mega buffer
+    static const uint16_t indices[] = {0,1,2,0,3,1};
 
-        VkSubmitInfo submitInfo = {0};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    static const Vertex triangleVertices[] = {
+        {0.0f,-0.433f,0.0f,1.0f,1.0f,0.5f,0.0f,0.0f,0.0f,-1.0f},
+        {0.5f,0.433f,0.0f,1.0f,0.0f,1.0f,0.5f,0.0f,0.0f,-1.0f},
+        {-0.5f,0.433f,0.0f,1.0f,0.5f,0.0f,1.0f,0.0f,0.0f,-1.0f}
+    };
 
-        pfn_vkQueueSubmit(g_TransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        pfn_vkQueueWaitIdle(g_TransferQueue);
+    static const uint16_t triangleIndices[] = {0,1,2};
 
-        if(commandBuffer)
-        {
-            pfn_vkFreeCommandBuffers(g_LogicalDevice, commandPool, 1, &commandBuffer);
-            printInfoMsg("free commandBuffer (copying)\n");
-        }
+    startupPhaseBegin("uploads");
 
-        if (commandPool && pfn_vkDestroyCommandPool)
-        {
-            pfn_vkDestroyCommandPool( g_LogicalDevice, commandPool, NULL );
-            printInfoMsg("destroy commandPool (copying)\n");
-        }
+    //upload engine
+    if (!createUploadEngine()) return false;
 
-        if (g_StagingBuffer && pfn_vkDestroyBuffer)
-        {
-            pfn_vkDestroyBuffer(g_LogicalDevice,g_StagingBuffer,NULL);
-            g_StagingBuffer = NULL;
-            printInfoMsg("destroy staging buffer\n");
-        }
+    //the mesh file decides the vertex format and index type before the buffers exist
+    if (g_MeshFileName && !openMeshFile()) return false;
 
-        if (g_StagingBufferDeviceMemory && pfn_vkFreeMemory)
-        {
-            pfn_vkFreeMemory(g_LogicalDevice, g_StagingBufferDeviceMemory, NULL);
-            g_StagingBufferDeviceMemory = VK_NULL_HANDLE;
-            printInfoMsg("free staging buffer memory\n");
-        }
-    }
+    if (!chooseVertexFormat()) return false;
 
-    //command pool
+    //vertex buffer
     {
-        VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
+        VkBufferCreateInfo vertexBufferCreateInfo ={0};
 
-        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        commandPoolCreateInfo.queueFamilyIndex = g_GraphicsQueueFamilyIndex;
+        vertexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	    vertexBufferCreateInfo.size = g_MegaVertexBufferSize;
+	    vertexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	    vertexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	    vertexBufferCreateInfo.queueFamilyIndexCount = 0;
+	    vertexBufferCreateInfo.pQueueFamilyIndices = NULL;
 
-        VkResult result  = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &g_CommandPool);
+	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
+            &vertexBufferCreateInfo, NULL, &g_VertexBuffer);
 
-        if (result != VK_SUCCESS)
+	    if (result != VK_SUCCESS)
         {
-            printErrorMsg("cannot create CommandPool.\n");
+		    printErrorMsg("vertex buffer, vkCreateBuffer().\n");
+		    return false;
+        }
+
+        if (!allocateBufferMemory(g_VertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &g_VertexBufferMemory))
+        {
+            printErrorMsg("vertex buffer, unable to allocate memory.\n");
             return false;
         }
 
+        printInfoMsg("vertex buffer memory OK, offset %zu.\n", (size_t)g_VertexBufferMemory.offset);
+
     }
 
-    printInfoMsg("create CommandPool OK.\n");
+    printInfoMsg("vertex buffer OK.\n");
 
-    //command buffers
+    //index buffer
     {
-        g_CommandBuffers = malloc(g_SwapChainImageCount * sizeof(VkCommandBuffer));
+        VkBufferCreateInfo indexBufferCreateInfo ={0};
 
-        if(!g_CommandBuffers)
-        {
-            printErrorMsg("unable to allocate memory (22).\n");
-			return false;
-        }
+        indexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        indexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        indexBufferCreateInfo.size = g_MegaIndexBufferSize;
+	    indexBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	    indexBufferCreateInfo.queueFamilyIndexCount = 0;
+	    indexBufferCreateInfo.pQueueFamilyIndices = NULL;
 
-    }
+	    VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
+            &indexBufferCreateInfo, NULL, &g_IndexBuffer);
 
-    //allocate command buffers
-    {
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+	    if (result != VK_SUCCESS)
+        {
+		    printErrorMsg("index buffer, vkCreateBuffer().\n");
+		    return false;
+        }
 
-        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        commandBufferAllocateInfo.commandPool = g_CommandPool;
-        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        commandBufferAllocateInfo.commandBufferCount = g_SwapChainImageCount;
+        if (!allocateBufferMemory(g_IndexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &g_IndexBufferMemory))
+        {
+            printErrorMsg("index buffer, unable to allocate memory.\n");
+            return false;
+        }
 
-        VkResult result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo, g_CommandBuffers);
+        printInfoMsg("index buffer memory OK, offset %zu.\n", (size_t)g_IndexBufferMemory.offset);
 
-        if (result != VK_SUCCESS)
-        {
-			printErrorMsg("cannot allocate Command Buffers.\n");
-			return false;
-		}
     }
 
-    printInfoMsg("allocate Command Buffers OK.\n");
+    printInfoMsg("index buffer OK.\n");
 
-    //load vertex shader
+    //instance buffer
     {
-        FILE *fp;
-        size_t fileSize;
+        //an instance range per object, indirect draws can only start past instance 0 with drawIndirectFirstInstance
+        g_PlaceObjects = g_ObjectCount > 1 && (!g_IndirectDraws || g_DrawIndirectFirstInstance);
 
-        const char path[]={"shaders/"};
+        if (g_ObjectCount > 1 && !g_PlaceObjects)
+            printWarningMsg("drawIndirectFirstInstance is not supported, all objects are drawn at the origin.\n");
 
-        char *fullPath = malloc( strlen(path) + strlen(vertexShaderFileName) + 1);
+        uint64_t instanceBufferCount = g_PlaceObjects ? (uint64_t)g_ObjectCount * g_InstanceCount : g_InstanceCount;
 
-        if(!fullPath)
+        if (instanceBufferCount > UINT32_MAX / sizeof(InstanceData))
         {
-            printErrorMsg("unable to allocate memory (19)");
+            printErrorMsg("too many instances, %llu.\n", (unsigned long long)instanceBufferCount);
             return false;
         }
 
-        sprintf(fullPath, "%s%s", path, vertexShaderFileName);
-
-        fp = fopen( fullPath , "rb");
-
-        free(fullPath);
-
-        if (!fp)
-        {
-	        printErrorMsg("cannot open file %s\n", vertexShaderFileName);
-		    return false;
-        }
-
-        fseek(fp, 0, SEEK_END);
+        g_InstanceBufferCount = (uint32_t)instanceBufferCount;
 
-        fileSize = ftell(fp);
+        VkBufferCreateInfo instanceBufferCreateInfo ={0};
 
-        fseek(fp, 0, SEEK_SET);
+        instanceBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        instanceBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        instanceBufferCreateInfo.size = g_InstanceBufferCount * sizeof(InstanceData);
+        instanceBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        printInfoMsg("%s size: %ld\n", vertexShaderFileName, fileSize);
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
+            &instanceBufferCreateInfo, NULL, &g_InstanceBuffer);
 
-        if (fileSize==0)
+        if (result != VK_SUCCESS)
         {
-	        printErrorMsg("%s size 0.\n", vertexShaderFileName);
-            fclose(fp);
-	        return false;
+            printErrorMsg("instance buffer, vkCreateBuffer().\n");
+            return false;
         }
 
-        char *vertShaderCode = malloc(fileSize);
-
-        if (!vertShaderCode)
+        if (!allocateBufferMemory(g_InstanceBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &g_InstanceBufferMemory))
         {
-	        printErrorMsg("unable to allocate memory (17)");
-            fclose(fp);
-	        return false;
+            printErrorMsg("instance buffer, unable to allocate memory.\n");
+            return false;
         }
+    }
 
-        size_t retSize = fread(vertShaderCode, 1, fileSize, fp);
+    printInfoMsg("instance buffer OK, %u instances.\n", g_InstanceBufferCount);
 
-        if (retSize!=fileSize)
+    //meshes go through the staging ring in one upload batch,
+    //nothing waits here, the graphics queue waits for the batch before the first frame
+    {
+        if (g_MeshFileName)
         {
-	        printErrorMsg("%s read error 0.\n", vertexShaderFileName);
-            fclose(fp);
-	        return false;
+            if (!addMeshFile()) return false;
         }
-
-        fclose(fp);
-
-        VkShaderModuleCreateInfo vertexShaderCreateInfo = {0};
-
-        vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        vertexShaderCreateInfo.codeSize = fileSize;
-        vertexShaderCreateInfo.pCode = (uint32_t*) vertShaderCode;
-
-        VkResult result = pfn_vkCreateShaderModule(g_LogicalDevice,
-            &vertexShaderCreateInfo,NULL,&g_vertShaderModule);
-
-        if (result != VK_SUCCESS)
+        else if (addMesh(vertices, sizeof vertices / sizeof vertices[0],
+                indices, sizeof indices / sizeof indices[0]) < 0 ||
+            addMesh(triangleVertices, sizeof triangleVertices / sizeof triangleVertices[0],
+                triangleIndices, sizeof triangleIndices / sizeof triangleIndices[0]) < 0)
         {
-            printErrorMsg("failed to create vertex shader module.\n");
-            free(vertShaderCode);
+            printErrorMsg("mesh upload.\n");
             return false;
         }
 
-        free(vertShaderCode);
-    }
+        if (!uploadInstances()) return false;
 
-    printInfoMsg("load vertex shader OK.\n");
+        if (!flushUploads()) return false;
 
-    //load fragment shader
-    {
-        FILE *fp;
-        size_t fileSize;
-        const char path[]={"shaders/"};
+        printInfoMsg("mega buffers: %u meshes, %u vertices, %u indices.\n",
+            g_MeshCount, g_MegaVertexCount, g_MegaIndexCount);
+    }
 
-        char *fullPath = malloc( strlen(path) + strlen(fragmentShaderFileName) + 1);
+    //scene draw list, --objects N draws the meshes in turn
+    {
+        g_Draws = calloc(g_ObjectCount, sizeof(VkDrawIndexedIndirectCommand));
+        g_DrawObjects = calloc(g_ObjectCount, sizeof(uint32_t));
 
-        if(!fullPath)
+        if (!g_Draws || !g_DrawObjects)
         {
-            printErrorMsg("unable to allocate memory (20)");
+            printErrorMsg("unable to allocate memory (22).\n");
             return false;
         }
 
-        sprintf(fullPath, "%s%s", path, fragmentShaderFileName);
+        uint64_t triangleCount = 0;
 
-        fp = fopen( fullPath, "rb");
+        //the first object is the quad, as before the scene had more than one
+        for (uint32_t i = 0; i < g_ObjectCount; ++i)
+        {
+            const Mesh *mesh = &g_Meshes[i % g_MeshCount];
 
-        free(fullPath);
+            g_Draws[i].indexCount = mesh->indexCount;
+            g_Draws[i].instanceCount = g_InstanceCount;
+            g_Draws[i].firstIndex = mesh->firstIndex;
+            g_Draws[i].vertexOffset = mesh->vertexOffset;
+            g_Draws[i].firstInstance = g_PlaceObjects ? i * g_InstanceCount : 0;
+            g_DrawObjects[i] = i;
 
-        if (!fp)
-        {
-	        printErrorMsg("cannot open file %s\n", fragmentShaderFileName);
-		    return false;
+            triangleCount += (uint64_t)g_InstanceCount * (mesh->indexCount / 3);
         }
 
-        fseek(fp, 0, SEEK_END);
+        g_DrawCount = g_ObjectCount;
 
-        fileSize = ftell(fp);
+        if (g_SortDraws && !sortDrawsFrontToBack()) return false;
 
-        fseek(fp, 0, SEEK_SET);
+        printInfoMsg("scene: %u draws, %u instances each, %llu triangles\n", g_DrawCount, g_InstanceCount,
+            (unsigned long long)triangleCount);
+    }
 
-        printInfoMsg("%s size: %ld\n", fragmentShaderFileName, fileSize);
+    //indirect buffer, a region of g_DrawCount commands per frame in flight
+    if (g_IndirectDraws)
+    {
+        VkBufferCreateInfo indirectBufferCreateInfo ={0};
 
-        if (fileSize==0)
-        {
-            printErrorMsg("%s size 0.\n", fragmentShaderFileName);
-            fclose(fp);
-            return false;
-        }
+        indirectBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        indirectBufferCreateInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            (g_GpuCulling ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+        indirectBufferCreateInfo.size = (VkDeviceSize)g_FramesInFlight * g_DrawCount * sizeof(VkDrawIndexedIndirectCommand);
+        indirectBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        char *fragShaderCode = malloc(fileSize);
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
+            &indirectBufferCreateInfo, NULL, &g_IndirectBuffer);
 
-        if (!fragShaderCode)
+        if (result != VK_SUCCESS)
         {
-		    printErrorMsg("unable to allocate memory (18)");
-            fclose(fp);
-		    return false;
+            printErrorMsg("indirect buffer, vkCreateBuffer().\n");
+            return false;
         }
 
-        size_t retSize = fread(fragShaderCode, 1, fileSize, fp);
-
-        if (retSize!=fileSize)
+        //written by the CPU every frame, read once by the GPU
+        if (!allocateBufferMemory(g_IndirectBuffer,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &g_IndirectBufferMemory))
         {
-	        printErrorMsg( "%s read error 0.\n", fragmentShaderFileName);
-            fclose(fp);
-	        return false;
+            printErrorMsg("indirect buffer, unable to allocate memory.\n");
+            return false;
         }
 
-        fclose(fp);
+        printInfoMsg("indirect draws OK, multi draw: %s.\n", g_MultiDrawIndirect ? "yes" : "no");
+    }
+
+    startupPhaseBegin("command buffers");
 
-        VkShaderModuleCreateInfo fragmentShaderCreateInfo = {0};
+    //command pools, buffers are re-recorded every frame and the pool is reset as a whole
+    for (uint32_t i = 0; i < g_FramesInFlight; ++i)
+    {
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
 
-        fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        fragmentShaderCreateInfo.codeSize = fileSize;
-        fragmentShaderCreateInfo.pCode = (uint32_t*) fragShaderCode;
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = g_GraphicsQueueFamilyIndex;
 
-        VkResult result = pfn_vkCreateShaderModule(g_LogicalDevice,
-            &fragmentShaderCreateInfo,NULL,&g_fragShaderModule);
+        VkResult result  = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL, &g_FrameCommandPools[i]);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg( "failed to create fragment shader module.\n");
-            free(fragShaderCode);
+            printErrorMsg("cannot create CommandPool.\n");
             return false;
         }
 
-        free(fragShaderCode);
     }
 
-    printInfoMsg("load fragment shader OK.\n");
+    printInfoMsg("create CommandPool OK.\n");
 
-    //descriptor buffer
+    //command buffers
+    if (!allocateImageFences()) return false;
+
+    //allocate command buffers
+    for (uint32_t i = 0; i < g_FramesInFlight; ++i)
     {
-        VkBufferCreateInfo descriptorBufferCreateInfo = {0};
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
 
-        descriptorBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        descriptorBufferCreateInfo.size =
-            sizeof modelMatrix + sizeof viewMatrix + sizeof projectionMatrix;
-        descriptorBufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        descriptorBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = g_FrameCommandPools[i];
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = 1;
 
-        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
-            &descriptorBufferCreateInfo,NULL,&g_DescrBuffer);
+        VkResult result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo, &g_FrameCommandBuffers[i]);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg("failed to create descriptor buffer.\n");
-            return false;
-        }
+			printErrorMsg("cannot allocate Command Buffers.\n");
+			return false;
+		}
+    }
 
-        printInfoMsg("descriptor buffer OK.\n");
+    printInfoMsg("allocate Command Buffers OK.\n");
 
-        VkMemoryRequirements descriptorBufferMemoryRequirements = {0};
+    //secondary command buffers, one pool per frame and slice
+    for (uint32_t i = 0; i < g_FramesInFlight; ++i)
+    {
+        for (uint32_t s = 0; s < g_RecordSliceCapacity; ++s)
+        {
+            VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
 
-        pfn_vkGetBufferMemoryRequirements(g_LogicalDevice,
-            g_DescrBuffer, &descriptorBufferMemoryRequirements);
+            commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            commandPoolCreateInfo.queueFamilyIndex = g_GraphicsQueueFamilyIndex;
 
-        printInfoMsg("Descriptor Memory Requirements size: %zu\n",
-            descriptorBufferMemoryRequirements.size );
-        printInfoMsg("Descriptor Memory Requirements alignment: %zu\n",
-            descriptorBufferMemoryRequirements.alignment );
+            VkResult result = pfn_vkCreateCommandPool(g_LogicalDevice, &commandPoolCreateInfo, NULL,
+                &g_RecordCommandPools[i][s]);
 
-        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("cannot create CommandPool (secondary).\n");
+                return false;
+            }
 
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.pNext = NULL;
-        memoryAllocateInfo.allocationSize = descriptorBufferMemoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 0;
+            VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+            commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferAllocateInfo.commandPool = g_RecordCommandPools[i][s];
+            commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            commandBufferAllocateInfo.commandBufferCount = 1;
 
-        pfn_vkGetPhysicalDeviceMemoryProperties(g_SelectedPhysicalDevice, &memoryProperties);
+            result = pfn_vkAllocateCommandBuffers(g_LogicalDevice, &commandBufferAllocateInfo,
+                &g_RecordCommandBuffers[i][s]);
 
-        bool flag = false;
+            if (result != VK_SUCCESS)
+            {
+                printErrorMsg("cannot allocate Command Buffers (secondary).\n");
+                return false;
+            }
+        }
+    }
 
-        VkMemoryPropertyFlags properties_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (g_RecordSliceCapacity)
+        printInfoMsg("secondary command buffers: %u per frame.\n", g_RecordSliceCapacity);
 
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    //timestamp query pool
+    if (g_GpuTiming)
+    {
+        if (!g_TimestampValidBits || g_PhysicalDeviceProperties.limits.timestampPeriod <= 0.0f)
+        {
+            printWarningMsg("timestamps are not supported on the graphics queue, GPU timing disabled.\n");
+            g_GpuTiming = false;
+        }
+        else
         {
-            VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+            VkQueryPoolCreateInfo queryPoolCreateInfo = {0};
+
+            queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCreateInfo.queryCount = g_FramesInFlight * TIMESTAMP_QUERIES_PER_FRAME;
+
+            VkResult result = pfn_vkCreateQueryPool(g_LogicalDevice, &queryPoolCreateInfo, NULL, &g_TimestampQueryPool);
 
-            if( descriptorBufferMemoryRequirements.memoryTypeBits & (1 << i) )
+            if (result != VK_SUCCESS)
             {
-                if ( (memoryType.propertyFlags & properties_flags) == properties_flags )
-                {
-                    memoryAllocateInfo.memoryTypeIndex = i;
-                    flag = true;
-                    break;
-                }   
+                printErrorMsg("cannot create timestamp query pool.\n");
+                return false;
             }
-        }
 
-        if (!flag)
-        {
-            printErrorMsg("descriptor buffer, failed to find suitable memory type!\n");
-		    return false;
+            printInfoMsg("create timestamp query pool OK, valid bits %u, period %f ns.\n",
+                g_TimestampValidBits, g_PhysicalDeviceProperties.limits.timestampPeriod);
         }
+    }
 
-        result = pfn_vkAllocateMemory(g_LogicalDevice,
-            &memoryAllocateInfo, NULL, &g_DescriptorBufferDeviceMemory);
+    startupPhaseBegin("descriptors");
 
-        if (result != VK_SUCCESS)
-        {
-            printErrorMsg("unable to allocate device memory (2).\n");
-            return false;
-        }
+    //descriptor buffer
+    {
+        VkDeviceSize uniformSize = sizeof modelMatrix + sizeof viewMatrix + sizeof projectionMatrix;
+        VkDeviceSize alignment = g_PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
 
-        printInfoMsg("descriptor buffer vkAllocateMemory OK.\n");
+        if (alignment < 1) alignment = 1;
 
-        result = pfn_vkBindBufferMemory(g_LogicalDevice,
-            g_DescrBuffer, g_DescriptorBufferDeviceMemory, 0);
+        g_UniformRingStride = (uniformSize + alignment - 1) / alignment * alignment;
+        g_UniformRingSlotCount = g_FramesInFlight;
 
-	    if (result != VK_SUCCESS)
-        {
-            printErrorMsg("descriptor buffer vkBindBufferMemory.\n");
-            return false;
-        }
+        printInfoMsg("uniform ring: %u slots, stride %zu (minUniformBufferOffsetAlignment %zu)\n",
+            g_UniformRingSlotCount, (size_t)g_UniformRingStride, (size_t)alignment);
 
-        printInfoMsg("descriptor buffer vkBindBufferMemory OK.\n");
+        VkBufferCreateInfo descriptorBufferCreateInfo = {0};
 
-        void* data;
+        descriptorBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        descriptorBufferCreateInfo.size = g_UniformRingStride * g_UniformRingSlotCount;
+        descriptorBufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        descriptorBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        result = pfn_vkMapMemory(g_LogicalDevice,
-            g_DescriptorBufferDeviceMemory, 0, VK_WHOLE_SIZE, 0, &data);
+        VkResult result = pfn_vkCreateBuffer(g_LogicalDevice,
+            &descriptorBufferCreateInfo,NULL,&g_DescrBuffer);
 
         if (result != VK_SUCCESS)
         {
-            printErrorMsg("descriptor buffer vkMapMemory.\n");
+            printErrorMsg("failed to create descriptor buffer.\n");
             return false;
         }
 
-        printInfoMsg("descriptor buffer vkMapMemory OK.\n");
+        printInfoMsg("descriptor buffer OK.\n");
+
+        if (!allocateBufferMemory(g_DescrBuffer,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &g_DescriptorBufferMemory))
+        {
+            printErrorMsg("descriptor buffer, unable to allocate memory.\n");
+            return false;
+        }
 
-        char *pMem = data;
+        printInfoMsg("descriptor buffer memory OK, offset %zu.\n", (size_t)g_DescriptorBufferMemory.offset);
 
-        memcpy(pMem, modelMatrix, sizeof modelMatrix);
-        memcpy(pMem + sizeof modelMatrix, viewMatrix, sizeof viewMatrix);
-        memcpy(pMem + sizeof modelMatrix + sizeof viewMatrix, projectionMatrix, sizeof projectionMatrix);
+        //the block stays mapped until shutdownVulkan(), memory is host coherent, no flush needed
+        g_UniformRingMapped = g_DescriptorBufferMemory.mapped;
 
-        pfn_vkUnmapMemory(g_LogicalDevice, g_DescriptorBufferDeviceMemory);
+        for (uint32_t i = 0; i < g_UniformRingSlotCount; ++i) writeUniforms(i);
     }
 
     //descriptors
@@ -3241,7 +7901,7 @@ bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
         VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[1];
 
         descriptorSetLayoutBinding[0].binding = 0;
-        descriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         descriptorSetLayoutBinding[0].descriptorCount = 1;
         descriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
         descriptorSetLayoutBinding[0].pImmutableSamplers = NULL;
@@ -3265,7 +7925,7 @@ bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
 
         VkDescriptorPoolSize descriptorPoolSize[1];
 
-	    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	    descriptorPoolSize[0].descriptorCount = 1;
 
 	    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
@@ -3319,7 +7979,7 @@ bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
 
 	    descriptorBufferInfo.buffer = g_DescrBuffer;
 	    descriptorBufferInfo.offset = 0;
-	    descriptorBufferInfo.range = VK_WHOLE_SIZE;
+	    descriptorBufferInfo.range = sizeof modelMatrix + sizeof viewMatrix + sizeof projectionMatrix;
 
 	    VkWriteDescriptorSet writeDescriptorSet = {0};
 
@@ -3329,7 +7989,7 @@ bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
 	    writeDescriptorSet.dstBinding = 0;
 	    writeDescriptorSet.dstArrayElement = 0;
 	    writeDescriptorSet.descriptorCount = 1;
-	    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	    writeDescriptorSet.pImageInfo = NULL;
 	    writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
 	    writeDescriptorSet.pTexelBufferView = NULL;
@@ -3337,755 +7997,1091 @@ bool initVulkan(xcb_window_t wnd, xcb_connection_t *conn)
 	    pfn_vkUpdateDescriptorSets(g_LogicalDevice,1,&writeDescriptorSet,0,NULL);
     }
 
-    //create shader stage, graphics pipeline
+    startupPhaseBegin("shader modules");
+
+    //the modules were built on the workers meanwhile, this is what the setup above did not hide
+    waitJobs(&g_ShaderJobCounter);
+
+    startupPhaseBegin("pipeline creation");
+
+    //pipeline cache
+    if (!createPipelineCache()) return false;
+
+    //pipeline layout, the pipeline itself is built by a worker
+    {
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = &g_DescriptorSetLayout;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+
+	    VkResult result = pfn_vkCreatePipelineLayout(g_LogicalDevice,
+                                &pipelineLayoutCreateInfo, NULL, &g_PipelineLayout);
+
+	    if (result != VK_SUCCESS)
+        {
+	        printErrorMsg("vkCreatePipelineLayout().\n");
+	        return false;
+	    }
+
+        printInfoMsg("vkCreatePipelineLayout() OK.\n");
+    }
+
+    g_PipelineJob.shaders = &g_ShaderJobCounter;
+    g_PipelineJob.pipeline = &g_Pipeline;
+    g_PipelineJob.ok = false;
+
+    if (!submitJob(graphicsPipelineJob, &g_PipelineJob, &g_PipelineJobCounter)) return false;
+
+    //the compute pipeline is built here while a worker builds the graphics pipeline
+    if (g_GpuCulling && !createCulling()) return false;
+
+    startupPhaseBegin("pipeline wait");
+
+    //first use of the pipeline, the main thread waits only here
+    waitJobs(&g_PipelineJobCounter);
+
+    if (!g_PipelineJob.ok)
+    {
+        printErrorMsg("graphics pipeline.\n");
+        return false;
+    }
+
+    if (g_WatchShaders) initShaderWatch();
+
+    startupPhaseEnd();
+
+    //before the first frame, the command pools of frame 0 are idle
+    if (g_RecordBenchIterations) recordBenchmark();
+
+    printMemoryStats();
+
+    return true;
+}
+
+/*
+==============================
+ renderVulkan();
+==============================
+*/
+
+//returns false if no frame was submitted
+bool renderVulkan()
+{
+    VkResult result;
+    uint32_t imageIndex;
+    uint64_t timeStart, timeAcquired, timeRecorded, timeSubmitted, timePresented;
+
+    timeStart = getTimeNs();
+
+    result = pfn_vkWaitForFences( g_LogicalDevice, 1, &fenceArr[currentFrame], VK_TRUE, UINT64_MAX);
+    if( result != VK_SUCCESS)
+    {
+        printErrorMsg("render error: wait for fences (2)\n");
+        //TODO
+    }
+
+    //the submission g_FramesInFlight frames ago has finished, its timestamps are available
+    readGpuTimestamps(currentFrame);
+    readCullStats(currentFrame);
+
+    //and so have its command buffers, everything allocated from the pools is recycled at once
+    resetFrameCommandPools(currentFrame);
+
+    //staging memory of finished uploads
+    collectUploads();
+
+    if (g_Headless)
+    {
+        //offscreen images are used in turn, g_ImagesInFlight guards the previous use
+        imageIndex = g_OffscreenImageIndex;
+        g_OffscreenImageIndex = (g_OffscreenImageIndex + 1) % g_SwapChainImageCount;
+    }
+    else
+    {
+        result = pfn_vkAcquireNextImageKHR( g_LogicalDevice, g_SwapChain, UINT64_MAX,
+            g_semaphoreImageAvailableArr[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            g_SwapChainDirty = true;
+            g_SwapChainOutOfDate = true;
+            return false;
+        }
+
+        if (result == VK_SUBOPTIMAL_KHR)
+        {
+            //the image is acquired and still can be presented
+            g_SwapChainDirty = true;
+        }
+        else if( result != VK_SUCCESS)
+        {
+            printErrorMsg("render error: acquire next image\n");
+            return false;
+        }
+    }
+
+    //reset only when a submission follows, otherwise the next wait would never return
+    result = pfn_vkResetFences(g_LogicalDevice, 1, &fenceArr[currentFrame]);
+    if( result != VK_SUCCESS)
+    {
+        printErrorMsg("render error: reset fences (2)\n");
+        //TODO
+    }
+
+    //the image may still be used by another frame in flight
+    if (g_ImagesInFlight[imageIndex] && g_ImagesInFlight[imageIndex] != fenceArr[currentFrame])
+    {
+        result = pfn_vkWaitForFences(g_LogicalDevice, 1, &g_ImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        if( result != VK_SUCCESS)
+        {
+            //the frame fence is already reset and nothing will signal it, the loop cannot go on
+            printErrorMsg("render error: wait for image fence\n");
+            g_Quit = true;
+            return false;
+        }
+    }
+
+    g_ImagesInFlight[imageIndex] = fenceArr[currentFrame];
+
+    //the frame's fence is signaled, its uniform slot is free
+    writeUniforms(currentFrame);
+
+    timeAcquired = getTimeNs();
+
+    writeDrawCommands(currentFrame);
+
+    recordFrame(currentFrame, imageIndex, g_RecordThreadCount);
+
+    destroyRetiredPipelines();
+
+    timeRecorded = getTimeNs();
+
+    //the image is written only after the presentation engine released it
+    VkPipelineStageFlags pipelineStageFlags = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+    VkSubmitInfo submitInfo = {0};
+
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = g_Headless ? 0 : 1;
+    submitInfo.pWaitSemaphores = &g_semaphoreImageAvailableArr[currentFrame];
+    submitInfo.pWaitDstStageMask = &pipelineStageFlags;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &g_FrameCommandBuffers[currentFrame];
+    submitInfo.signalSemaphoreCount = g_Headless ? 0 : 1;
+    submitInfo.pSignalSemaphores = &g_semaphoreRenderFinishedArr[currentFrame];
+
+    result = pfn_vkQueueSubmit( g_GraphicsQueue, 1, &submitInfo, fenceArr[currentFrame]);
+
+    if( result != VK_SUCCESS)
+    {
+        printErrorMsg("render error: queue submit\n");
+        //TODO
+    }
+
+    timeSubmitted = getTimeNs();
+
+    if (g_TimestampQueryPool && result == VK_SUCCESS) g_FrameTimestampPending[currentFrame] = true;
+
+    if (g_GpuCulling && result == VK_SUCCESS) g_CullCountPending[currentFrame] = true;
+
+    if (g_Headless)
+    {
+        g_FrameTiming.acquire = (timeAcquired - timeStart) * 1e-6;
+        g_FrameTiming.record = (timeRecorded - timeAcquired) * 1e-6;
+        g_FrameTiming.submit = (timeSubmitted - timeRecorded) * 1e-6;
+        g_FrameTiming.present = 0.0;
+        g_FrameTiming.frame = (timeSubmitted - timeStart) * 1e-6;
+
+        currentFrame = (currentFrame + 1) % g_FramesInFlight;
+        return true;
+    }
+
+    VkPresentInfoKHR presentInfo = {0};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.pNext = NULL;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &g_semaphoreRenderFinishedArr[currentFrame];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &g_SwapChain;
+    presentInfo.pImageIndices = &imageIndex;
+    presentInfo.pResults = NULL;
+
+    result = pfn_vkQueuePresentKHR(g_GraphicsQueue, &presentInfo);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        g_SwapChainDirty = true;
+        g_SwapChainOutOfDate = true;
+    }
+    else if (result == VK_SUBOPTIMAL_KHR)
+    {
+        g_SwapChainDirty = true;
+    }
+    else if (result != VK_SUCCESS)
+    {
+        printErrorMsg("render error: queue present\n");
+    }
+
+    timePresented = getTimeNs();
+
+    g_FrameTiming.acquire = (timeAcquired - timeStart) * 1e-6;
+    g_FrameTiming.record = (timeRecorded - timeAcquired) * 1e-6;
+    g_FrameTiming.submit = (timeSubmitted - timeRecorded) * 1e-6;
+    g_FrameTiming.present = (timePresented - timeSubmitted) * 1e-6;
+    g_FrameTiming.frame = (timePresented - timeStart) * 1e-6;
+
+    currentFrame = (currentFrame + 1) % g_FramesInFlight;
+
+    return true;
+}
+
+/*
+==============================
+ benchAddSample();
+==============================
+*/
+
+bool benchAddSample(const FrameTiming *sample)
+{
+    if (g_BenchSampleCount == g_BenchSampleCapacity)
     {
-        VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {0};
+        uint32_t newCapacity = g_BenchSampleCapacity ? g_BenchSampleCapacity * 2 : 1024;
+
+        FrameTiming *newSamples = realloc(g_BenchSamples, newCapacity * sizeof(FrameTiming));
+
+        if (!newSamples)
+        {
+            printErrorMsg("unable to allocate memory (24)\n");
+            return false;
+        }
+
+        g_BenchSamples = newSamples;
+        g_BenchSampleCapacity = newCapacity;
+    }
+
+    g_BenchSamples[g_BenchSampleCount++] = *sample;
+
+    return true;
+}
+
+/*
+==============================
+ compareDouble();
+==============================
+*/
+
+static int compareDouble(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
 
-        vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertexShaderStageInfo.module = g_vertShaderModule;
-        vertexShaderStageInfo.pName = "main";
+    return (da > db) - (da < db);
+}
 
-        VkPipelineShaderStageCreateInfo fragmentShaderStageInfo = {0};
+/*
+==============================
+ computeStats();
+==============================
+*/
 
-        fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragmentShaderStageInfo.module = g_fragShaderModule;
-        fragmentShaderStageInfo.pName = "main";
+//sorts values in place, nearest-rank percentiles
+void computeStats(double *values, uint32_t count, TimeStats *stats)
+{
+    double sum = 0.0;
 
+    memset(stats, 0, sizeof(TimeStats));
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertexShaderStageInfo, fragmentShaderStageInfo};
+    if (!count) return;
 
-        VkVertexInputBindingDescription vertexInputBindingDescription = {0};
+    qsort(values, count, sizeof(double), compareDouble);
 
-        vertexInputBindingDescription.binding = 0;
-        vertexInputBindingDescription.stride = sizeof(Vertex);
-        vertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    for (uint32_t i = 0; i < count; ++i) sum += values[i];
 
-        VkVertexInputAttributeDescription vertexInputAttributeDescriptions[2]={0};
+    #define PERCENTILE(p) values[(uint32_t)ceil((p) / 100.0 * count) - 1]
 
-        vertexInputAttributeDescriptions[0].location = 0;
-        vertexInputAttributeDescriptions[0].binding = 0;
-        vertexInputAttributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        vertexInputAttributeDescriptions[0].offset = 0;
+    stats->min = values[0];
+    stats->mean = sum / count;
+    stats->p50 = PERCENTILE(50.0);
+    stats->p95 = PERCENTILE(95.0);
+    stats->p99 = PERCENTILE(99.0);
+    stats->max = values[count - 1];
 
-        vertexInputAttributeDescriptions[1].location = 1;
-        vertexInputAttributeDescriptions[1].binding = 0;
-        vertexInputAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexInputAttributeDescriptions[1].offset = offsetof( Vertex, r );
+    #undef PERCENTILE
+}
 
-        VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {0};
+/*
+==============================
+ timingReport();
+==============================
+*/
 
-        vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-        vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDescription;
-        vertexInputStateCreateInfo.vertexAttributeDescriptionCount = 2;
-        vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescriptions;
+//CPU frame times of --bench and GPU render pass times of --gpu-timing
+void timingReport()
+{
+    static const struct{
+        const char *name;
+        size_t offset;
+    } cpuMetrics[] = {
+        {"acquire", offsetof(FrameTiming, acquire)},
+        {"record",  offsetof(FrameTiming, record)},
+        {"submit",  offsetof(FrameTiming, submit)},
+        {"present", offsetof(FrameTiming, present)},
+        {"frame",   offsetof(FrameTiming, frame)},
+    };
+
+    const uint32_t cpuMetricsCount = sizeof(cpuMetrics) / sizeof(cpuMetrics[0]);
+
+    const char *names[sizeof(cpuMetrics) / sizeof(cpuMetrics[0]) + 1];
+    uint32_t counts[sizeof(cpuMetrics) / sizeof(cpuMetrics[0]) + 1];
+    TimeStats stats[sizeof(cpuMetrics) / sizeof(cpuMetrics[0]) + 1];
+    uint32_t metricsCount = 0;
+
+    uint32_t maxCount = g_BenchSampleCount > g_GpuTimeCount ? g_BenchSampleCount : g_GpuTimeCount;
+
+    if (!maxCount)
+    {
+        printWarningMsg("timing report: no frames measured.\n");
+        return;
+    }
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {0};
+    double *values = malloc(maxCount * sizeof(double));
 
-        inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+    if (!values)
+    {
+        printErrorMsg("unable to allocate memory (25)\n");
+        return;
+    }
 
-        VkViewport viewport = {0};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = g_SwapChainExtent.width;
-        viewport.height = g_SwapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
+    if (g_BenchSampleCount)
+    {
+        for (uint32_t m = 0; m < cpuMetricsCount; ++m)
+        {
+            for (uint32_t i = 0; i < g_BenchSampleCount; ++i)
+            {
+                values[i] = *(const double*)((const char*)&g_BenchSamples[i] + cpuMetrics[m].offset);
+            }
 
-        VkRect2D scissor = {0};
+            names[metricsCount] = cpuMetrics[m].name;
+            counts[metricsCount] = g_BenchSampleCount;
+            computeStats(values, g_BenchSampleCount, &stats[metricsCount++]);
+        }
+    }
 
-        scissor.offset = (VkOffset2D){0, 0};
-        scissor.extent = g_SwapChainExtent;
+    if (g_GpuTimeCount)
+    {
+        memcpy(values, g_GpuTimes, g_GpuTimeCount * sizeof(double));
 
-        VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {0};
-        viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportStateCreateInfo.viewportCount = 1;
-        viewportStateCreateInfo.pViewports = &viewport;
-        viewportStateCreateInfo.scissorCount = 1;
-        viewportStateCreateInfo.pScissors = &scissor;
+        names[metricsCount] = "gpu";
+        counts[metricsCount] = g_GpuTimeCount;
+        computeStats(values, g_GpuTimeCount, &stats[metricsCount++]);
+    }
 
-        VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {0};
+    free(values);
 
-        rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizationStateCreateInfo.depthClampEnable = VK_FALSE;
-        rasterizationStateCreateInfo.rasterizerDiscardEnable = VK_FALSE;
-        rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizationStateCreateInfo.lineWidth = 1.0f;
-        rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizationStateCreateInfo.depthBiasEnable = VK_FALSE;
+    double seconds = (g_BenchEndTime - g_BenchStartTime) * 1e-9;
+    double fps = seconds > 0.0 ? g_BenchSampleCount / seconds : 0.0;
 
-        VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {0};
+    if (g_BenchSampleCount)
+    {
+        printInfoMsg("benchmark: %u frames in %.3f s, %.2f FPS\n", g_BenchSampleCount, seconds, fps);
+    }
 
-        multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;
-        multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    const MeshVertexLayout *vertexLayout = &meshVertexLayouts[g_VertexFormat];
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {0};
-        colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-                                            | VK_COLOR_COMPONENT_G_BIT
-                                            | VK_COLOR_COMPONENT_B_BIT
-                                            | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachmentState.blendEnable = VK_FALSE;
+    printInfoMsg("vertex format %s, %u bytes/vertex, %u vertices\n", vertexLayout->name, vertexLayout->stride,
+        g_MegaVertexCount);
 
-        VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {0};
+    printf("%-10s %8s %9s %9s %9s %9s %9s %9s\n", "ms", "samples", "min", "mean", "p50", "p95", "p99", "max");
 
-        colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlendStateCreateInfo.logicOpEnable = VK_FALSE;
-        colorBlendStateCreateInfo.logicOp = VK_LOGIC_OP_COPY;
-        colorBlendStateCreateInfo.attachmentCount = 1;
-        colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
-        colorBlendStateCreateInfo.blendConstants[0] = 0.0f;
-        colorBlendStateCreateInfo.blendConstants[1] = 0.0f;
-        colorBlendStateCreateInfo.blendConstants[2] = 0.0f;
-        colorBlendStateCreateInfo.blendConstants[3] = 0.0f;
+    for (uint32_t m = 0; m < metricsCount; ++m)
+    {
+        printf("%-10s %8u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", names[m], counts[m],
+            stats[m].min, stats[m].mean, stats[m].p50, stats[m].p95, stats[m].p99, stats[m].max);
+    }
 
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
-        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.setLayoutCount = 1;
-        pipelineLayoutCreateInfo.pSetLayouts = &g_DescriptorSetLayout;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+    if (!g_BenchOutFileName) return;
 
-	    VkResult result = pfn_vkCreatePipelineLayout(g_LogicalDevice,
-                                &pipelineLayoutCreateInfo, NULL, &g_PipelineLayout);
+    FILE *file = fopen(g_BenchOutFileName, "w");
 
-	    if (result != VK_SUCCESS)
-        {
-	        printErrorMsg("vkCreatePipelineLayout().\n");
-	        return false;
-	    }
+    if (!file)
+    {
+        printErrorMsg("can't open benchmark output file %s\n", g_BenchOutFileName);
+        return;
+    }
 
-        printInfoMsg("vkCreatePipelineLayout() OK.\n");
+    const char *ext = strrchr(g_BenchOutFileName, '.');
 
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo = {0};
-
-        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineCreateInfo.stageCount = 2;
-        pipelineCreateInfo.pStages = shaderStages;
-        pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
-        pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-        pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
-        pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
-        pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
-        pipelineCreateInfo.layout = g_PipelineLayout;
-        pipelineCreateInfo.renderPass = g_RenderPass;
-        pipelineCreateInfo.subpass = 0;
-        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-	    result = pfn_vkCreateGraphicsPipelines(g_LogicalDevice,
-                                VK_NULL_HANDLE,1,&pipelineCreateInfo,NULL,&g_Pipeline);
+    if (ext && !strcmp(ext, ".csv"))
+    {
+        fprintf(file, "metric,frames,seconds,fps,vertex_format,vertex_bytes,samples,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
 
-	    if (result != VK_SUCCESS)
+        for (uint32_t m = 0; m < metricsCount; ++m)
         {
-	        printErrorMsg("vkCreateGraphicsPipelines.\n");
-		    return false;
-	    }
-
-        printInfoMsg("vkCreatePipeline() OK.\n");
+            fprintf(file, "%s,%u,%.6f,%.3f,%s,%u,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", names[m],
+                g_BenchSampleCount, seconds, fps, vertexLayout->name, vertexLayout->stride, counts[m],
+                stats[m].min, stats[m].mean, stats[m].p50, stats[m].p95, stats[m].p99, stats[m].max);
+        }
     }
-
-    //recording a command buffers
-    for(uint32_t i = 0; i < g_SwapChainImageCount; ++i)
+    else
     {
-        VkCommandBufferBeginInfo beginInfo = {0};
+        fprintf(file, "{\n  \"frames\": %u,\n  \"seconds\": %.6f,\n  \"fps\": %.3f", g_BenchSampleCount, seconds, fps);
+        fprintf(file, ",\n  \"vertex_format\": \"%s\",\n  \"vertex_bytes\": %u", vertexLayout->name, vertexLayout->stride);
 
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-        pfn_vkBeginCommandBuffer(g_CommandBuffers[i], &beginInfo);
+        for (uint32_t m = 0; m < metricsCount; ++m)
+        {
+            fprintf(file, ",\n  \"%s_ms\": {\"samples\": %u, \"min\": %.6f, \"mean\": %.6f, \"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f}",
+                names[m], counts[m],
+                stats[m].min, stats[m].mean, stats[m].p50, stats[m].p95, stats[m].p99, stats[m].max);
+        }
 
-        VkClearValue clearValue[] = {
-            {.color = {.float32 = {0.0f,0.5f,0.5f,1.0f}}},
-            {.depthStencil = {.depth = 1.0,.stencil = 0}}
-        };
+        fprintf(file, "\n}\n");
+    }
 
-        VkRenderPassBeginInfo renderPassBeginInfo = {0};
+    fclose(file);
 
-        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassBeginInfo.renderPass = g_RenderPass;
-        renderPassBeginInfo.framebuffer = g_FrameBuffers[i];
+    printInfoMsg("timing results written to %s\n", g_BenchOutFileName);
+}
 
-        VkOffset2D offset = { 0, 0 };
-        VkExtent2D extent= { g_Width, g_Height };
-        VkRect2D rectangle = { offset, extent };
-        renderPassBeginInfo.renderArea = rectangle;
-        renderPassBeginInfo.clearValueCount = 2;
-        renderPassBeginInfo.pClearValues = clearValue;
+/*
+===================
+ createWindow();
+===================
+*/
 
-        pfn_vkCmdBeginRenderPass(g_CommandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+bool createWindow()
+{
+    int screenNum = 0;
+    xcb_screen_iterator_t screenIter;
+    xcb_screen_t *screen = NULL;
+    uint32_t mask;
+    uint32_t values[2];
+    xcb_generic_error_t *error;
+    xcb_void_cookie_t cookieWindow;
+    xcb_void_cookie_t cookieMap;
+    char *title = "Figure";
 
-        pfn_vkCmdBindPipeline(g_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, g_Pipeline);
+    g_Connection = xcb_connect(NULL, &screenNum);
 
-        pfn_vkCmdBindDescriptorSets(g_CommandBuffers[i],
-            VK_PIPELINE_BIND_POINT_GRAPHICS, g_PipelineLayout, 0, 1, g_DescriptorSets, 0, NULL);
+    if (g_Connection == NULL || xcb_connection_has_error(g_Connection))
+    {
+        printErrorMsg("can't connect to X server.\n");
 
-        VkBuffer vertexBuffers[] = {g_VertexBuffer};
+        if (g_Connection)
+        {
+            xcb_disconnect(g_Connection);
+            g_Connection = NULL;
+        }
 
-        VkDeviceSize offsets[] = {0};
+        return false;
+    }
 
-        pfn_vkCmdBindVertexBuffers( g_CommandBuffers[i], 0, 1, vertexBuffers, offsets );
+    printInfoMsg("connect to X server OK.\n");
 
-        pfn_vkCmdBindIndexBuffer( g_CommandBuffers[i], g_IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    screenIter = xcb_setup_roots_iterator(xcb_get_setup(g_Connection));
 
-        pfn_vkCmdDrawIndexed( g_CommandBuffers[i], sizeof indices / sizeof indices[0], 1, 0, 0, 0);
+    while (screenNum-- > 0)
+    {
+        xcb_screen_next( &screenIter );
+    }
 
-        pfn_vkCmdEndRenderPass(g_CommandBuffers[i]);
+    screen = screenIter.data;
 
-        pfn_vkEndCommandBuffer(g_CommandBuffers[i]);
+    if (!screen)
+    {
+        printErrorMsg("can't get the current screen.\n");
+        return false;
     }
 
-    return true;
-}
+    printInfoMsg("get current screen OK.\n");
 
-/*
-==============================
- updateData();
-==============================
-*/
+    g_Window = xcb_generate_id(g_Connection);
 
-void updateData()
-{
+    mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
 
-    float aspectRatio = (float) g_Width / (float) g_Height;
-    float nearZ  = 0.1f;
-	float farZ   = 1000.0f;
-    float fieldOfView = 45.0f;
+    values[0] = screen->black_pixel;
 
-    projectionMatrix[0][0]= 1.0f / (aspectRatio * (float) tanf(fieldOfView / 2.0f * TORAD));
-    projectionMatrix[0][1]=0;
-    projectionMatrix[0][2]=0;
-    projectionMatrix[0][3]=0;
-    projectionMatrix[1][0]=0;
-    projectionMatrix[1][1]= 1.0f / (float) tanf(fieldOfView / 2.0f * TORAD);
-    projectionMatrix[1][2]=0;
-    projectionMatrix[1][3]=0;
-    projectionMatrix[2][0]=0;
-    projectionMatrix[2][1]=0;
-    projectionMatrix[2][2]= (-nearZ - farZ ) / (nearZ - farZ);
-    projectionMatrix[2][3]= 1.0f;
-    projectionMatrix[3][0]=0;
-    projectionMatrix[3][1]=0;
-    projectionMatrix[3][2]= 2.0f * nearZ * farZ / (nearZ - farZ);
-    projectionMatrix[3][3]=0;
+    values[1] = XCB_EVENT_MASK_EXPOSURE |
+                    XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+                    XCB_EVENT_MASK_VISIBILITY_CHANGE |
+                    XCB_EVENT_MASK_KEY_PRESS |
+                    XCB_EVENT_MASK_KEY_RELEASE |
+                    XCB_EVENT_MASK_POINTER_MOTION |
+                    XCB_EVENT_MASK_BUTTON_PRESS |
+                    XCB_EVENT_MASK_BUTTON_RELEASE;
 
-    static float vx = 0.0f;
-    static float vy = 0.0f;
-    static float vz = 1.0f;
+    cookieWindow = xcb_create_window_checked(g_Connection,
+                                XCB_COPY_FROM_PARENT,
+                                g_Window,
+                                screen->root,
+                                0, 0, g_Width, g_Height,
+                                0,
+                                XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                                screen->root_visual,
+                                mask,
+                                values);
 
-    viewMatrix[3][0] = vx;
-    viewMatrix[3][1] = vy;
-    viewMatrix[3][2] = vz;
+    error = xcb_request_check (g_Connection, cookieWindow);
 
-    float x = 0.0f;
-    float y = 0.0f;
-    float z = 1.0f;
+    if (error)
+    {
+        printErrorMsg("can't create window : %d\n", error->error_code);
+        free(error);
+        g_Window = 0;
+        return false;
+    }
 
-    modelMatrix[3][0] = x;
-    modelMatrix[3][1] = y;
-    modelMatrix[3][2] = z;
+    printInfoMsg("create window OK.\n");
+
+    /* Magic code that will send notification when window is destroyed */
+    xcb_intern_atom_cookie_t cookie1 = xcb_intern_atom(g_Connection, 1, 12, "WM_PROTOCOLS");
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(g_Connection, cookie1, 0);
+    xcb_intern_atom_cookie_t cookie2 = xcb_intern_atom(g_Connection, 0, 16,"WM_DELETE_WINDOW");
+    g_AtomReply = xcb_intern_atom_reply(g_Connection, cookie2, 0);
+    xcb_change_property(g_Connection, XCB_PROP_MODE_REPLACE, g_Window,
+        (*reply).atom, 4, 32, 1, &(*g_AtomReply).atom);
+    free(reply);
 
-    void* data;
+    /* set title of the window */
+    xcb_change_property(g_Connection, XCB_PROP_MODE_REPLACE, g_Window,
+        XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen (title), title);
 
-    VkResult result = pfn_vkMapMemory(g_LogicalDevice, g_DescriptorBufferDeviceMemory, 0, VK_WHOLE_SIZE, 0, &data);
+    cookieMap = xcb_map_window_checked(g_Connection, g_Window);
 
-    if (result != VK_SUCCESS)
+    error = xcb_request_check(g_Connection, cookieMap);
+
+    if (error)
     {
-        printErrorMsg("descriptor buffer vkMapMemory.\n");
-        return;
+        printErrorMsg("can't map window : %d\n", error->error_code);
+        free(error);
+        return false;
     }
 
-    char *pMem = data;
-
-    memcpy(pMem, modelMatrix, sizeof modelMatrix);
-    memcpy(pMem + sizeof modelMatrix, viewMatrix, sizeof viewMatrix);
-    memcpy(pMem + sizeof modelMatrix + sizeof viewMatrix, projectionMatrix, sizeof projectionMatrix);
+    printInfoMsg("map window OK.\n");
 
-    pfn_vkUnmapMemory(g_LogicalDevice, g_DescriptorBufferDeviceMemory);
+    xcb_flush (g_Connection);
 
+    return true;
 }
 
 /*
-==============================
- renderVulkan();
-==============================
+===================
+ destroyWindow();
+===================
 */
 
-void renderVulkan()
+void destroyWindow()
 {
-    VkResult result;
-    uint32_t imageIndex;
-
-    result = pfn_vkWaitForFences( g_LogicalDevice, 1, &fenceArr[currentFrame], VK_TRUE, UINT64_MAX);
-    if( result != VK_SUCCESS)
+    if (g_AtomReply)
     {
-        printErrorMsg("render error: wait for fences (2)\n");
-        //TODO
+        free(g_AtomReply);
+        g_AtomReply = NULL;
     }
 
-    result = pfn_vkResetFences(g_LogicalDevice, 1, &fenceArr[currentFrame]);
-    if( result != VK_SUCCESS)
+    if (g_Connection)
     {
-        printErrorMsg("render error: reset fences (2)\n");
-        //TODO
+        if (g_Window) xcb_destroy_window(g_Connection, g_Window);
+        xcb_disconnect(g_Connection);
     }
 
-    result = pfn_vkAcquireNextImageKHR( g_LogicalDevice, g_SwapChain, UINT64_MAX,
-        g_semaphoreImageAvailableArr[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    g_Window = 0;
+    g_Connection = NULL;
+}
 
-    if( result != VK_SUCCESS)
-    {
-        printErrorMsg("render error: acquire next image\n");
-        //TODO
-    }
+/*
+===================
+ signalHandler();
+===================
+*/
 
-    VkPipelineStageFlags pipelineStageFlags = { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+static void signalHandler(int sig)
+{
+    (void)sig;
+    g_Interrupted = 1;
+}
 
-    VkSubmitInfo submitInfo = {0};
+/*
+===================
+ waitForEvents();
+===================
+*/
 
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &g_semaphoreImageAvailableArr[currentFrame];
-    submitInfo.pWaitDstStageMask = &pipelineStageFlags;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &g_CommandBuffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &g_semaphoreRenderFinishedArr[currentFrame];
+//blocks until the X connection has data, a signal arrives or timeoutMs passes (-1 forever)
+void waitForEvents(int timeoutMs)
+{
+    struct pollfd pfd;
 
-    pfn_vkQueueSubmit( g_GraphicsQueue, 1, &submitInfo, fenceArr[currentFrame]);
+    xcb_flush(g_Connection);
 
-    if( result != VK_SUCCESS)
-    {
-        printErrorMsg("render error: queue submit\n");
-        //TODO
-    }
+    pfd.fd = xcb_get_file_descriptor(g_Connection);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
 
-    VkPresentInfoKHR presentInfo = {0};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.pNext = NULL;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &g_semaphoreRenderFinishedArr[currentFrame];
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &g_SwapChain;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = NULL;
+    poll(&pfd, 1, timeoutMs);
+}
+
+/*
+===================
+ sleepUntil();
+===================
+*/
+
+void sleepUntil(uint64_t timeNs)
+{
+    struct timespec ts;
 
-    pfn_vkQueuePresentKHR(g_GraphicsQueue, &presentInfo);
+    ts.tv_sec = timeNs / 1000000000ull;
+    ts.tv_nsec = timeNs % 1000000000ull;
 
-    currentFrame = (currentFrame + 1) % SWAP_CHAIN_IMAGE_COUNT;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !g_Interrupted);
 }
 
 /*
 ===================
- main();
+ processEvent();
 ===================
 */
 
-int main(int argc, char **argv)
+void processEvent(xcb_generic_event_t *event)
 {
-
-    void *libHandle = NULL;
-    char *envVar;
-    xcb_connection_t *connection = NULL;
-    int screenNum = 0;
-    xcb_screen_iterator_t screenIter;
-    xcb_screen_t *screen = NULL;
-    xcb_window_t window = 0;
-    uint32_t mask;
-    uint32_t values[2];
-    xcb_generic_error_t *error;
-    xcb_void_cookie_t cookieWindow;
-    xcb_void_cookie_t cookieMap;
-    xcb_intern_atom_reply_t *atomReply = NULL;
-    char *title = "Figure";
-    xcb_generic_event_t *event;
     xcb_key_press_event_t *keyEvent;
+    xcb_configure_notify_event_t *configureNotifyEvent;
+    xcb_visibility_notify_event_t *visibilityNotifyEvent;
+    xcb_button_press_event_t *buttonPressEvent;
+    xcb_motion_notify_event_t *motionNotify;
 
-    if(!parseOptions(argc, argv))
+    switch (event->response_type & ~0x80)
     {
-        return -1;
-    }
 
-    printInfoMsg("Starting a program.\n");
+        case XCB_EXPOSE:
 
-    libHandle = openLibrary("libvulkan.so");
+            xcb_flush(g_Connection);
 
-    if (!libHandle)
-    {
-        return -1;
-    }
+            break;
+
+        case XCB_CLIENT_MESSAGE:
+
+            if ((*(xcb_client_message_event_t*)event).data.data32[0] == (*g_AtomReply).atom)
+            {
+                g_Quit = true;
+            }
+
+            break;
 
-    printInfoMsg("shared library libvulkan.so openned OK.\n");
+        case XCB_CONFIGURE_NOTIFY:
 
-    if (!getFncAddress(libHandle))
-    {
-        printErrorMsg("failed to load functions pointers.\n");
+            configureNotifyEvent = (xcb_configure_notify_event_t*) event;
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+            if (configureNotifyEvent->width != g_Width || configureNotifyEvent->height != g_Height)
+            {
+                g_Width = configureNotifyEvent->width;
+                g_Height = configureNotifyEvent->height;
 
-        return -1;
-    }
+                g_ResizeLastTime = getTimeNs();
 
-    envVar = getenv("VK_LAYER_PATH");
+                if (!g_ResizePending) g_ResizeFirstTime = g_ResizeLastTime;
 
-    if (envVar == NULL)
-    {
-        printWarningMsg("environment variable VK_LAYER_PATH is not set.\n");
-    }
-    else
-    {
-        printInfoMsg("VK_LAYER_PATH: %s\n",envVar);
-    }
+                g_ResizePending = true;
+            }
 
-    connection = xcb_connect(NULL, &screenNum);
+            break;
 
-    if (connection == NULL)
-    {
-        printErrorMsg("can't connect to X server.\n");
+        case XCB_MAP_NOTIFY:
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+            g_WindowHidden = false;
 
-        return 1;
-    }
+            break;
 
-    printInfoMsg("connect to X server OK.\n");
+        case XCB_UNMAP_NOTIFY:
 
-    screenIter = xcb_setup_roots_iterator(xcb_get_setup(connection));
+            g_WindowHidden = true;
 
-    while (screenNum-- > 0)
-    {
-        xcb_screen_next( &screenIter );
-    }
+            break;
 
-    screen = screenIter.data;
+        case XCB_VISIBILITY_NOTIFY:
 
-    if (!screen)
-    {
-        printErrorMsg("can't get the current screen.\n");
+            visibilityNotifyEvent = (xcb_visibility_notify_event_t*) event;
 
-        xcb_disconnect(connection);
+            g_WindowHidden = visibilityNotifyEvent->state == XCB_VISIBILITY_FULLY_OBSCURED;
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+            break;
 
-        return 1;
-    }
+        case XCB_KEY_PRESS:
 
-    printInfoMsg("get current screen OK.\n");
+            keyEvent = (xcb_key_press_event_t*)event;
 
-    window = xcb_generate_id(connection);
+            switch (keyEvent->detail)
+            {
+                case 0x9:	//Esc
 
-    mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+                    g_Quit = true;
 
-    values[0] = screen->black_pixel;
+                    break;
 
-    values[1] = XCB_EVENT_MASK_EXPOSURE |
-                    XCB_EVENT_MASK_RESIZE_REDIRECT |
-                    XCB_EVENT_MASK_KEY_PRESS |
-                    XCB_EVENT_MASK_KEY_RELEASE |
-                    XCB_EVENT_MASK_POINTER_MOTION |
-                    XCB_EVENT_MASK_BUTTON_PRESS |
-                    XCB_EVENT_MASK_BUTTON_RELEASE;
+                case 0x18:	//Q
 
-    cookieWindow = xcb_create_window_checked(connection,
-                                XCB_COPY_FROM_PARENT,
-                                window,
-                                screen->root,
-                                0, 0, g_Width, g_Height,
-                                0,
-                                XCB_WINDOW_CLASS_INPUT_OUTPUT,
-                                screen->root_visual,
-                                mask,
-                                values);
+                    if (keyEvent->state & XCB_MOD_MASK_CONTROL) g_Quit = true;	//Ctrl+Q
 
-    error = xcb_request_check (connection, cookieWindow);
+                    break;
 
-    if (error)
-    {
-        printErrorMsg("can't create window : %d\n", error->error_code);
+                case 0x19:  //W
 
-        xcb_disconnect(connection);
+                    break;
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+                case 0x26:  //A
 
-        return 1;
-    }
+                    break;
 
-    printInfoMsg("create window OK.\n");
+                case 0x27:  //S
 
-    /* Magic code that will send notification when window is destroyed */
-    xcb_intern_atom_cookie_t cookie1 = xcb_intern_atom(connection, 1, 12, "WM_PROTOCOLS");
-    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection, cookie1, 0);
-    xcb_intern_atom_cookie_t cookie2 = xcb_intern_atom(connection, 0, 16,"WM_DELETE_WINDOW");
-    atomReply = xcb_intern_atom_reply(connection, cookie2, 0);
-    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
-        (*reply).atom, 4, 32, 1, &(*atomReply).atom);
-    free(reply);
+                    break;
 
-    /* set title of the window */
-    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
-        XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen (title), title);
+                case 0x28:  //D
 
-    cookieMap = xcb_map_window_checked(connection, window);
+                    break;
 
-    error = xcb_request_check(connection, cookieMap);
+                default:
+                    break;
+            }
 
-    if (error)
-    {
-        printErrorMsg("can't map window : %d\n", error->error_code);
+            break;
 
-        free(atomReply);
+        case XCB_KEY_RELEASE:
 
-        xcb_destroy_window(connection, window);
+            keyEvent = (xcb_key_press_event_t*)event;
 
-        xcb_disconnect(connection);
+            switch (keyEvent->detail)
+            {
+                case 0x19:  //W
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+                    break;
 
-        return 1;
-    }
+                case 0x26:  //A
 
-    printInfoMsg("map window OK.\n");
+                    break;
 
-    xcb_flush (connection);
+                case 0x27:  //S
 
-    if (!initVulkan(window,connection))
-    {
-        printErrorMsg("initVulkan().\n");
+                    break;
 
-        shutdownVulkan();
+                case 0x28:  //D
 
-        free(atomReply);
+                    break;
 
-        xcb_destroy_window(connection, window);
+                default:
+                    break;
+            }
 
-        xcb_disconnect(connection);
+            break;
 
-        if (closeLibrary(libHandle))
-        {
-            printErrorMsg("close libvulkan.so.\n");
-        }
+        case XCB_MOTION_NOTIFY:
 
-        return 1;
-    }
+            motionNotify = (xcb_motion_notify_event_t*)event;
 
-    g_Ready = true;
+            g_MousePosX = motionNotify->event_x;
+            g_MousePosY = motionNotify->event_y;
 
-    printInfoMsg("Ready !\n");
+            break;
 
-    while (!g_Quit)
-    {
+        case XCB_BUTTON_PRESS:
 
-        event = xcb_poll_for_event(connection);
-        xcb_resize_request_event_t *resizeRequestEvent;
-        xcb_button_press_event_t *buttonPressEvent;
-        xcb_motion_notify_event_t *motionNotify;
+            buttonPressEvent = (xcb_button_press_event_t*)event;
 
-        if (event)
-        {
-            switch (event->response_type & ~0x80)
+            switch (buttonPressEvent->detail)
             {
+                case XCB_BUTTON_INDEX_1:
 
-                case XCB_EXPOSE:
+                    g_MouseButton1 = true;
 
-                    xcb_flush(connection);
+                    g_MousePosX = buttonPressEvent->event_x;
+                    g_MousePosY = buttonPressEvent->event_y;
 
                     break;
 
-                case XCB_CLIENT_MESSAGE:
+                case XCB_BUTTON_INDEX_2:
 
-                    if ((*(xcb_client_message_event_t*)event).data.data32[0] == (*atomReply).atom)
-                    {
-                        g_Quit = true;
-                    }
+                    g_MouseButton2 = true;
 
                     break;
 
-                case XCB_RESIZE_REQUEST:
-
-                    resizeRequestEvent = (xcb_resize_request_event_t*) event;
+                case XCB_BUTTON_INDEX_3:
 
-                    if (resizeRequestEvent->width != g_Width || resizeRequestEvent->height != g_Height)
-                    {
-                        g_Ready = false;
+                    g_MouseButton3 = true;
 
-                        printInfoMsg("resize is not yet supported !\n");
-                    }
+                    break;
 
+                default:
                     break;
 
-                case XCB_KEY_PRESS:
+            }
 
-                    keyEvent = (xcb_key_press_event_t*)event;
+            break;
 
-                    switch (keyEvent->detail)
-                    {
-                        case 0x9:	//Esc
+        case XCB_BUTTON_RELEASE:
+
+            buttonPressEvent = (xcb_button_press_event_t*)event;
+
+            switch (buttonPressEvent->detail)
+            {
+                case XCB_BUTTON_INDEX_1:
 
-                            g_Quit = true;
+                    g_MouseButton1 = false;
 
-                            break;
+                    break;
 
-                        case 0x18:	//Q
+                case XCB_BUTTON_INDEX_2:
 
-                            if (keyEvent->state & XCB_MOD_MASK_CONTROL) g_Quit = true;	//Ctrl+Q
+                    g_MouseButton2 = false;
 
-                            break;
+                    break;
 
-                        case 0x19:  //W
+                case XCB_BUTTON_INDEX_3:
 
-                            break;
+                    g_MouseButton3 = false;
 
-                        case 0x26:  //A
+                    break;
 
-                            break;
+                default:
+                    break;
 
-                        case 0x27:  //S
+            }
 
-                            break;
+            break;
 
-                        case 0x28:  //D
+        default:
+            break;
 
-                            break;
+    }
+}
 
-                        default:
-                            break;
-                    }
+/*
+===================
+ main();
+===================
+*/
 
-                    break;
+int main(int argc, char **argv)
+{
 
-                case XCB_KEY_RELEASE:
+    void *libHandle = NULL;
+    char *envVar;
+    xcb_generic_event_t *event;
+    uint64_t nextFrameTime = 0;
 
-                    keyEvent = (xcb_key_press_event_t*)event;
+    g_StartupTime = getTimeNs();
 
-                    switch (keyEvent->detail)
-                    {
-                        case 0x19:  //W
+    if(!parseOptions(argc, argv))
+    {
+        return -1;
+    }
+
+    //default: one worker per core, at most 4, startup work is a handful of jobs
+    if (!g_WorkerThreadCount)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
 
-                            break;
+        g_WorkerThreadCount = cores < 1 ? 1 : (cores > 4 ? 4 : (uint32_t)cores);
+    }
+
+    if (g_GpuCulling && !g_IndirectDraws)
+    {
+        printErrorMsg("--gpu-cull needs indirect draws, it can't be combined with --direct.\n");
+        return -1;
+    }
 
-                        case 0x26:  //A
+    //one worker per recording slice
+    if (g_WorkerThreadCount < g_RecordThreadCount) g_WorkerThreadCount = g_RecordThreadCount;
 
-                            break;
+    g_RecordSliceCapacity = g_RecordThreadCount;
 
-                        case 0x27:  //S
+    if (g_RecordBenchIterations && !g_RecordSliceCapacity) g_RecordSliceCapacity = g_WorkerThreadCount;
 
-                            break;
+    printInfoMsg("Starting a program.\n");
 
-                        case 0x28:  //D
+    startupPhaseBegin("dlopen libvulkan.so");
 
-                            break;
+    libHandle = openLibrary("libvulkan.so");
 
-                        default:
-                            break;
-                    }
+    if (!libHandle)
+    {
+        return -1;
+    }
 
-                    break;
+    printInfoMsg("shared library libvulkan.so openned OK.\n");
 
-                case XCB_MOTION_NOTIFY:
+    if (!getFncAddress(libHandle))
+    {
+        printErrorMsg("failed to load functions pointers.\n");
 
-                    motionNotify = (xcb_motion_notify_event_t*)event;
+        if (closeLibrary(libHandle))
+        {
+            printErrorMsg("close libvulkan.so.\n");
+        }
 
-                    g_MousePosX = motionNotify->event_x;
-                    g_MousePosY = motionNotify->event_y;
+        return -1;
+    }
 
-                    break;
+    startupPhaseEnd();
 
-                case XCB_BUTTON_PRESS:
+    envVar = getenv("VK_LAYER_PATH");
 
-                    buttonPressEvent = (xcb_button_press_event_t*)event;
+    if (envVar == NULL)
+    {
+        printWarningMsg("environment variable VK_LAYER_PATH is not set.\n");
+    }
+    else
+    {
+        printInfoMsg("VK_LAYER_PATH: %s\n",envVar);
+    }
 
-                    switch (buttonPressEvent->detail)
-                    {
-                        case XCB_BUTTON_INDEX_1:
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
 
-                            g_MouseButton1 = true;
+    startupPhaseBegin("window");
 
-                            g_MousePosX = buttonPressEvent->event_x;
-                            g_MousePosY = buttonPressEvent->event_y;
+    if (g_Headless)
+    {
+        printInfoMsg("headless mode, X server is not used.\n");
+    }
+    else if (!createWindow())
+    {
+        destroyWindow();
 
-                            break;
+        if (closeLibrary(libHandle))
+        {
+            printErrorMsg("close libvulkan.so.\n");
+        }
 
-                        case XCB_BUTTON_INDEX_2:
+        return 1;
+    }
 
-                            g_MouseButton2 = true;
+    if (!initVulkan(g_Window, g_Connection))
+    {
+        printErrorMsg("initVulkan().\n");
 
-                            break;
+        shutdownVulkan();
 
-                        case XCB_BUTTON_INDEX_3:
+        destroyWindow();
 
-                            g_MouseButton3 = true;
+        if (closeLibrary(libHandle))
+        {
+            printErrorMsg("close libvulkan.so.\n");
+        }
 
-                            break;
+        return 1;
+    }
 
-                        default:
-                            break;
+    g_Ready = true;
 
-                    }
+    printInfoMsg("Ready !\n");
 
-                    break;
+    startupPhaseBegin("first frame");
 
-                case XCB_BUTTON_RELEASE:
+    while (!g_Quit)
+    {
 
-                    buttonPressEvent = (xcb_button_press_event_t*)event;
+        if (g_Interrupted) g_Quit = true;
 
-                    switch (buttonPressEvent->detail)
-                    {
-                        case XCB_BUTTON_INDEX_1:
+        if (!g_Headless)
+        {
+            //drain everything that is pending, one frame may be late by many events
+            while ((event = xcb_poll_for_event(g_Connection)))
+            {
+                processEvent(event);
+                free(event);
+            }
 
-                            g_MouseButton1 = false;
+            if (xcb_connection_has_error(g_Connection))
+            {
+                printErrorMsg("connection to X server lost.\n");
+                g_Quit = true;
+                continue;
+            }
+        }
 
-                            break;
+        //a drag-resize rebuilds the swapchain once the events settle, at most every RESIZE_MAX_DELAY_NS
+        if (g_ResizePending)
+        {
+            uint64_t now = getTimeNs();
 
-                        case XCB_BUTTON_INDEX_2:
+            if (now - g_ResizeLastTime >= RESIZE_SETTLE_TIME_NS || now - g_ResizeFirstTime >= RESIZE_MAX_DELAY_NS)
+            {
+                g_ResizePending = false;
+                g_SwapChainDirty = true;
+            }
+        }
 
-                            g_MouseButton2 = false;
+        if (g_Ready && g_SwapChainDirty && !g_ResizePending)
+        {
+            if (!recreateSwapChain())
+            {
+                printErrorMsg("recreateSwapChain().\n");
+                g_Quit = true;
+                continue;
+            }
+        }
 
-                            break;
+        //paused, sleep until the X server has something for us
+        if (!g_Headless && (!g_Ready || g_SwapChainOutOfDate || g_WindowHidden))
+        {
+            int timeoutMs = -1;
 
-                        case XCB_BUTTON_INDEX_3:
+            if (g_ResizePending)
+            {
+                uint64_t now = getTimeNs();
+                uint64_t settleTime = g_ResizeLastTime + RESIZE_SETTLE_TIME_NS;
+                uint64_t maxTime = g_ResizeFirstTime + RESIZE_MAX_DELAY_NS;
+                uint64_t wakeTime = settleTime < maxTime ? settleTime : maxTime;
 
-                            g_MouseButton3 = false;
+                timeoutMs = wakeTime > now ? (int)((wakeTime - now) / 1000000ull) + 1 : 0;
+            }
 
-                            break;
+            waitForEvents(timeoutMs);
 
-                        default:
-                            break;
+            //the frame limiter starts over after a pause
+            nextFrameTime = 0;
 
-                    }
+            continue;
+        }
 
-                    break;
+        if (g_Ready && g_ShaderWatchFd >= 0) pollShaderWatch();
 
-                default:
-                    break;
+        if (g_FpsLimit)
+        {
+            uint64_t period = 1000000000ull / g_FpsLimit;
+            uint64_t now = getTimeNs();
 
-            }
+            //too far behind, don't try to catch up with a burst of frames
+            if (!nextFrameTime || now > nextFrameTime + period) nextFrameTime = now;
 
-            free (event);
+            sleepUntil(nextFrameTime);
 
+            nextFrameTime += period;
         }
 
-        if (g_Ready)
+        if (g_Ready && !g_SwapChainOutOfDate)
         {
+            uint64_t frameStart = getTimeNs();
+
+            if ((g_BenchFrames || g_BenchSeconds) && !g_BenchStartTime) g_BenchStartTime = frameStart;
+
             updateData();
-            renderVulkan();
+
+            bool rendered = renderVulkan();
+
+            if (rendered && !g_StartupReported) startupReport();
+
+            if (rendered && (g_BenchFrames || g_BenchSeconds))
+            {
+                //frame includes updateData() as well
+                g_BenchEndTime = getTimeNs();
+                g_FrameTiming.frame = (g_BenchEndTime - frameStart) * 1e-6;
+
+                if (!benchAddSample(&g_FrameTiming)) g_Quit = true;
+
+                if (g_BenchFrames && g_BenchSampleCount >= g_BenchFrames) g_Quit = true;
+                if (g_BenchSeconds && g_BenchEndTime - g_BenchStartTime >= g_BenchSeconds * 1000000000ull) g_Quit = true;
+            }
         }
 
     }
@@ -4093,11 +9089,26 @@ int main(int argc, char **argv)
     //TODO
     if (g_LogicalDevice && pfn_vkDeviceWaitIdle) pfn_vkDeviceWaitIdle(g_LogicalDevice);
 
+    if (g_BenchFrames || g_BenchSeconds || g_GpuTiming)
+    {
+        //collect timestamps of the frames still in flight
+        if (g_GpuTiming)
+        {
+            for (uint32_t i = 0; i < g_FramesInFlight; ++i) readGpuTimestamps(i);
+        }
+
+        timingReport();
+
+        free(g_BenchSamples);
+        g_BenchSamples = NULL;
+
+        free(g_GpuTimes);
+        g_GpuTimes = NULL;
+    }
+
     shutdownVulkan();
 
-    free(atomReply);
-    xcb_destroy_window(connection, window);
-    xcb_disconnect(connection);
+    destroyWindow();
 
     if (closeLibrary(libHandle))
     {
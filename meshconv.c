@@ -0,0 +1,638 @@
+/*
+ * meshconv, Wavefront OBJ to the binary mesh file of mesh_format.h
+ * C (C99)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#include "optparse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include "mesh_format.h"
+
+#define MAX_FACE_CORNERS 64
+
+typedef struct{
+    float *data;
+    uint32_t count;
+    uint32_t capacity;
+}FloatArray;
+
+typedef struct{
+    uint32_t *data;
+    uint32_t count;
+    uint32_t capacity;
+}IndexArray;
+
+//an output vertex is a unique position / normal pair of the faces, 1 based, normal 0 if none
+typedef struct{
+    uint32_t position;
+    uint32_t normal;
+}VertexKey;
+
+FloatArray g_Positions = {0};
+FloatArray g_Colors = {0};
+FloatArray g_Normals = {0};
+
+VertexKey *g_Vertices = NULL;
+uint32_t g_VertexCount = 0;
+uint32_t g_VertexCapacity = 0;
+
+IndexArray g_Indices = {0};
+
+//open addressing, vertex index + 1, 0 is empty
+uint32_t *g_VertexHash = NULL;
+uint32_t g_VertexHashCapacity = 0;
+
+/*
+==============================
+ usage();
+==============================
+*/
+
+void usage()
+{
+    printf("usage: meshconv [options] input.obj output.mesh\n"
+           "  -f, --format=format   float, half or snorm16 vertex positions, default float\n"
+           "  -h, --help            display help message and exit\n");
+}
+
+/*
+==============================
+ pushFloats();
+==============================
+*/
+
+bool pushFloats(FloatArray *array, const float *values, uint32_t count)
+{
+    if (array->count + count > array->capacity)
+    {
+        uint32_t capacity = array->capacity ? array->capacity * 2 : 1024;
+
+        while (capacity < array->count + count) capacity *= 2;
+
+        float *data = realloc(array->data, capacity * sizeof(float));
+
+        if (!data) return false;
+
+        array->data = data;
+        array->capacity = capacity;
+    }
+
+    memcpy(array->data + array->count, values, count * sizeof(float));
+    array->count += count;
+
+    return true;
+}
+
+/*
+==============================
+ pushIndex();
+==============================
+*/
+
+bool pushIndex(IndexArray *array, uint32_t index)
+{
+    if (array->count == array->capacity)
+    {
+        uint32_t capacity = array->capacity ? array->capacity * 2 : 1024;
+        uint32_t *data = realloc(array->data, capacity * sizeof(uint32_t));
+
+        if (!data) return false;
+
+        array->data = data;
+        array->capacity = capacity;
+    }
+
+    array->data[array->count++] = index;
+
+    return true;
+}
+
+/*
+==============================
+ hashVertexKey();
+==============================
+*/
+
+uint32_t hashVertexKey(VertexKey key)
+{
+    uint64_t hash = ((uint64_t)key.position << 32 | key.normal) * 0x9e3779b97f4a7c15ull;
+
+    return (uint32_t)(hash >> 32);
+}
+
+/*
+==============================
+ growVertexHash();
+==============================
+*/
+
+bool growVertexHash()
+{
+    uint32_t capacity = g_VertexHashCapacity ? g_VertexHashCapacity * 2 : 4096;
+    uint32_t *hash = calloc(capacity, sizeof(uint32_t));
+
+    if (!hash) return false;
+
+    for (uint32_t i = 0; i < g_VertexCount; ++i)
+    {
+        uint32_t slot = hashVertexKey(g_Vertices[i]) & (capacity - 1);
+
+        while (hash[slot]) slot = (slot + 1) & (capacity - 1);
+
+        hash[slot] = i + 1;
+    }
+
+    free(g_VertexHash);
+    g_VertexHash = hash;
+    g_VertexHashCapacity = capacity;
+
+    return true;
+}
+
+/*
+==============================
+ findOrAddVertex();
+==============================
+*/
+
+//index of the output vertex of a face corner, UINT32_MAX if out of memory
+uint32_t findOrAddVertex(VertexKey key)
+{
+    if ((g_VertexCount + 1) * 2 > g_VertexHashCapacity && !growVertexHash()) return UINT32_MAX;
+
+    uint32_t slot = hashVertexKey(key) & (g_VertexHashCapacity - 1);
+
+    while (g_VertexHash[slot])
+    {
+        const VertexKey *found = &g_Vertices[g_VertexHash[slot] - 1];
+
+        if (found->position == key.position && found->normal == key.normal) return g_VertexHash[slot] - 1;
+
+        slot = (slot + 1) & (g_VertexHashCapacity - 1);
+    }
+
+    if (g_VertexCount == g_VertexCapacity)
+    {
+        uint32_t capacity = g_VertexCapacity ? g_VertexCapacity * 2 : 1024;
+        VertexKey *vertices = realloc(g_Vertices, capacity * sizeof(VertexKey));
+
+        if (!vertices) return UINT32_MAX;
+
+        g_Vertices = vertices;
+        g_VertexCapacity = capacity;
+    }
+
+    g_Vertices[g_VertexCount] = key;
+    g_VertexHash[slot] = g_VertexCount + 1;
+
+    return g_VertexCount++;
+}
+
+/*
+==============================
+ resolveIndex();
+==============================
+*/
+
+//OBJ indices are 1 based, negative ones count back from the last element, 0 if invalid
+uint32_t resolveIndex(long index, uint32_t count)
+{
+    if (index > 0 && (unsigned long)index <= count) return (uint32_t)index;
+
+    if (index < 0 && (unsigned long)-index <= count) return (uint32_t)(count + 1 + index);
+
+    return 0;
+}
+
+/*
+==============================
+ parseFace();
+==============================
+*/
+
+//v, v/vt, v//vn or v/vt/vn corners, the polygon is triangulated as a fan
+bool parseFace(char *line, uint32_t lineNumber)
+{
+    uint32_t corners[MAX_FACE_CORNERS];
+    uint32_t cornerCount = 0;
+
+    for (char *token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n"))
+    {
+        if (cornerCount == MAX_FACE_CORNERS)
+        {
+            fprintf(stderr, "line %u: more than %d face corners.\n", lineNumber, MAX_FACE_CORNERS);
+            return false;
+        }
+
+        char *end;
+        VertexKey key = {0};
+
+        key.position = resolveIndex(strtol(token, &end, 10), g_Positions.count / 3);
+
+        if (!key.position)
+        {
+            fprintf(stderr, "line %u: bad position index %s.\n", lineNumber, token);
+            return false;
+        }
+
+        if (*end == '/')
+        {
+            char *normal = strchr(end + 1, '/');
+
+            if (normal)
+            {
+                key.normal = resolveIndex(strtol(normal + 1, NULL, 10), g_Normals.count / 3);
+
+                if (!key.normal)
+                {
+                    fprintf(stderr, "line %u: bad normal index %s.\n", lineNumber, token);
+                    return false;
+                }
+            }
+        }
+
+        corners[cornerCount] = findOrAddVertex(key);
+
+        if (corners[cornerCount] == UINT32_MAX)
+        {
+            fprintf(stderr, "unable to allocate memory (1).\n");
+            return false;
+        }
+
+        cornerCount++;
+    }
+
+    if (cornerCount < 3)
+    {
+        fprintf(stderr, "line %u: face with %u corners.\n", lineNumber, cornerCount);
+        return false;
+    }
+
+    for (uint32_t i = 1; i + 1 < cornerCount; ++i)
+    {
+        if (!pushIndex(&g_Indices, corners[0]) || !pushIndex(&g_Indices, corners[i]) ||
+            !pushIndex(&g_Indices, corners[i + 1]))
+        {
+            fprintf(stderr, "unable to allocate memory (2).\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+==============================
+ loadObj();
+==============================
+*/
+
+//v x y z [r g b], vn x y z and f, everything else is skipped
+bool loadObj(const char *fileName)
+{
+    FILE *file = fopen(fileName, "r");
+
+    if (!file)
+    {
+        fprintf(stderr, "cannot open file %s\n", fileName);
+        return false;
+    }
+
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    uint32_t lineNumber = 0;
+    bool ok = true;
+
+    while (ok && getline(&line, &lineCapacity, file) != -1)
+    {
+        lineNumber++;
+
+        float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+
+        if (!strncmp(line, "v ", 2))
+        {
+            int count = sscanf(line + 2, "%f %f %f %f %f %f",
+                &values[0], &values[1], &values[2], &values[3], &values[4], &values[5]);
+
+            if (count != 3 && count != 6)
+            {
+                fprintf(stderr, "line %u: bad vertex.\n", lineNumber);
+                ok = false;
+            }
+            else if (!pushFloats(&g_Positions, values, 3) || !pushFloats(&g_Colors, values + 3, 3))
+            {
+                fprintf(stderr, "unable to allocate memory (3).\n");
+                ok = false;
+            }
+        }
+        else if (!strncmp(line, "vn ", 3))
+        {
+            if (sscanf(line + 3, "%f %f %f", &values[0], &values[1], &values[2]) != 3)
+            {
+                fprintf(stderr, "line %u: bad normal.\n", lineNumber);
+                ok = false;
+            }
+            else if (!pushFloats(&g_Normals, values, 3))
+            {
+                fprintf(stderr, "unable to allocate memory (4).\n");
+                ok = false;
+            }
+        }
+        else if (!strncmp(line, "f ", 2))
+        {
+            ok = parseFace(line + 2, lineNumber);
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    if (ok && !g_Indices.count)
+    {
+        fprintf(stderr, "%s has no faces.\n", fileName);
+        ok = false;
+    }
+
+    return ok;
+}
+
+/*
+==============================
+ toRendererSpace();
+==============================
+*/
+
+//OBJ is y up and seen from +z, the renderer is y down and looks down +z: a half turn around x,
+//which keeps the winding, the triangles are reversed for the clockwise front faces of the pipeline
+void toRendererSpace(float v[3])
+{
+    v[1] = -v[1];
+    v[2] = -v[2];
+}
+
+/*
+==============================
+ writeMesh();
+==============================
+*/
+
+bool writeMesh(const char *fileName, MeshVertexFormat format)
+{
+    const MeshVertexLayout *layout = &meshVertexLayouts[format];
+
+    MeshFileHeader header = {0};
+
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.headerSize = sizeof(MeshFileHeader);
+    header.indexSize = g_VertexCount <= 65536 ? 2 : 4;
+    header.layout.format = format;
+    header.layout.stride = layout->stride;
+    header.layout.normalOffset = layout->normalOffset;
+    header.layout.colorOffset = layout->colorOffset;
+    header.vertexCount = g_VertexCount;
+    header.indexCount = g_Indices.count;
+
+    uint64_t vertexDataSize = (uint64_t)g_VertexCount * layout->stride;
+    uint64_t indexDataSize = (uint64_t)g_Indices.count * header.indexSize;
+
+    header.vertexDataOffset = (sizeof(MeshFileHeader) + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+    header.indexDataOffset = (header.vertexDataOffset + vertexDataSize + MESH_FILE_ALIGNMENT - 1) &
+        ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+
+    //smooth normals for the corners without one, the area weighted sum of the faces around the position
+    float *faceNormals = calloc(g_Positions.count, sizeof(float));
+    uint8_t *vertices = malloc(vertexDataSize);
+
+    if (!faceNormals || !vertices)
+    {
+        fprintf(stderr, "unable to allocate memory (5).\n");
+        free(faceNormals);
+        free(vertices);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < g_Indices.count; i += 3)
+    {
+        const float *p[3];
+
+        for (int c = 0; c < 3; ++c) p[c] = &g_Positions.data[(g_Vertices[g_Indices.data[i + c]].position - 1) * 3];
+
+        float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+        for (int c = 0; c < 3; ++c)
+        {
+            float *sum = &faceNormals[(g_Vertices[g_Indices.data[i + c]].position - 1) * 3];
+
+            sum[0] += n[0];
+            sum[1] += n[1];
+            sum[2] += n[2];
+        }
+    }
+
+    float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    for (uint32_t i = 0; i < g_VertexCount; ++i)
+    {
+        float position[3];
+
+        memcpy(position, &g_Positions.data[(g_Vertices[i].position - 1) * 3], sizeof position);
+        toRendererSpace(position);
+
+        float length = sqrtf(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+
+        if (length > header.radius) header.radius = length;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            boundsMin[j] = fminf(boundsMin[j], position[j]);
+            boundsMax[j] = fmaxf(boundsMax[j], position[j]);
+        }
+    }
+
+    header.dequantScale = 1.0f;
+
+    if (layout->quantized)
+    {
+        float extent = 0.0f;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            header.dequantOffset[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+            extent = fmaxf(extent, (boundsMax[j] - boundsMin[j]) * 0.5f);
+        }
+
+        if (extent > 0.0f) header.dequantScale = extent;
+    }
+
+    memcpy(header.boundsMin, boundsMin, sizeof boundsMin);
+    memcpy(header.boundsMax, boundsMax, sizeof boundsMax);
+
+    for (uint32_t i = 0; i < g_VertexCount; ++i)
+    {
+        const VertexKey *key = &g_Vertices[i];
+        float position[3], normal[3], color[3];
+
+        memcpy(position, &g_Positions.data[(key->position - 1) * 3], sizeof position);
+        memcpy(color, &g_Colors.data[(key->position - 1) * 3], sizeof color);
+
+        if (key->normal)
+            memcpy(normal, &g_Normals.data[(key->normal - 1) * 3], sizeof normal);
+        else
+            memcpy(normal, &faceNormals[(key->position - 1) * 3], sizeof normal);
+
+        toRendererSpace(position);
+        toRendererSpace(normal);
+
+        meshPackVertex(format, position, normal, color, header.dequantScale, header.dequantOffset,
+            vertices + (size_t)i * layout->stride);
+    }
+
+    free(faceNormals);
+
+    FILE *file = fopen(fileName, "wb");
+
+    if (!file)
+    {
+        fprintf(stderr, "cannot open file %s\n", fileName);
+        free(vertices);
+        return false;
+    }
+
+    static const uint8_t padding[MESH_FILE_ALIGNMENT] = {0};
+
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1 &&
+        fwrite(padding, 1, header.vertexDataOffset - sizeof header, file) == header.vertexDataOffset - sizeof header &&
+        fwrite(vertices, 1, vertexDataSize, file) == vertexDataSize &&
+        fwrite(padding, 1, header.indexDataOffset - header.vertexDataOffset - vertexDataSize, file) ==
+            header.indexDataOffset - header.vertexDataOffset - vertexDataSize;
+
+    free(vertices);
+
+    //reversed winding, see toRendererSpace()
+    for (uint32_t i = 0; ok && i < g_Indices.count; i += 3)
+    {
+        uint32_t triangle[3] = { g_Indices.data[i], g_Indices.data[i + 2], g_Indices.data[i + 1] };
+
+        if (header.indexSize == 2)
+        {
+            uint16_t triangle16[3] = { (uint16_t)triangle[0], (uint16_t)triangle[1], (uint16_t)triangle[2] };
+
+            ok = fwrite(triangle16, sizeof triangle16, 1, file) == 1;
+        }
+        else
+        {
+            ok = fwrite(triangle, sizeof triangle, 1, file) == 1;
+        }
+    }
+
+    if (fclose(file) != 0) ok = false;
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s write error.\n", fileName);
+        return false;
+    }
+
+    printf("%s: %u vertices %s (%u bytes/vertex), %u triangles, %u bit indices, %llu bytes\n",
+        fileName, g_VertexCount, layout->name, layout->stride, g_Indices.count / 3, header.indexSize * 8,
+        (unsigned long long)(header.indexDataOffset + indexDataSize));
+
+    return true;
+}
+
+/*
+==============================
+ main();
+==============================
+*/
+
+int main(int argc, char **argv)
+{
+    MeshVertexFormat format = MESH_VERTEX_FORMAT_FLOAT;
+
+    struct optparse options;
+
+    static const struct optparse_long longopts[] = {
+        {"help",        'h',    OPTPARSE_NONE},
+        {"format",      'f',    OPTPARSE_REQUIRED},
+        { 0, 0, 0 },
+    };
+
+    optparse_init(&options, argv);
+
+    int opt, longindex;
+
+    while ((opt = optparse_long(&options, longopts, &longindex)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+            {
+                bool found = false;
+
+                for (uint32_t i = 0; i < MESH_VERTEX_FORMAT_COUNT; ++i)
+                {
+                    if (!strcmp(options.optarg, meshVertexLayouts[i].name))
+                    {
+                        format = (MeshVertexFormat)i;
+                        found = true;
+                    }
+                }
+
+                if (!found)
+                {
+                    fprintf(stderr, "unknown vertex format %s\n", options.optarg);
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            }
+
+            case 'h':
+
+                usage();
+                return EXIT_SUCCESS;
+
+            case '?':
+
+                fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    const char *inputFileName = optparse_arg(&options);
+    const char *outputFileName = optparse_arg(&options);
+
+    if (!inputFileName || !outputFileName)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    (void)argc;
+
+    bool ok = loadObj(inputFileName) && writeMesh(outputFileName, format);
+
+    free(g_Positions.data);
+    free(g_Colors.data);
+    free(g_Normals.data);
+    free(g_Vertices);
+    free(g_Indices.data);
+    free(g_VertexHash);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,18 +4,39 @@
 
 layout(location = 0) out vec3 fragColor;
 
+//float, half or snorm16 position, w is 1; RGBA8 color
 layout (location = 0) in vec4 pos;
 layout (location = 1) in vec3 col;
 
+//per instance, binding 1: xyz offset, w scale, and a color tint
+layout (location = 2) in vec4 instanceOffsetScale;
+layout (location = 3) in vec4 instanceColor;
+
+//octahedron encoded normal, 2 x snorm16
+layout (location = 4) in vec2 octNormal;
+
 layout(binding = 0) uniform UniformBufferObject {
 mat4 model;
 mat4 view;
 mat4 proj;
 } ubo;
 
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main() {
 
-    gl_Position = ubo.proj * ubo.view * ubo.model * pos;
+    vec4 instancePos = vec4(pos.xyz * instanceOffsetScale.w + instanceOffsetScale.xyz, pos.w);
+
+    gl_Position = ubo.proj * ubo.view * ubo.model * instancePos;
+
+    //headlight, a mesh facing the camera keeps its color
+    vec3 normal = normalize(mat3(ubo.view * ubo.model) * octDecode(octNormal));
 
-    fragColor = col;
+    fragColor = col * instanceColor.rgb * abs(normal.z);
 }